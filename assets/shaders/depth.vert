@@ -0,0 +1,22 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+} ubo;
+
+// Latched right before the frame is submitted
+layout(binding = 1) uniform CameraBufferObject {
+    mat4 view;
+    mat4 proj;
+} camera;
+
+// Only the position stream is bound
+layout(location = 0) in vec3 position;
+
+// The scene pass tests for equal depth, both shaders have to compute the exact same positions
+invariant gl_Position;
+
+void main() {
+    gl_Position = camera.proj * camera.view * ubo.model * vec4(position, 1.0);
+}
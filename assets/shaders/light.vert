@@ -3,9 +3,13 @@
 
 layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
+} ubo;
+
+// Latched right before the frame is submitted
+layout(binding = 1) uniform CameraBufferObject {
     mat4 view;
     mat4 proj;
-} ubo;
+} camera;
 
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec2 uv;
@@ -15,7 +19,7 @@ layout(location = 0) out vec2 outUV;
 layout(location = 1) out vec3 outClr;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(position, 1.0);
+    gl_Position = camera.proj * camera.view * ubo.model * vec4(position, 1.0);
     outUV = uv;
     outClr = color;
 }
\ No newline at end of file
@@ -3,9 +3,13 @@
 
 layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
+} ubo;
+
+// Latched right before the frame is submitted
+layout(binding = 1) uniform CameraBufferObject {
     mat4 view;
     mat4 proj;
-} ubo;
+} camera;
 
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
@@ -15,8 +19,11 @@ layout(location = 0) out vec3 outPos;
 layout(location = 1) out vec3 outNormal;
 layout(location = 2) out vec2 outUV;
 
+// Has to match depth.vert bit for bit, the depth pre-pass's depth is tested for equality
+invariant gl_Position;
+
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(position, 1.0);
+    gl_Position = camera.proj * camera.view * ubo.model * vec4(position, 1.0);
 
     outPos = vec3(ubo.model * vec4(position, 1.0));
     outNormal = normal;
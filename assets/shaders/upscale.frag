@@ -0,0 +1,18 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(set = 0, binding = 0) uniform sampler2D samplerScene;
+
+layout(push_constant) uniform UpscaleConstants {
+    vec2 uvScale;
+    vec2 uvMax;
+} constants;
+
+layout(location = 0) in vec2 inUV;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    // Texels right of and below the rendered part are stale, the filter must not reach them
+    outColor = texture(samplerScene, min(inUV, constants.uvMax));
+}
@@ -0,0 +1,16 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(push_constant) uniform UpscaleConstants {
+    vec2 uvScale;
+    vec2 uvMax;
+} constants;
+
+layout(location = 0) out vec2 outUV;
+
+void main() {
+    // One triangle covering the screen, (0, 0), (2, 0) and (0, 2) in UV space
+    vec2 uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
+    outUV = uv * constants.uvScale;
+}
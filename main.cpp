@@ -1,6 +1,11 @@
+#ifdef _MSC_VER
 #define _CRTDBG_MAP_ALLOC
 #include <crtdbg.h>
+#endif
+#include <cstdio>
+#include <stdexcept>
 #include <stdlib.h>
+#include <string>
 
 #include <vector>
 
@@ -11,10 +16,115 @@ const std::vector<const char *> gDeviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_
 constexpr uint32_t WIDTH = 1920;
 constexpr uint32_t HEIGHT = 1080;
 
-int main()
+namespace
 {
+void PrintUsage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [--headless [frames]] [--validation] [--on-demand] [--dynamic-resolution] [--depth-prepass]\n",
+            program);
+}
+
+// Digits only, std::stoul would accept a sign and wrap a negative count around
+bool ParseFrameCount(const std::string &text, uint32_t &frameCount)
+{
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+    try
+    {
+        const auto value = std::stoul(text);
+        if (value > UINT32_MAX)
+            return false;
+        frameCount = static_cast<uint32_t>(value);
+        return true;
+    }
+    catch (const std::logic_error &)
+    {
+        return false;
+    }
+}
+struct SOptions
+{
+    bool isHeadless = false;
+    // Empty keeps SAppInfo's default
+    std::string headlessFrames;
+    // Windowed runs always validate, headless ones only when asked, the layer would dominate their frame times
+    bool isValidation = false;
+    bool isRenderOnDemand = false;
+    bool isDynamicResolution = false;
+    bool isDepthPrepass = false;
+};
+
+// Flags may come in any order and combination
+bool ParseOptions(int argc, char **argv, SOptions &options)
+{
+    for (auto index = 1; index < argc; ++index)
+    {
+        const std::string arg = argv[index];
+        // --headless [frames] renders offscreen, e.g. on a software driver without any display
+        if (arg == "--headless")
+        {
+            options.isHeadless = true;
+            if (index + 1 < argc && argv[index + 1][0] != '-')
+                options.headlessFrames = argv[++index];
+        }
+        // --validation enables the Khronos validation layer for a headless run as well
+        else if (arg == "--validation")
+        {
+            options.isValidation = true;
+        }
+        // --on-demand only draws when something changed, it can also be toggled in the frame pacing window
+        else if (arg == "--on-demand")
+        {
+            options.isRenderOnDemand = true;
+        }
+        // --dynamic-resolution scales the scene to hold 60 fps of GPU time, it can also be tuned in the resolution
+        // window
+        else if (arg == "--dynamic-resolution")
+        {
+            options.isDynamicResolution = true;
+        }
+        // --depth-prepass lays down the scene's depth before shading it, it can also be toggled in the resolution
+        // window
+        else if (arg == "--depth-prepass")
+        {
+            options.isDepthPrepass = true;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown argument '%s'\n", argv[index]);
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+#ifdef _MSC_VER
     _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
-    SAppInfo appInfo(WIDTH, HEIGHT, gVulkanLayers, gDeviceExtensions);
+#endif
+    SOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    const auto isValidation = options.isValidation || !options.isHeadless;
+    SAppInfo appInfo(WIDTH, HEIGHT, isValidation ? gVulkanLayers : std::vector<const char *>{},
+                     options.isHeadless ? std::vector<const char *>{} : gDeviceExtensions);
+    appInfo.isHeadless = options.isHeadless;
+    if (!options.headlessFrames.empty() && !ParseFrameCount(options.headlessFrames, appInfo.headlessFrameCount))
+    {
+        fprintf(stderr, "Invalid headless frame count '%s'\n", options.headlessFrames.c_str());
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    appInfo.isRenderOnDemand = options.isRenderOnDemand;
+    appInfo.isDynamicResolution = options.isDynamicResolution;
+    appInfo.isDepthPrepass = options.isDepthPrepass;
     auto app = CApp(appInfo);
 
     app.RenderLoop();
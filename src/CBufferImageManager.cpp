@@ -1,224 +1,350 @@
 #include "CBufferImageManager.hpp"
+#include "CHostAllocator.hpp"
+#include <algorithm>
 #include <iostream>
 
-CBufferImageManager::CBufferImageManager(VkPhysicalDevice physicalDevice) : m_physicalDevice(physicalDevice)
+namespace
 {
+constexpr VkMemoryPropertyFlags kDirectWriteFlags =
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+// Without resizable BAR only this much VRAM is mappable, too little to spend on resources
+constexpr VkDeviceSize kLegacyBarSize = 256ull * 1024 * 1024;
+// Buffers above this keep using staged uploads so one resource cannot take over the mappable heap
+constexpr VkDeviceSize kDirectWriteMaxBufferSize = 64ull * 1024 * 1024;
+
+VkImageAspectFlags GetAspectMask(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_X8_D24_UNORM_PACK32:
+    case VK_FORMAT_D32_SFLOAT:
+        return VK_IMAGE_ASPECT_DEPTH_BIT;
+    case VK_FORMAT_S8_UINT:
+        return VK_IMAGE_ASPECT_STENCIL_BIT;
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+        return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    default:
+        return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
+} // namespace
+
+CBufferImageManager::CBufferImageManager(VkPhysicalDevice physicalDevice)
+    : m_physicalDevice(physicalDevice), mp_allocator(std::make_unique<CMemoryAllocator>(physicalDevice))
+{
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    for (auto i = 0u; i != memoryProperties.memoryTypeCount; ++i)
+    {
+        if ((memoryProperties.memoryTypes[i].propertyFlags & kDirectWriteFlags) != kDirectWriteFlags)
+            continue;
+        const auto heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[i].heapIndex].size;
+        if (heapSize > kLegacyBarSize)
+            m_directWriteHeapSize = std::max(m_directWriteHeapSize, heapSize);
+    }
+
+    if (m_directWriteHeapSize != 0)
+        fprintf(stdout, "Resizable BAR heap of %llu MiB, small device buffers are written directly\n",
+                static_cast<unsigned long long>(m_directWriteHeapSize / (1024 * 1024)));
 }
 
 void CBufferImageManager::CreateBuffer(const VkBufferCreateInfo createInfo, VkMemoryPropertyFlags memFlags,
-                                       SBufferHandles &bufferHandles) const
+                                       SBufferHandles &bufferHandles, EMemoryCategory category) const
 {
-    if (const auto res =
-            vkCreateBuffer(CDevice::GetInstance().GetDevice(), &createInfo, nullptr, &bufferHandles.buffer);
+    if (const auto res = vkCreateBuffer(CDevice::GetInstance().GetDevice(), &createInfo, CHostAllocator::GetCallbacks(),
+                                        &bufferHandles.buffer);
         res != VK_SUCCESS)
         throw std::runtime_error("Failed to create buffer.");
 
     VkMemoryRequirements memoryRequirements{};
     vkGetBufferMemoryRequirements(CDevice::GetInstance().GetDevice(), bufferHandles.buffer, &memoryRequirements);
 
-    VkMemoryAllocateInfo memoryAllocateInfo{};
-    memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memoryAllocateInfo.memoryTypeIndex = FindMemoryType(memoryRequirements.memoryTypeBits, memFlags);
-    memoryAllocateInfo.allocationSize = memoryRequirements.size;
+    bufferHandles.allocation = mp_allocator->Allocate(memoryRequirements, memFlags, EResourceKind::Linear, category);
 
-    if (const auto res =
-            vkAllocateMemory(CDevice::GetInstance().GetDevice(), &memoryAllocateInfo, nullptr, &bufferHandles.memory);
+    if (const auto res = vkBindBufferMemory(CDevice::GetInstance().GetDevice(), bufferHandles.buffer,
+                                            bufferHandles.allocation.memory, bufferHandles.allocation.offset);
         res != VK_SUCCESS)
-        throw std::runtime_error("Failed to create buffer device memory.");
+        throw std::runtime_error("Failed to bind buffer to memory.");
+}
 
-    if (const auto res =
-            vkBindBufferMemory(CDevice::GetInstance().GetDevice(), bufferHandles.buffer, bufferHandles.memory, 0);
+void CBufferImageManager::CreateDeviceBuffer(const VkBufferCreateInfo createInfo, SBufferHandles &bufferHandles,
+                                             EMemoryCategory category) const
+{
+    const auto device = CDevice::GetInstance().GetDevice();
+    if (const auto res = vkCreateBuffer(device, &createInfo, CHostAllocator::GetCallbacks(), &bufferHandles.buffer);
+        res != VK_SUCCESS)
+        throw std::runtime_error("Failed to create buffer.");
+
+    VkMemoryRequirements memoryRequirements{};
+    vkGetBufferMemoryRequirements(device, bufferHandles.buffer, &memoryRequirements);
+
+    const auto isDirect = m_directWriteHeapSize != 0 && memoryRequirements.size <= kDirectWriteMaxBufferSize &&
+                          mp_allocator->HasMemoryType(memoryRequirements.memoryTypeBits, kDirectWriteFlags,
+                                                      memoryRequirements.size);
+    const auto memoryFlags = isDirect ? kDirectWriteFlags : VkMemoryPropertyFlags{VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT};
+    bufferHandles.allocation = mp_allocator->Allocate(memoryRequirements, memoryFlags, EResourceKind::Linear, category);
+
+    if (const auto res = vkBindBufferMemory(device, bufferHandles.buffer, bufferHandles.allocation.memory,
+                                            bufferHandles.allocation.offset);
         res != VK_SUCCESS)
         throw std::runtime_error("Failed to bind buffer to memory.");
 }
 
 void CBufferImageManager::CreateImage(const VkImageCreateInfo createInfo, VkMemoryPropertyFlags memFlags,
-                                      SImageHandles &imageHandles) const
+                                      SImageHandles &imageHandles, EMemoryCategory category) const
 {
-    if (const auto res = vkCreateImage(CDevice::GetInstance().GetDevice(), &createInfo, nullptr, &imageHandles.image);
+    if (const auto res = vkCreateImage(CDevice::GetInstance().GetDevice(), &createInfo, CHostAllocator::GetCallbacks(),
+                                       &imageHandles.image);
         res != VK_SUCCESS)
         throw std::runtime_error("Failed to create image.");
 
     VkMemoryRequirements memReq;
     vkGetImageMemoryRequirements(CDevice::GetInstance().GetDevice(), imageHandles.image, &memReq);
 
-    VkMemoryAllocateInfo allocateInfo{};
-    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocateInfo.allocationSize = memReq.size;
-    allocateInfo.memoryTypeIndex = FindMemoryType(memReq.memoryTypeBits, memFlags);
-
-    if (const auto res =
-            vkAllocateMemory(CDevice::GetInstance().GetDevice(), &allocateInfo, nullptr, &imageHandles.memory);
-        res != VK_SUCCESS)
-        throw std::runtime_error("Failed to allocate image memory.");
+    const auto kind = createInfo.tiling == VK_IMAGE_TILING_LINEAR ? EResourceKind::Linear : EResourceKind::Optimal;
+    imageHandles.allocation = mp_allocator->Allocate(memReq, memFlags, kind, category);
 
-    if (const auto res =
-            vkBindImageMemory(CDevice::GetInstance().GetDevice(), imageHandles.image, imageHandles.memory, 0);
+    if (const auto res = vkBindImageMemory(CDevice::GetInstance().GetDevice(), imageHandles.image,
+                                           imageHandles.allocation.memory, imageHandles.allocation.offset);
         res != VK_SUCCESS)
         throw std::runtime_error("Failed to bind image memory.");
 
-    CreateImageView(imageHandles);
+    CreateImageView(imageHandles, createInfo.format);
 }
 
-void CBufferImageManager::CreateImageView(SImageHandles &imageHandles) const
+void CBufferImageManager::CreateImageView(SImageHandles &imageHandles, VkFormat format) const
 {
     VkImageViewCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     createInfo.image = imageHandles.image;
     createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    createInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
-    createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    createInfo.format = format;
+    // Depth-stencil views used as attachments cover both aspects
+    createInfo.subresourceRange.aspectMask = GetAspectMask(format);
     createInfo.subresourceRange.baseMipLevel = 0;
     createInfo.subresourceRange.levelCount = 1;
     createInfo.subresourceRange.baseArrayLayer = 0;
     createInfo.subresourceRange.layerCount = 1;
 
-    if (const auto res =
-            vkCreateImageView(CDevice::GetInstance().GetDevice(), &createInfo, nullptr, &imageHandles.imageView);
+    if (const auto res = vkCreateImageView(CDevice::GetInstance().GetDevice(), &createInfo,
+                                           CHostAllocator::GetCallbacks(), &imageHandles.imageView);
         res != VK_SUCCESS)
         throw std::runtime_error("Failed to create image view.");
 }
 
-void CBufferImageManager::CopyBuffer(const VkBuffer src, const VkBufferCopy copyRegions, VkBuffer &dst) const
+bool CBufferImageManager::CreateRelocatedBuffer(const VkBufferCreateInfo createInfo,
+                                                const SBufferHandles &bufferHandles,
+                                                SBufferHandles &relocatedHandles) const
 {
-    // Create and allocate a command buffer
-    VkCommandBuffer commandBuffer;
-    VkCommandBufferAllocateInfo allocateInfo{};
-    allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocateInfo.commandPool = CDevice::GetInstance().GetCommandPool();
-    allocateInfo.commandBufferCount = 1;
-    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    if (const auto res = vkAllocateCommandBuffers(CDevice::GetInstance().GetDevice(), &allocateInfo, &commandBuffer);
+    if (!mp_allocator->CanReallocate(bufferHandles.allocation))
+        return false;
+
+    const auto device = CDevice::GetInstance().GetDevice();
+    if (const auto res = vkCreateBuffer(device, &createInfo, CHostAllocator::GetCallbacks(), &relocatedHandles.buffer);
         res != VK_SUCCESS)
-        throw std::runtime_error("Failed to allocate command buffer.");
+        throw std::runtime_error("Failed to create relocated buffer.");
 
-    // Begin command buffer for the copy
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VkMemoryRequirements memoryRequirements{};
+    vkGetBufferMemoryRequirements(device, relocatedHandles.buffer, &memoryRequirements);
+    if (!mp_allocator->Reallocate(bufferHandles.allocation, memoryRequirements, relocatedHandles.allocation))
+    {
+        vkDestroyBuffer(device, relocatedHandles.buffer, CHostAllocator::GetCallbacks());
+        relocatedHandles = {};
+        return false;
+    }
 
-    if (const auto res = vkBeginCommandBuffer(commandBuffer, &beginInfo); res != VK_SUCCESS)
-        throw std::runtime_error("Failed to begin command buffer.");
+    if (const auto res = vkBindBufferMemory(device, relocatedHandles.buffer, relocatedHandles.allocation.memory,
+                                            relocatedHandles.allocation.offset);
+        res != VK_SUCCESS)
+        throw std::runtime_error("Failed to bind relocated buffer to memory.");
+    return true;
+}
 
-    // Copy the src to dst
-    vkCmdCopyBuffer(commandBuffer, src, dst, 1, &copyRegions);
+bool CBufferImageManager::CreateRelocatedImage(const VkImageCreateInfo createInfo, const SImageHandles &imageHandles,
+                                               SImageHandles &relocatedHandles) const
+{
+    if (!mp_allocator->CanReallocate(imageHandles.allocation))
+        return false;
 
-    vkEndCommandBuffer(commandBuffer);
+    const auto device = CDevice::GetInstance().GetDevice();
+    if (const auto res = vkCreateImage(device, &createInfo, CHostAllocator::GetCallbacks(), &relocatedHandles.image);
+        res != VK_SUCCESS)
+        throw std::runtime_error("Failed to create relocated image.");
 
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
+    VkMemoryRequirements memReq;
+    vkGetImageMemoryRequirements(device, relocatedHandles.image, &memReq);
+    if (!mp_allocator->Reallocate(imageHandles.allocation, memReq, relocatedHandles.allocation))
+    {
+        vkDestroyImage(device, relocatedHandles.image, CHostAllocator::GetCallbacks());
+        relocatedHandles = {};
+        return false;
+    }
 
-    if (const auto res = vkQueueSubmit(CDevice::GetInstance().GetGraphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE);
+    if (const auto res = vkBindImageMemory(device, relocatedHandles.image, relocatedHandles.allocation.memory,
+                                           relocatedHandles.allocation.offset);
         res != VK_SUCCESS)
-        throw std::runtime_error("Failed to submit queue.");
+        throw std::runtime_error("Failed to bind relocated image memory.");
+
+    CreateImageView(relocatedHandles, createInfo.format);
+    return true;
+}
+
+void CBufferImageManager::CreateTransientImages(const std::vector<STransientImageDesc> &vecDescs,
+                                                STransientImages &transientImages) const
+{
+    const auto device = CDevice::GetInstance().GetDevice();
+    transientImages.vecImages.resize(vecDescs.size());
+    std::vector<VkMemoryRequirements> vecMemReqs(vecDescs.size());
+    for (auto i = 0u; i != vecDescs.size(); ++i)
+    {
+        if (const auto res = vkCreateImage(device, &vecDescs[i].createInfo, CHostAllocator::GetCallbacks(),
+                                           &transientImages.vecImages[i].image);
+            res != VK_SUCCESS)
+            throw std::runtime_error("Failed to create transient image.");
+
+        vkGetImageMemoryRequirements(device, transientImages.vecImages[i].image, &vecMemReqs[i]);
+    }
 
-    vkQueueWaitIdle(CDevice::GetInstance().GetGraphicsQueue());
+    // Only TRANSIENT_ATTACHMENT images can live in lazily allocated memory, the others are aliased
+    constexpr VkMemoryPropertyFlags lazyFlags =
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    std::vector<uint32_t> vecOrder;
+    for (auto i = 0u; i != vecDescs.size(); ++i)
+    {
+        if (!mp_allocator->HasMemoryType(vecMemReqs[i].memoryTypeBits, lazyFlags))
+        {
+            vecOrder.push_back(i);
+            continue;
+        }
+        transientImages.vecAllocations.push_back(
+            mp_allocator->Allocate(vecMemReqs[i], lazyFlags, EResourceKind::Optimal, EMemoryCategory::Attachment));
+        transientImages.vecImages[i].allocation = transientImages.vecAllocations.back();
+    }
+
+    // Greedy interval colouring: in order of first use, an image joins the first slot whose images are all done
+    // before it starts and whose memory types it can live in
+    struct SSlot
+    {
+        uint32_t lastPass = 0;
+        VkMemoryRequirements memReq{};
+        std::vector<uint32_t> vecImageIndices;
+    };
+    std::stable_sort(vecOrder.begin(), vecOrder.end(), [&vecDescs](uint32_t lhs, uint32_t rhs) {
+        return vecDescs[lhs].firstPass < vecDescs[rhs].firstPass;
+    });
+
+    std::vector<SSlot> vecSlots;
+    for (const auto imageIndex : vecOrder)
+    {
+        const auto &desc = vecDescs[imageIndex];
+        const auto &memReq = vecMemReqs[imageIndex];
+        auto slot = std::find_if(vecSlots.begin(), vecSlots.end(), [&desc, &memReq](const SSlot &slot) {
+            return slot.lastPass < desc.firstPass && (slot.memReq.memoryTypeBits & memReq.memoryTypeBits);
+        });
+        if (slot == vecSlots.end())
+        {
+            vecSlots.push_back({desc.lastPass, memReq, {imageIndex}});
+            continue;
+        }
 
-    vkFreeCommandBuffers(CDevice::GetInstance().GetDevice(), CDevice::GetInstance().GetCommandPool(), 1,
-                         &commandBuffer);
+        slot->lastPass = desc.lastPass;
+        slot->memReq.size = std::max(slot->memReq.size, memReq.size);
+        slot->memReq.alignment = std::max(slot->memReq.alignment, memReq.alignment);
+        slot->memReq.memoryTypeBits &= memReq.memoryTypeBits;
+        slot->vecImageIndices.push_back(imageIndex);
+    }
+
+    for (const auto &slot : vecSlots)
+    {
+        transientImages.vecAllocations.push_back(mp_allocator->Allocate(
+            slot.memReq, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, EResourceKind::Optimal, EMemoryCategory::Attachment));
+        for (const auto imageIndex : slot.vecImageIndices)
+            transientImages.vecImages[imageIndex].allocation = transientImages.vecAllocations.back();
+    }
+
+    for (auto i = 0u; i != vecDescs.size(); ++i)
+    {
+        auto &imageHandles = transientImages.vecImages[i];
+        if (const auto res = vkBindImageMemory(device, imageHandles.image, imageHandles.allocation.memory,
+                                               imageHandles.allocation.offset);
+            res != VK_SUCCESS)
+            throw std::runtime_error("Failed to bind transient image memory.");
+        CreateImageView(imageHandles, vecDescs[i].createInfo.format);
+    }
 }
 
-void CBufferImageManager::CopyBufferToImage(const VkBuffer src, const VkBufferImageCopy copyRegions, VkImage &dst) const
+void CBufferImageManager::DestroyTransientImages(STransientImages &transientImages) const
 {
-    VkCommandBuffer cmdBuffer;
-    VkCommandBufferAllocateInfo allocateInfo{};
-    allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocateInfo.commandPool = CDevice::GetInstance().GetCommandPool();
-    allocateInfo.commandBufferCount = 1;
-    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    if (const auto res = vkAllocateCommandBuffers(CDevice::GetInstance().GetDevice(), &allocateInfo, &cmdBuffer);
-        res != VK_SUCCESS)
-        throw std::runtime_error("Failed to allocate cmd buffer to copy buffer to image.");
-
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    vkBeginCommandBuffer(cmdBuffer, &beginInfo);
-
-    VkImageMemoryBarrier imageMemoryBarrier{};
-    imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    imageMemoryBarrier.srcAccessMask = 0;
-    imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    imageMemoryBarrier.image = dst;
-    imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
-    imageMemoryBarrier.subresourceRange.levelCount = 1;
-    imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
-    imageMemoryBarrier.subresourceRange.layerCount = 1;
-
-    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
-                         nullptr, 1, &imageMemoryBarrier);
-
-    vkCmdCopyBufferToImage(cmdBuffer, src, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegions);
-
-    imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
-                         nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-
-    vkEndCommandBuffer(cmdBuffer);
-
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &cmdBuffer;
-
-    if (const auto res = vkQueueSubmit(CDevice::GetInstance().GetGraphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE);
-        res != VK_SUCCESS)
-        throw std::runtime_error("Failed to submit queue.");
+    const auto device = CDevice::GetInstance().GetDevice();
+    for (auto &imageHandles : transientImages.vecImages)
+    {
+        vkDestroyImageView(device, imageHandles.imageView, CHostAllocator::GetCallbacks());
+        vkDestroyImage(device, imageHandles.image, CHostAllocator::GetCallbacks());
+    }
+    // Aliased images share their allocation, so memory is released per allocation rather than per image
+    for (auto &allocation : transientImages.vecAllocations)
+        mp_allocator->Free(allocation);
+    transientImages = {};
+}
+
+VkDeviceSize CBufferImageManager::ReleaseEmptyBlocks(VkMemoryPropertyFlags memFlags) const
+{
+    return mp_allocator->ReleaseEmptyBlocks(memFlags);
+}
 
-    vkQueueWaitIdle(CDevice::GetInstance().GetGraphicsQueue());
+void CBufferImageManager::WriteMemory(const SBufferHandles &bufferHandles, const VkDeviceSize offset,
+                                      const VkDeviceSize size, const void *pData) const
+{
+    memcpy(static_cast<char *>(GetMappedData(bufferHandles)) + offset, pData, size);
+    FlushMemory(bufferHandles, offset, size);
+}
 
-    vkFreeCommandBuffers(CDevice::GetInstance().GetDevice(), CDevice::GetInstance().GetCommandPool(), 1, &cmdBuffer);
+void *CBufferImageManager::GetMappedData(const SBufferHandles &bufferHandles) const
+{
+    if (!bufferHandles.allocation.pMapped)
+        throw std::runtime_error("Buffer memory is not host visible.");
+    return bufferHandles.allocation.pMapped;
 }
 
-void CBufferImageManager::MapMemory(const SBufferHandles &bufferHandles, const VkDeviceSize offset,
-                                    const VkDeviceSize size, const void *pData) const
+void CBufferImageManager::FlushMemory(const SBufferHandles &bufferHandles, const VkDeviceSize offset,
+                                      const VkDeviceSize size) const
 {
-    void *data;
-    vkMapMemory(CDevice::GetInstance().GetDevice(), bufferHandles.memory, offset, size, 0, &data);
-    memcpy(data, pData, size);
-    vkUnmapMemory(CDevice::GetInstance().GetDevice(), bufferHandles.memory);
+    mp_allocator->Flush(bufferHandles.allocation, offset, size);
+}
+
+void CBufferImageManager::InvalidateMemory(const SBufferHandles &bufferHandles, const VkDeviceSize offset,
+                                           const VkDeviceSize size) const
+{
+    mp_allocator->Invalidate(bufferHandles.allocation, offset, size);
 }
 
 void CBufferImageManager::DestroyBufferHandles(SBufferHandles &bufferHandles) const
 {
-    vkDestroyBuffer(CDevice::GetInstance().GetDevice(), bufferHandles.buffer, nullptr);
-    vkFreeMemory(CDevice::GetInstance().GetDevice(), bufferHandles.memory, nullptr);
+    vkDestroyBuffer(CDevice::GetInstance().GetDevice(), bufferHandles.buffer, CHostAllocator::GetCallbacks());
+    mp_allocator->Free(bufferHandles.allocation);
 }
 
 void CBufferImageManager::DestroyImagesHandles(SImageHandles &bufferHandles) const
 {
-    vkDestroyImage(CDevice::GetInstance().GetDevice(), bufferHandles.image, nullptr);
-    vkDestroyImageView(CDevice::GetInstance().GetDevice(), bufferHandles.imageView, nullptr);
-    vkFreeMemory(CDevice::GetInstance().GetDevice(), bufferHandles.memory, nullptr);
+    vkDestroyImage(CDevice::GetInstance().GetDevice(), bufferHandles.image, CHostAllocator::GetCallbacks());
+    vkDestroyImageView(CDevice::GetInstance().GetDevice(), bufferHandles.imageView, CHostAllocator::GetCallbacks());
+    mp_allocator->Free(bufferHandles.allocation);
 }
 
-uint32_t CBufferImageManager::FindMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags flags) const
+std::vector<SHeapStatistics> CBufferImageManager::GetHeapStatistics() const
 {
-    VkPhysicalDeviceMemoryProperties deviceMemoryProperties;
-    vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &deviceMemoryProperties);
+    return mp_allocator->GetHeapStatistics();
+}
 
-    for (auto i = 0; i != deviceMemoryProperties.memoryTypeCount; ++i)
-    {
-        if (memoryTypeBits & (1 << i))
-        {
-            if ((deviceMemoryProperties.memoryTypes[i].propertyFlags & flags) == flags)
-            {
-                return i;
-            }
-        }
-    }
-    throw std::runtime_error("Failed to find a suitable memory type.");
+CMemoryBudget &CBufferImageManager::GetMemoryBudget() const
+{
+    return mp_allocator->GetBudget();
 }
 
+void CBufferImageManager::Cleanup()
+{
+    mp_allocator->Cleanup();
+}
@@ -1,19 +1,36 @@
 #pragma once
 
 #include "CDevice.hpp"
+#include "CMemoryAllocator.hpp"
+#include <memory>
 #include <vulkan/vulkan.h>
 
 struct SBufferHandles
 {
     VkBuffer buffer = VK_NULL_HANDLE;
-    VkDeviceMemory memory = VK_NULL_HANDLE;
+    SMemoryAllocation allocation{};
 };
 
 struct SImageHandles
 {
     VkImage image = VK_NULL_HANDLE;
     VkImageView imageView = VK_NULL_HANDLE;
-    VkDeviceMemory memory = VK_NULL_HANDLE;
+    SMemoryAllocation allocation{};
+};
+
+struct STransientImageDesc
+{
+    VkImageCreateInfo createInfo{};
+    // Passes of a frame that use the image, images whose ranges do not overlap may share memory
+    uint32_t firstPass = 0;
+    uint32_t lastPass = 0;
+};
+
+// Images that only live within a frame, in the order of their descriptions
+struct STransientImages
+{
+    std::vector<SImageHandles> vecImages;
+    std::vector<SMemoryAllocation> vecAllocations;
 };
 
 class CBufferImageManager
@@ -21,24 +38,57 @@ class CBufferImageManager
   public:
     explicit CBufferImageManager(VkPhysicalDevice physicalDevice);
     void CreateBuffer(const VkBufferCreateInfo createInfo, VkMemoryPropertyFlags memFlags,
-                      SBufferHandles &bufferHandles) const;
+                      SBufferHandles &bufferHandles, EMemoryCategory category = EMemoryCategory::Other) const;
 
-    void CreateImage(const VkImageCreateInfo createInfo, VkMemoryPropertyFlags memFlags,
-                     SImageHandles &imageHandles) const;
+    // Device-local buffer that the CPU writes directly when the device maps all of its VRAM (resizable BAR) and the
+    // buffer is small enough, see CUploadContext::UploadBuffer. Falls back to plain device-local memory otherwise.
+    void CreateDeviceBuffer(const VkBufferCreateInfo createInfo, SBufferHandles &bufferHandles,
+                            EMemoryCategory category = EMemoryCategory::Other) const;
 
-    void CreateImageView(SImageHandles &imageHandles) const;
+    // Size of the largest device-local heap the CPU can map, 0 when there is none or only the small legacy BAR window
+    VkDeviceSize GetDirectWriteHeapSize() const
+    {
+        return m_directWriteHeapSize;
+    }
 
-    void CopyBuffer(const VkBuffer src, const VkBufferCopy copyRegions, VkBuffer &dst) const;
-    void CopyBufferToImage(const VkBuffer src, const VkBufferImageCopy copyRegions, VkImage &dst) const;
+    void CreateImage(const VkImageCreateInfo createInfo, VkMemoryPropertyFlags memFlags, SImageHandles &imageHandles,
+                     EMemoryCategory category = EMemoryCategory::Other) const;
 
-    void MapMemory(const SBufferHandles &bufferHandles, const VkDeviceSize offset, const VkDeviceSize size,
-                   const void *pData) const;
+    void CreateImageView(SImageHandles &imageHandles, VkFormat format) const;
+
+    // Images that only live within a frame. TRANSIENT_ATTACHMENT images go into lazily allocated memory when the device
+    // has it, tilers then never back them with physical pages. The others with disjoint pass ranges are aliased onto
+    // the same memory, which is only valid as long as every pass treats them as UNDEFINED on first use (loadOp CLEAR or
+    // DONT_CARE).
+    void CreateTransientImages(const std::vector<STransientImageDesc> &vecDescs,
+                               STransientImages &transientImages) const;
+    void DestroyTransientImages(STransientImages &transientImages) const;
+
+    // Create an unfilled copy of the resource in a fuller memory block, false when no block can take it
+    bool CreateRelocatedBuffer(const VkBufferCreateInfo createInfo, const SBufferHandles &bufferHandles,
+                               SBufferHandles &relocatedHandles) const;
+    bool CreateRelocatedImage(const VkImageCreateInfo createInfo, const SImageHandles &imageHandles,
+                              SImageHandles &relocatedHandles) const;
+    VkDeviceSize ReleaseEmptyBlocks(VkMemoryPropertyFlags memFlags) const;
+
+    // Host visible buffers are persistently mapped, writes go straight through the stable pointer and only the
+    // written range is flushed when the memory is not coherent
+    void WriteMemory(const SBufferHandles &bufferHandles, const VkDeviceSize offset, const VkDeviceSize size,
+                     const void *pData) const;
+    void *GetMappedData(const SBufferHandles &bufferHandles) const;
+    void FlushMemory(const SBufferHandles &bufferHandles, const VkDeviceSize offset, const VkDeviceSize size) const;
+    void InvalidateMemory(const SBufferHandles &bufferHandles, const VkDeviceSize offset,
+                          const VkDeviceSize size) const;
 
     void DestroyBufferHandles(SBufferHandles &bufferHandles) const;
     void DestroyImagesHandles(SImageHandles &bufferHandles) const;
 
-  private:
-    uint32_t FindMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags flags) const;
+    std::vector<SHeapStatistics> GetHeapStatistics() const;
+    CMemoryBudget &GetMemoryBudget() const;
+    void Cleanup();
 
+  private:
     VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+    VkDeviceSize m_directWriteHeapSize = 0;
+    std::unique_ptr<CMemoryAllocator> mp_allocator;
 };
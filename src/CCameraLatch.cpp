@@ -0,0 +1,37 @@
+#include "CCameraLatch.hpp"
+
+using namespace vkTools;
+
+CCameraLatch::CCameraLatch(uint32_t frameCount)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(CDevice::GetInstance().GetVulkanInstance()->GetPhysicalDevice(), &properties);
+    const auto alignment = properties.limits.minUniformBufferOffsetAlignment;
+    m_stride = (sizeof(vkPrimitives::SCameraUniform) + alignment - 1) / alignment * alignment;
+
+    m_latchedCamera.view = glm::mat4(1.0f);
+    m_latchedCamera.projection = glm::mat4(1.0f);
+
+    VkBufferCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    createInfo.size = m_stride * frameCount;
+    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    createInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    CDevice::GetInstance().GetBufferImageManager().CreateBuffer(createInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                                                m_bufferHandles, EMemoryCategory::Uniform);
+}
+
+void CCameraLatch::Latch(uint32_t frameIndex)
+{
+    if (m_sampler)
+        m_latchedCamera = m_sampler();
+
+    // Host writes made before vkQueueSubmit are visible to the submission, no barrier needed
+    CDevice::GetInstance().GetBufferImageManager().WriteMemory(m_bufferHandles, GetOffset(frameIndex),
+                                                               sizeof(m_latchedCamera), &m_latchedCamera);
+}
+
+void CCameraLatch::Cleanup()
+{
+    CDevice::GetInstance().GetBufferImageManager().DestroyBufferHandles(m_bufferHandles);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "CBufferImageManager.hpp"
+#include "vkPrimitives.hpp"
+#include <functional>
+#include <vulkan/vulkan.h>
+
+// Camera matrices are sampled as late as possible instead of when the frame starts recording. CDevice latches them
+// right before vkQueueSubmit into the frame's region of a small persistently mapped buffer, every draw reads the camera
+// from there through binding 1 of the uniform set.
+class CCameraLatch
+{
+  public:
+    using Sampler = std::function<vkTools::vkPrimitives::SCameraUniform()>;
+
+    explicit CCameraLatch(uint32_t frameCount);
+
+    // Runs on every latch, it should read the freshest input it can get
+    void SetSampler(Sampler &&sampler)
+    {
+        m_sampler = std::move(sampler);
+    }
+
+    // The frame's previous submission must have completed
+    void Latch(uint32_t frameIndex);
+
+    // Dynamic offset of the frame's camera
+    uint32_t GetOffset(uint32_t frameIndex) const
+    {
+        return static_cast<uint32_t>(frameIndex * m_stride);
+    }
+
+    // The camera of the last latch, for CPU-side work that has to agree with what was rendered
+    const vkTools::vkPrimitives::SCameraUniform &GetLatchedCamera() const
+    {
+        return m_latchedCamera;
+    }
+
+    VkBuffer GetBuffer() const
+    {
+        return m_bufferHandles.buffer;
+    }
+
+    void Cleanup();
+
+  private:
+    SBufferHandles m_bufferHandles{};
+    VkDeviceSize m_stride = 0;
+    Sampler m_sampler;
+    vkTools::vkPrimitives::SCameraUniform m_latchedCamera{};
+};
@@ -0,0 +1,42 @@
+#include "CCommandCache.hpp"
+#include "CCommandPoolManager.hpp"
+#include "CDevice.hpp"
+#include "vkStructs.hpp"
+#include <algorithm>
+
+using namespace vkTools;
+
+CCommandCache::CCommandCache(uint32_t frameCount)
+    : m_vecSceneBuffers(frameCount, VK_NULL_HANDLE), m_vecIsValid(frameCount, false)
+{
+}
+
+void CCommandCache::Invalidate()
+{
+    std::fill(m_vecIsValid.begin(), m_vecIsValid.end(), false);
+}
+
+VkCommandBuffer CCommandCache::BeginScene(uint32_t frameIndex, VkRenderPass renderPass)
+{
+    m_vecIsValid[frameIndex] = false;
+    m_vecSceneBuffers[frameIndex] = CDevice::GetInstance().GetCommandPoolManager().Acquire(
+        ECommandPoolSet::Scene, frameIndex, 0, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+    BeginSecondary(m_vecSceneBuffers[frameIndex], renderPass);
+    return m_vecSceneBuffers[frameIndex];
+}
+
+void CCommandCache::EndScene(uint32_t frameIndex)
+{
+    VK_CHECK_RESULT(vkEndCommandBuffer(m_vecSceneBuffers[frameIndex]))
+    m_vecIsValid[frameIndex] = true;
+    ++m_statistics.recordedScenes;
+}
+
+void CCommandCache::BeginSecondary(VkCommandBuffer cmdBuffer, VkRenderPass renderPass)
+{
+    // No framebuffer, so the recording isn't tied to one swapchain image
+    const auto inheritanceInfo = vkStructs::CommandBufferInheritanceInfo(renderPass);
+    auto beginInfo = vkStructs::CommandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuffer, &beginInfo))
+}
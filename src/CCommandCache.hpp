@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+struct SCommandCacheStatistics
+{
+    uint64_t recordedScenes = 0;
+    uint64_t replayedScenes = 0;
+};
+
+// Secondary command buffers for the scene pass that are recorded once and replayed every frame until something they
+// baked in changes: the set of objects, their descriptor sets, the extent or the pipelines. Per-frame data only flows
+// through buffers, so there is one recording per frame in flight, each with that slot's dynamic uniform and camera
+// offsets. The framebuffer is left out of the inheritance info so the recordings work with every swapchain image.
+// Whatever changes every frame, like the GUI, is drawn inline in a later pass. Scene buffers come from the Scene pool
+// set, which CDevice only resets when the scene records again.
+class CCommandCache
+{
+  public:
+    explicit CCommandCache(uint32_t frameCount);
+
+    // Every slot records again the next time it is used
+    void Invalidate();
+    bool IsValid(uint32_t frameIndex) const
+    {
+        return m_vecIsValid[frameIndex];
+    }
+
+    // The frame's Scene pool set must have been reset
+    VkCommandBuffer BeginScene(uint32_t frameIndex, VkRenderPass renderPass);
+    void EndScene(uint32_t frameIndex);
+    VkCommandBuffer GetScene(uint32_t frameIndex) const
+    {
+        return m_vecSceneBuffers[frameIndex];
+    }
+    // Counts a frame that executes the existing recording
+    void OnSceneReplayed()
+    {
+        ++m_statistics.replayedScenes;
+    }
+
+    const SCommandCacheStatistics &GetStatistics() const
+    {
+        return m_statistics;
+    }
+
+  private:
+    static void BeginSecondary(VkCommandBuffer cmdBuffer, VkRenderPass renderPass);
+
+    std::vector<VkCommandBuffer> m_vecSceneBuffers;
+    std::vector<bool> m_vecIsValid;
+    SCommandCacheStatistics m_statistics{};
+};
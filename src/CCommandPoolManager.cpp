@@ -0,0 +1,142 @@
+#include "CCommandPoolManager.hpp"
+#include "CDevice.hpp"
+#include "CHostAllocator.hpp"
+#include "CTimelineSync.hpp"
+#include "vkStructs.hpp"
+#include <algorithm>
+
+using namespace vkTools;
+
+CCommandPoolManager::CCommandPoolManager(uint32_t queueFamilyIndex, uint32_t frameCount, uint32_t threadCount)
+    : m_frameCount(frameCount), m_threadCount(std::max(threadCount, 1u)),
+      m_vecThreadPools(static_cast<size_t>(ECommandPoolSet::Count) * frameCount * m_threadCount)
+{
+    const auto device = CDevice::GetInstance().GetDevice();
+
+    VkCommandPoolCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    createInfo.queueFamilyIndex = queueFamilyIndex;
+    // Buffers are only ever reset together with their pool
+    createInfo.flags = 0;
+    for (auto &threadPool : m_vecThreadPools)
+    {
+        VK_CHECK_RESULT(
+            vkCreateCommandPool(device, &createInfo, CHostAllocator::GetCallbacks(), &threadPool.commandPool))
+    }
+
+    // Recycled one-shots are implicitly reset when they begin again
+    createInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    VK_CHECK_RESULT(vkCreateCommandPool(device, &createInfo, CHostAllocator::GetCallbacks(), &m_oneShotPool))
+}
+
+void CCommandPoolManager::Reset(ECommandPoolSet poolSet, uint32_t frameIndex)
+{
+    const auto device = CDevice::GetInstance().GetDevice();
+    for (auto threadIndex = 0u; threadIndex != m_threadCount; ++threadIndex)
+    {
+        auto &threadPool = GetThreadPool(poolSet, frameIndex, threadIndex);
+        if (threadPool.usedCounts[0] == 0 && threadPool.usedCounts[1] == 0)
+            continue;
+        VK_CHECK_RESULT(vkResetCommandPool(device, threadPool.commandPool, 0))
+        threadPool.usedCounts = {};
+    }
+}
+
+VkCommandBuffer CCommandPoolManager::Acquire(ECommandPoolSet poolSet, uint32_t frameIndex, uint32_t threadIndex,
+                                             VkCommandBufferLevel level)
+{
+    auto &threadPool = GetThreadPool(poolSet, frameIndex, threadIndex);
+    auto &vecBuffers = threadPool.vecBuffers[level];
+    auto &usedCount = threadPool.usedCounts[level];
+    if (usedCount == vecBuffers.size())
+    {
+        const auto allocateInfo = vkStructs::CommandBufferAllocateInfo(threadPool.commandPool, 1, level);
+        VkCommandBuffer cmdBuffer;
+        VK_CHECK_RESULT(vkAllocateCommandBuffers(CDevice::GetInstance().GetDevice(), &allocateInfo, &cmdBuffer))
+        vecBuffers.push_back(cmdBuffer);
+    }
+    return vecBuffers[usedCount++];
+}
+
+VkCommandBuffer CCommandPoolManager::BeginOneShot()
+{
+    const auto device = CDevice::GetInstance().GetDevice();
+    RetireOneShots(false);
+
+    SOneShot oneShot{};
+    if (!m_vecFreeOneShots.empty())
+    {
+        oneShot = m_vecFreeOneShots.back();
+        m_vecFreeOneShots.pop_back();
+    }
+    else
+    {
+        const auto allocateInfo = vkStructs::CommandBufferAllocateInfo(m_oneShotPool);
+        VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &allocateInfo, &oneShot.commandBuffer))
+    }
+
+    const auto beginInfo = vkStructs::CommandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    VK_CHECK_RESULT(vkBeginCommandBuffer(oneShot.commandBuffer, &beginInfo))
+    m_vecRecordingOneShots.push_back(oneShot);
+    return oneShot.commandBuffer;
+}
+
+uint64_t CCommandPoolManager::SubmitOneShot(VkCommandBuffer cmdBuffer)
+{
+    const auto recording =
+        std::find_if(m_vecRecordingOneShots.begin(), m_vecRecordingOneShots.end(),
+                     [cmdBuffer](const SOneShot &oneShot) { return oneShot.commandBuffer == cmdBuffer; });
+    if (recording == m_vecRecordingOneShots.end())
+        throw std::runtime_error("Command buffer wasn't begun with BeginOneShot.");
+
+    VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuffer))
+    recording->timelineValue = CDevice::GetInstance().GetTimelineSync().Submit(ETimelineQueue::Graphics, cmdBuffer);
+    const auto timelineValue = recording->timelineValue;
+    m_vecPendingOneShots.push_back(*recording);
+    m_vecRecordingOneShots.erase(recording);
+    return timelineValue;
+}
+
+void CCommandPoolManager::WaitOneShots()
+{
+    RetireOneShots(true);
+}
+
+void CCommandPoolManager::Cleanup()
+{
+    WaitOneShots();
+
+    const auto device = CDevice::GetInstance().GetDevice();
+    // Begun but never submitted ones are freed with the pool
+    m_vecRecordingOneShots.clear();
+    m_vecFreeOneShots.clear();
+    vkDestroyCommandPool(device, m_oneShotPool, CHostAllocator::GetCallbacks());
+
+    for (auto &threadPool : m_vecThreadPools)
+        vkDestroyCommandPool(device, threadPool.commandPool, CHostAllocator::GetCallbacks());
+    m_vecThreadPools.clear();
+}
+
+CCommandPoolManager::SThreadPool &CCommandPoolManager::GetThreadPool(ECommandPoolSet poolSet, uint32_t frameIndex,
+                                                                      uint32_t threadIndex)
+{
+    const auto setIndex = static_cast<size_t>(poolSet);
+    return m_vecThreadPools[(setIndex * m_frameCount + frameIndex) * m_threadCount + threadIndex];
+}
+
+void CCommandPoolManager::RetireOneShots(bool isBlocking)
+{
+    // Submitted in order, so the pending ones retire from the front
+    auto &timelineSync = CDevice::GetInstance().GetTimelineSync();
+    auto it = m_vecPendingOneShots.begin();
+    for (; it != m_vecPendingOneShots.end(); ++it)
+    {
+        const STimelinePoint point{ETimelineQueue::Graphics, it->timelineValue};
+        if (isBlocking)
+            timelineSync.Wait(point);
+        else if (!timelineSync.IsReached(point))
+            break;
+    }
+    m_vecFreeOneShots.insert(m_vecFreeOneShots.end(), m_vecPendingOneShots.begin(), it);
+    m_vecPendingOneShots.erase(m_vecPendingOneShots.begin(), it);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Groups of per-frame pools that are reset independently of each other
+enum class ECommandPoolSet
+{
+    // Reset at the start of every frame, for primaries and whatever is recorded fresh each frame
+    Frame,
+    // Reset only when the scene records again, the command cache replays these buffers until then
+    Scene,
+    Count
+};
+
+// Owns every graphics command pool. Frame work gets one pool per pool set, frame in flight and recording thread, none
+// of them allow resetting single buffers. Buffers stay allocated and are handed out in order, Reset rewinds a frame
+// with one vkResetCommandPool per thread. One-shot work outside the frame loop records into primaries from a separate
+// TRANSIENT pool that are recycled once the graphics timeline passed their submission instead of being allocated and
+// freed each time.
+class CCommandPoolManager
+{
+  public:
+    CCommandPoolManager(uint32_t queueFamilyIndex, uint32_t frameCount, uint32_t threadCount);
+
+    // Every submission that used the set's buffers of the frame must have completed
+    void Reset(ECommandPoolSet poolSet, uint32_t frameIndex);
+    // The next unused buffer of the thread's pool, valid until the set is reset for the frame. Threads may call this
+    // concurrently as long as each one passes its own index.
+    VkCommandBuffer Acquire(ECommandPoolSet poolSet, uint32_t frameIndex, uint32_t threadIndex,
+                            VkCommandBufferLevel level);
+
+    // Returns a begun primary
+    VkCommandBuffer BeginOneShot();
+    // Ends and submits the buffer to the graphics queue without waiting for it, returns the graphics timeline value
+    // the submission signals
+    uint64_t SubmitOneShot(VkCommandBuffer cmdBuffer);
+    // Blocks until every submitted one-shot completed
+    void WaitOneShots();
+
+    uint32_t GetThreadCount() const
+    {
+        return m_threadCount;
+    }
+
+    // The device must be idle
+    void Cleanup();
+
+  private:
+    struct SThreadPool
+    {
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        // Indexed by VkCommandBufferLevel
+        std::array<std::vector<VkCommandBuffer>, 2> vecBuffers;
+        std::array<uint32_t, 2> usedCounts{};
+    };
+
+    struct SOneShot
+    {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        uint64_t timelineValue = 0;
+    };
+
+    SThreadPool &GetThreadPool(ECommandPoolSet poolSet, uint32_t frameIndex, uint32_t threadIndex);
+    void RetireOneShots(bool isBlocking);
+
+    uint32_t m_frameCount;
+    uint32_t m_threadCount;
+    // Per pool set, then frame, then thread
+    std::vector<SThreadPool> m_vecThreadPools;
+
+    VkCommandPool m_oneShotPool = VK_NULL_HANDLE;
+    std::vector<SOneShot> m_vecRecordingOneShots;
+    std::vector<SOneShot> m_vecPendingOneShots;
+    std::vector<SOneShot> m_vecFreeOneShots;
+};
@@ -0,0 +1,219 @@
+#include "CDefragmenter.hpp"
+#include <algorithm>
+#include <array>
+
+namespace
+{
+constexpr VkBufferUsageFlags kMovableBufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+constexpr VkImageUsageFlags kMovableImageUsage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+} // namespace
+
+CDefragmenter::CDefragmenter(VkDeviceSize bytesPerFrame) : m_bytesPerFrame(bytesPerFrame)
+{
+}
+
+uint32_t CDefragmenter::RegisterBuffer(SBufferHandles &bufferHandles, const VkBufferCreateInfo &createInfo,
+                                       std::function<void()> &&onMoved)
+{
+    if ((createInfo.usage & kMovableBufferUsage) != kMovableBufferUsage)
+        throw std::runtime_error("Movable buffers need transfer source and destination usage.");
+
+    SMovable movable{};
+    movable.pBufferHandles = &bufferHandles;
+    movable.bufferCreateInfo = createInfo;
+    // Relocated copies are only ever used by the graphics queue
+    movable.bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    movable.bufferCreateInfo.queueFamilyIndexCount = 0;
+    movable.bufferCreateInfo.pQueueFamilyIndices = nullptr;
+    movable.onMoved = std::move(onMoved);
+
+    m_movables.emplace(m_nextId, std::move(movable));
+    return m_nextId++;
+}
+
+uint32_t CDefragmenter::RegisterImage(SImageHandles &imageHandles, const VkImageCreateInfo &createInfo,
+                                      std::function<void()> &&onMoved)
+{
+    if ((createInfo.usage & kMovableImageUsage) != kMovableImageUsage)
+        throw std::runtime_error("Movable images need transfer source and destination usage.");
+
+    SMovable movable{};
+    movable.pImageHandles = &imageHandles;
+    movable.imageCreateInfo = createInfo;
+    movable.imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    movable.imageCreateInfo.queueFamilyIndexCount = 0;
+    movable.imageCreateInfo.pQueueFamilyIndices = nullptr;
+    movable.imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    movable.onMoved = std::move(onMoved);
+
+    m_movables.emplace(m_nextId, std::move(movable));
+    return m_nextId++;
+}
+
+void CDefragmenter::Unregister(uint32_t id)
+{
+    m_movables.erase(id);
+}
+
+void CDefragmenter::Step(VkCommandBuffer cmdBuffer)
+{
+    // Blocks emptied by earlier steps are free once their old resources have been collected
+    m_statistics.bytesReclaimed +=
+        CDevice::GetInstance().GetBufferImageManager().ReleaseEmptyBlocks(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    if (!m_isEnabled || m_movables.empty())
+        return;
+
+    std::unordered_map<const SMemoryBlock *, std::vector<SMovable *>> blockMovables;
+    for (auto &[id, movable] : m_movables)
+    {
+        if (const auto pBlock = GetAllocation(movable).pBlock)
+            blockMovables[pBlock].push_back(&movable);
+    }
+
+    std::vector<const SMemoryBlock *> vecBlocks;
+    vecBlocks.reserve(blockMovables.size());
+    for (const auto &[pBlock, vecMovables] : blockMovables)
+        vecBlocks.push_back(pBlock);
+    std::sort(vecBlocks.begin(), vecBlocks.end(), [](const SMemoryBlock *lhs, const SMemoryBlock *rhs) {
+        return lhs->allocator.GetUsedSize() < rhs->allocator.GetUsedSize();
+    });
+
+    // Drain the sparsest block that anything can leave, largest resources first. The first move of a frame is
+    // always allowed so resources above the per-frame budget still get relocated eventually.
+    VkDeviceSize movedBytes = 0;
+    for (const auto pBlock : vecBlocks)
+    {
+        auto &vecMovables = blockMovables[pBlock];
+        std::sort(vecMovables.begin(), vecMovables.end(), [this](const SMovable *lhs, const SMovable *rhs) {
+            return GetAllocation(*lhs).size > GetAllocation(*rhs).size;
+        });
+
+        for (const auto pMovable : vecMovables)
+        {
+            if (movedBytes >= m_bytesPerFrame)
+                break;
+
+            const auto size = GetAllocation(*pMovable).size;
+            const auto isMoved = pMovable->pBufferHandles ? MoveBuffer(cmdBuffer, *pMovable)
+                                                          : MoveImage(cmdBuffer, *pMovable);
+            if (!isMoved)
+                continue;
+
+            movedBytes += size;
+            ++m_statistics.allocationsMoved;
+            if (pMovable->onMoved)
+                pMovable->onMoved();
+        }
+
+        if (movedBytes != 0)
+            break;
+    }
+
+    if (movedBytes == 0)
+        return;
+    m_statistics.bytesMoved += movedBytes;
+
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+                                  VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+const SMemoryAllocation &CDefragmenter::GetAllocation(const SMovable &movable) const
+{
+    return movable.pBufferHandles ? movable.pBufferHandles->allocation : movable.pImageHandles->allocation;
+}
+
+bool CDefragmenter::MoveBuffer(VkCommandBuffer cmdBuffer, SMovable &movable)
+{
+    auto &deviceInstance = CDevice::GetInstance();
+    SBufferHandles relocatedHandles{};
+    if (!deviceInstance.GetBufferImageManager().CreateRelocatedBuffer(movable.bufferCreateInfo,
+                                                                      *movable.pBufferHandles, relocatedHandles))
+        return false;
+
+    // Earlier frames only read the old buffer, so the copy needs no barrier in front of it
+    VkBufferCopy region{};
+    region.size = movable.bufferCreateInfo.size;
+    vkCmdCopyBuffer(cmdBuffer, movable.pBufferHandles->buffer, relocatedHandles.buffer, 1, &region);
+
+    deviceInstance.DeferDestroy([oldHandles = *movable.pBufferHandles]() mutable {
+        CDevice::GetInstance().GetBufferImageManager().DestroyBufferHandles(oldHandles);
+    });
+    *movable.pBufferHandles = relocatedHandles;
+    return true;
+}
+
+bool CDefragmenter::MoveImage(VkCommandBuffer cmdBuffer, SMovable &movable)
+{
+    auto &deviceInstance = CDevice::GetInstance();
+    SImageHandles relocatedHandles{};
+    if (!deviceInstance.GetBufferImageManager().CreateRelocatedImage(movable.imageCreateInfo, *movable.pImageHandles,
+                                                                     relocatedHandles))
+        return false;
+
+    const auto &createInfo = movable.imageCreateInfo;
+    std::array<VkImageMemoryBarrier, 2> imageMemoryBarriers{};
+    for (auto &imageMemoryBarrier : imageMemoryBarriers)
+    {
+        imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+        imageMemoryBarrier.subresourceRange.levelCount = createInfo.mipLevels;
+        imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+        imageMemoryBarrier.subresourceRange.layerCount = createInfo.arrayLayers;
+    }
+
+    // The old image stays readable by earlier frames, only its layout changes for the copy
+    imageMemoryBarriers[0].srcAccessMask = 0;
+    imageMemoryBarriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    imageMemoryBarriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageMemoryBarriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageMemoryBarriers[0].image = movable.pImageHandles->image;
+
+    imageMemoryBarriers[1].srcAccessMask = 0;
+    imageMemoryBarriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    imageMemoryBarriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageMemoryBarriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    imageMemoryBarriers[1].image = relocatedHandles.image;
+
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                         nullptr, 0, nullptr, imageMemoryBarriers.size(), imageMemoryBarriers.data());
+
+    std::vector<VkImageCopy> vecRegions(createInfo.mipLevels);
+    for (auto mipLevel = 0u; mipLevel != createInfo.mipLevels; ++mipLevel)
+    {
+        auto &region = vecRegions[mipLevel];
+        region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.srcSubresource.mipLevel = mipLevel;
+        region.srcSubresource.baseArrayLayer = 0;
+        region.srcSubresource.layerCount = createInfo.arrayLayers;
+        region.dstSubresource = region.srcSubresource;
+        region.extent.width = std::max(createInfo.extent.width >> mipLevel, 1u);
+        region.extent.height = std::max(createInfo.extent.height >> mipLevel, 1u);
+        region.extent.depth = std::max(createInfo.extent.depth >> mipLevel, 1u);
+    }
+    vkCmdCopyImage(cmdBuffer, movable.pImageHandles->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   relocatedHandles.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, vecRegions.size(), vecRegions.data());
+
+    imageMemoryBarriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    imageMemoryBarriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    imageMemoryBarriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    imageMemoryBarriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+                         nullptr, 0, nullptr, 1, &imageMemoryBarriers[1]);
+
+    deviceInstance.DeferDestroy([oldHandles = *movable.pImageHandles]() mutable {
+        CDevice::GetInstance().GetBufferImageManager().DestroyImagesHandles(oldHandles);
+    });
+    *movable.pImageHandles = relocatedHandles;
+    return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "CBufferImageManager.hpp"
+#include <functional>
+#include <unordered_map>
+#include <vulkan/vulkan.h>
+
+struct SDefragStatistics
+{
+    uint64_t allocationsMoved = 0;
+    VkDeviceSize bytesMoved = 0;
+    // Device memory handed back to the driver after blocks were emptied
+    VkDeviceSize bytesReclaimed = 0;
+};
+
+// Incrementally empties sparsely used device-local blocks. Owners register the resources that may move together with
+// the create info needed to rebuild them; every frame a bounded number of bytes is copied out of the sparsest block
+// into fuller blocks, the owner's handles are swapped and its callback re-points whatever referenced the old ones.
+// The old resources are destroyed once the frames that used them retire, and emptied blocks are released.
+class CDefragmenter
+{
+  public:
+    explicit CDefragmenter(VkDeviceSize bytesPerFrame);
+
+    // The handles must stay at the same address until Unregister. Resources need both TRANSFER_SRC and TRANSFER_DST
+    // usage, images are expected in SHADER_READ_ONLY_OPTIMAL and owned by the graphics queue family.
+    uint32_t RegisterBuffer(SBufferHandles &bufferHandles, const VkBufferCreateInfo &createInfo,
+                            std::function<void()> &&onMoved = {});
+    uint32_t RegisterImage(SImageHandles &imageHandles, const VkImageCreateInfo &createInfo,
+                           std::function<void()> &&onMoved = {});
+    void Unregister(uint32_t id);
+
+    // Records the copies of this frame, the command buffer must be outside a render pass and nothing may be writing
+    // to a registered resource
+    void Step(VkCommandBuffer cmdBuffer);
+
+    void SetEnabled(bool isEnabled)
+    {
+        m_isEnabled = isEnabled;
+    }
+
+    bool IsEnabled() const
+    {
+        return m_isEnabled;
+    }
+
+    const SDefragStatistics &GetStatistics() const
+    {
+        return m_statistics;
+    }
+
+  private:
+    struct SMovable
+    {
+        SBufferHandles *pBufferHandles = nullptr;
+        SImageHandles *pImageHandles = nullptr;
+        VkBufferCreateInfo bufferCreateInfo{};
+        VkImageCreateInfo imageCreateInfo{};
+        std::function<void()> onMoved;
+    };
+
+    const SMemoryAllocation &GetAllocation(const SMovable &movable) const;
+    bool MoveBuffer(VkCommandBuffer cmdBuffer, SMovable &movable);
+    bool MoveImage(VkCommandBuffer cmdBuffer, SMovable &movable);
+
+    VkDeviceSize m_bytesPerFrame;
+    bool m_isEnabled = true;
+    uint32_t m_nextId = 1;
+    std::unordered_map<uint32_t, SMovable> m_movables;
+    SDefragStatistics m_statistics{};
+};
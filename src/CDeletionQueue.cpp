@@ -0,0 +1,36 @@
+#include "CDeletionQueue.hpp"
+
+void CDeletionQueue::Push(std::function<void()> &&deleter)
+{
+    m_vecUnsubmitted.push_back(std::move(deleter));
+}
+
+void CDeletionQueue::OnFrameSubmitted(uint64_t timelineValue)
+{
+    for (auto &deleter : m_vecUnsubmitted)
+    {
+        m_deleters.emplace_back(timelineValue, std::move(deleter));
+    }
+    m_vecUnsubmitted.clear();
+}
+
+void CDeletionQueue::Collect(uint64_t completedValue)
+{
+    while (!m_deleters.empty() && m_deleters.front().first <= completedValue)
+    {
+        // Pop first, a deleter is allowed to queue further deletions
+        auto deleter = std::move(m_deleters.front().second);
+        m_deleters.pop_front();
+        deleter();
+    }
+}
+
+void CDeletionQueue::Flush()
+{
+    // Deleters may queue further deletions, those are run as well
+    while (!m_vecUnsubmitted.empty() || !m_deleters.empty())
+    {
+        OnFrameSubmitted(0);
+        Collect(UINT64_MAX);
+    }
+}
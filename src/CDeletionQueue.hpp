@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+// Holds destruction callbacks until the frame that last used the resources has finished on the GPU. Deleters wait for
+// the next frame to be submitted and are then keyed by the graphics timeline value that frame signals (see
+// CTimelineSync). Values complete in submission order, so the queue only ever has to look at its front.
+class CDeletionQueue
+{
+  public:
+    void Push(std::function<void()> &&deleter);
+    // Hands everything pushed since the last submitted frame to the one that signals timelineValue
+    void OnFrameSubmitted(uint64_t timelineValue);
+    // Runs every deleter of frames up to and including completedValue of the graphics timeline
+    void Collect(uint64_t completedValue);
+    // Runs everything, the device must be idle
+    void Flush();
+
+    size_t GetPendingCount() const
+    {
+        return m_vecUnsubmitted.size() + m_deleters.size();
+    }
+
+  private:
+    std::vector<std::function<void()>> m_vecUnsubmitted;
+    std::deque<std::pair<uint64_t, std::function<void()>>> m_deleters;
+};
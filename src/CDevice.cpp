@@ -1,14 +1,49 @@
 #include "CDevice.hpp"
 #include "CBufferImageManager.hpp"
+#include "CCameraLatch.hpp"
+#include "CCommandCache.hpp"
+#include "CCommandPoolManager.hpp"
+#include "CDefragmenter.hpp"
+#include "CDeletionQueue.hpp"
+#include "CDynamicResolution.hpp"
+#include "CFramePacer.hpp"
+#include "CGeometryArena.hpp"
+#include "CHostAllocator.hpp"
+#include "CParallelRecorder.hpp"
 #include "CShaderUtils.hpp"
+#include "CTimelineSync.hpp"
+#include "CUniformRing.hpp"
+#include "CUploadContext.hpp"
+#include "CUpscalePass.hpp"
 #include "SGraphicsPipelineStates.hpp"
 #include "vkPrimitives.hpp"
+#include "vkStructs.hpp"
 #include <algorithm>
 #include <array>
 #include <iostream>
+#include <thread>
 
 using namespace vkTools;
 
+namespace
+{
+// Room for a few thousand object uniforms per frame to start with, the ring grows when more are pushed
+constexpr VkDeviceSize kUniformRingFrameSize = 1024 * 1024;
+// Upper bound on per-object texture descriptor sets
+constexpr uint32_t kMaxTextureDescriptorSets = 1024;
+// Staging space shared by all in-flight upload batches
+constexpr VkDeviceSize kUploadStagingSize = 32ull * 1024 * 1024;
+// Shared by every mesh, 32 MiB of vertices and 8 MiB of indices
+constexpr uint32_t kGeometryArenaVertexCount = 1024 * 1024;
+constexpr uint32_t kGeometryArenaIndexCount = 4 * 1024 * 1024;
+// Copy work the defragmenter may record per frame
+constexpr VkDeviceSize kDefragmentBytesPerFrame = 8ull * 1024 * 1024;
+// More recording threads than this rarely pay off against the cost of waking them
+constexpr uint32_t kMaxRecordingThreads = 8;
+// Matches the preferred swapchain format so both backends run the same shaders and blending
+constexpr VkFormat kOffscreenColorFormat = VK_FORMAT_B8G8R8A8_SRGB;
+} // namespace
+
 CDevice &CDevice::GetInstance()
 {
     static CDevice instance;
@@ -21,23 +56,59 @@ void CDevice::InitDevice(CWindow *window, CInstance *vkInstance, CBufferImageMan
     mp_window = window;
     mp_instance = vkInstance;
     mp_bufferImageManager = bufferImageManager;
+    m_framesInFlight = std::max(appInfo.framesInFlight, 1u);
+    m_isHeadless = appInfo.isHeadless;
     // Create Device
     CreateDevice(appInfo);
+    mp_deletionQueue = std::make_unique<CDeletionQueue>();
+    mp_defragmenter = std::make_unique<CDefragmenter>(kDefragmentBytesPerFrame);
+    mp_framePacer = std::make_unique<CFramePacer>(m_framesInFlight, appInfo.presentMode, appInfo.maxFrameRate);
+    mp_framePacer->SetRenderOnDemand(appInfo.isRenderOnDemand);
+    // The scene animates by default, on demand it would never idle, the animation can be resumed from the GUI
+    if (appInfo.isRenderOnDemand)
+        mp_framePacer->SetAnimating(false);
+    mp_dynamicResolution =
+        std::make_unique<CDynamicResolution>(m_framesInFlight, appInfo.isDynamicResolution, appInfo.targetGpuFrameMs);
+    m_isCommandCaching = appInfo.isCommandCaching;
+    m_isParallelRecording = appInfo.isParallelRecording;
+    m_isDepthPrepass = appInfo.isDepthPrepass;
+    m_isFrameDepthPrepass = m_isDepthPrepass;
     CreateQueues();
-    CreateSwapchain();
-    CreateSwapchainImages();
+    CreateTimelineSync();
+    if (m_isHeadless)
+    {
+        m_extent = {appInfo.width, appInfo.height};
+        CreateOffscreenImages();
+    }
+    else
+    {
+        CreateSwapchain();
+        CreateSwapchainImages();
+    }
     CreateImageViews();
-    CreateDepthImage();
-    CreateCommandPool();
-    CreateCommandBuffers();
+    const auto recordingThreadCount =
+        appInfo.recordingThreadCount != 0
+            ? appInfo.recordingThreadCount
+            : std::clamp(std::thread::hardware_concurrency(), 1u, kMaxRecordingThreads);
+    CreateCommandPools(recordingThreadCount);
+    CreateUploadContext();
+    CreateGeometryArena();
+    CreateCommandRecorders();
     CreateDescriptorPool();
     CreateDescriptorSetLayout();
+    CreateCameraLatch();
+    CreateUniformRing();
     CreatePipelineLayout();
-    CreateRenderPass();
+    CreateRenderGraph();
+    CreateRenderGraphResources();
     CreateGraphicsPipeline();
-    CreateFramebuffers();
-    CreateSemaphores();
-    CreateFences();
+    CreateDepthPrepassPipeline();
+    // Offscreen frames are only ordered by the graphics timeline
+    if (!m_isHeadless)
+    {
+        CreateSemaphores();
+        CreatePresentSemaphores();
+    }
 
     //    // Create the buffer and image manager
     //    mp_bufferImageManager =
@@ -57,85 +128,258 @@ void CDevice::InitDevice(CWindow *window, CInstance *vkInstance, CBufferImageMan
 
 bool CDevice::DrawBegin()
 {
-    uint32_t imageIndex;
-    const auto acquireRes = vkAcquireNextImageKHR(m_device, m_swapchain, UINT64_MAX, m_semaphoreRenderComplete,
-                                                  VK_NULL_HANDLE, &imageIndex);
-    if (acquireRes == VK_ERROR_OUT_OF_DATE_KHR)
-    {
-        RecreateSwapchain();
-        return false;
-    }
-    else if (acquireRes != VK_SUCCESS && acquireRes != VK_SUBOPTIMAL_KHR)
+    // Earlier frames may finish before or while the limiter waits, the sooner we see it the closer the measured
+    // latency
+    mp_framePacer->BeginFrame([this]() { PollCompletedFrames(); });
+
+    // Only the frame that last used this slot has to be done, the ones after it keep running while we record
+    const auto frameIndex = m_currentFrameIndex;
+    mp_timelineSync->Wait({ETimelineQueue::Graphics, m_vecFrameTimelineValues[frameIndex]});
+    mp_framePacer->OnFrameCompleted(frameIndex);
+
+    // Offscreen images belong to a frame slot, the wait above already made this one free
+    uint32_t imageIndex = frameIndex;
+    if (!m_isHeadless)
     {
-        throw std::runtime_error("Failed to acquire next image.");
+        const auto acquireRes = vkAcquireNextImageKHR(m_device, m_swapchain, UINT64_MAX,
+                                                      m_vecImageAcquiredSemaphores[frameIndex], VK_NULL_HANDLE,
+                                                      &imageIndex);
+        if (acquireRes == VK_ERROR_OUT_OF_DATE_KHR)
+        {
+            RecreateSwapchain();
+            return false;
+        }
+        else if (acquireRes != VK_SUCCESS && acquireRes != VK_SUBOPTIMAL_KHR)
+        {
+            throw std::runtime_error("Failed to acquire next image.");
+        }
     }
-    // Wait for the current fence
-    vkWaitForFences(m_device, 1, &m_fences[imageIndex], VK_TRUE, UINT64_MAX);
-    vkResetFences(m_device, 1, &m_fences[imageIndex]);
 
-    m_currentCommandBuffer = m_commandBuffers[imageIndex];
+    // Frames retire in submission order, whatever the graphics timeline passed is done, not only this slot's frame
+    mp_deletionQueue->Collect(mp_timelineSync->GetCompleted(ETimelineQueue::Graphics));
+    mp_bufferImageManager->GetMemoryBudget().Update();
+    CHostAllocator::GetInstance().BeginFrame();
+
+    // Everything the slot recorded into Frame pools last time goes with one reset per thread
+    mp_commandPoolManager->Reset(ECommandPoolSet::Frame, frameIndex);
+    m_primaryCommandBuffer =
+        mp_commandPoolManager->Acquire(ECommandPoolSet::Frame, frameIndex, 0, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+    m_currentCommandBuffer = m_primaryCommandBuffer;
     m_currentImageIndex = imageIndex;
+    // Toggling takes effect here, the render pass contents depend on it
+    m_isFrameCached = m_isCommandCaching;
+    m_isFrameParallel = m_isParallelRecording;
+    m_isFrameDepthPrepass = m_isDepthPrepass;
+    mp_uniformRing->BeginFrame(frameIndex);
 
     // Begin writing to command buffer
     VkCommandBufferBeginInfo commandBufferBeginInfo{};
     commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    if (vkBeginCommandBuffer(m_currentCommandBuffer, &commandBufferBeginInfo) != VK_SUCCESS)
+    if (vkBeginCommandBuffer(m_primaryCommandBuffer, &commandBufferBeginInfo) != VK_SUCCESS)
         throw std::runtime_error("Failed to begin command buffer.");
 
-    std::array<VkClearValue, 2> clearValues;
-    clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
-    clearValues[1].depthStencil = {1.0f, 0};
+    // The slot's previous frame is done, its GPU time decides this frame's scale
+    mp_dynamicResolution->BeginFrame(m_primaryCommandBuffer, frameIndex);
+    const auto renderExtent = mp_dynamicResolution->GetRenderExtent(m_extent);
+    if (renderExtent.width != m_renderExtent.width || renderExtent.height != m_renderExtent.height)
+    {
+        m_renderExtent = renderExtent;
+        // The recorded viewport and scissor have the old render extent
+        mp_commandCache->Invalidate();
+    }
+    // Enabling dynamic resolution or lowering the max scale moves the scene into SceneColor, and back out. Toggling
+    // the depth pre-pass switches to the variant with or without its pass.
+    if (GetFrameGraphIndex(IsUpscaleNeeded(m_renderExtent), m_isFrameDepthPrepass) != m_frameGraphIndex)
+        CreateRenderGraphResources();
 
-    // Begin renderpass
-    VkRenderPassBeginInfo renderPassBeginInfo{};
-    renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassBeginInfo.renderPass = m_renderPass;
-    renderPassBeginInfo.framebuffer = m_framebuffers[m_currentImageIndex];
-    renderPassBeginInfo.renderArea.offset = {0, 0};
-    renderPassBeginInfo.renderArea.extent = m_extent;
-    renderPassBeginInfo.clearValueCount = clearValues.size();
-    renderPassBeginInfo.pClearValues = clearValues.data();
-    vkCmdBeginRenderPass(m_currentCommandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+    // Resources may only move while no upload is writing to them or waiting for its ownership acquire
+    const auto canDefragment = mp_uploadContext->IsIdle();
 
-    // Bind the graphics pipeline
-    vkCmdBindPipeline(m_currentCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+    // Submit uploads recorded since the last frame and take ownership of whatever the transfer queue released
+    mp_uploadContext->Flush();
+    m_uploadWaitValue = mp_uploadContext->RecordAcquireBarriers(m_primaryCommandBuffer);
+
+    // Relocations are recorded before anything this frame binds the resources
+    if (canDefragment)
+        mp_defragmenter->Step(m_primaryCommandBuffer);
 
     return true;
 }
+
+void CDevice::SetSceneRecorder(std::function<void()> &&sceneRecorder)
+{
+    m_sceneRecorder = std::move(sceneRecorder);
+    mp_commandCache->Invalidate();
+}
+
+void CDevice::SetOverlayRecorder(std::function<void()> &&overlayRecorder)
+{
+    m_overlayRecorder = std::move(overlayRecorder);
+}
+
+void CDevice::SetDepthRecorder(std::function<void()> &&depthRecorder)
+{
+    m_depthRecorder = std::move(depthRecorder);
+}
+
+void CDevice::RecordDepthPrepass()
+{
+    // Only part of the graph while the pre-pass is switched on
+    if (!m_depthRecorder)
+        return;
+
+    BindDepthState(m_currentCommandBuffer);
+    m_depthRecorder();
+}
+
+void CDevice::RecordScenePass()
+{
+    if (BeginScene() && m_sceneRecorder)
+        m_sceneRecorder();
+    EndScene();
+}
+
+void CDevice::RecordUpscalePass(VkCommandBuffer cmdBuffer)
+{
+    mp_upscalePass->Record(cmdBuffer, m_renderExtent, m_extent);
+    RecordOverlayPass();
+}
+
+void CDevice::RecordOverlayPass()
+{
+    // Changes every frame, never part of the cached scene, and is recorded inline
+    if (m_overlayRecorder)
+        m_overlayRecorder();
+}
+
+bool CDevice::BeginScene()
+{
+    if (m_isFrameCached && mp_commandCache->IsValid(m_currentFrameIndex))
+    {
+        mp_commandCache->OnSceneReplayed();
+        return false;
+    }
+
+    // The cache's scene buffer takes whatever the scene records on this thread, also when it isn't cached
+    if (IsFrameInSecondaries())
+    {
+        mp_commandPoolManager->Reset(ECommandPoolSet::Scene, m_currentFrameIndex);
+        m_currentCommandBuffer = mp_commandCache->BeginScene(m_currentFrameIndex, m_renderPass);
+    }
+    if (m_isFrameParallel)
+        mp_parallelRecorder->BeginFrame(m_currentFrameIndex);
+
+    BindSceneState(m_currentCommandBuffer);
+    return true;
+}
+
+void CDevice::RecordParallel(uint32_t drawCount, const std::function<void(VkCommandBuffer, uint32_t)> &drawFunction)
+{
+    if (!m_isFrameParallel)
+    {
+        for (auto index = 0u; index != drawCount; ++index)
+            drawFunction(m_currentCommandBuffer, index);
+        return;
+    }
+
+    mp_parallelRecorder->Record(m_currentFrameIndex, m_renderPass, drawCount, drawFunction);
+}
+
+void CDevice::EndScene()
+{
+    if (!IsFrameInSecondaries())
+        return;
+
+    if (m_currentCommandBuffer != m_primaryCommandBuffer)
+        mp_commandCache->EndScene(m_currentFrameIndex);
+
+    // Parallel ranges in draw order, then what was recorded on this thread. A replay executes the same buffers, the
+    // recorder's pools are only reset when the scene records again.
+    std::vector<VkCommandBuffer> vecSceneCommandBuffers;
+    if (m_isFrameParallel)
+        vecSceneCommandBuffers = mp_parallelRecorder->GetCommandBuffers(m_currentFrameIndex);
+    vecSceneCommandBuffers.push_back(mp_commandCache->GetScene(m_currentFrameIndex));
+    vkCmdExecuteCommands(m_primaryCommandBuffer, static_cast<uint32_t>(vecSceneCommandBuffers.size()),
+                         vecSceneCommandBuffers.data());
+    m_currentCommandBuffer = m_primaryCommandBuffer;
+}
+
+void CDevice::BindSceneState(VkCommandBuffer cmdBuffer) const
+{
+    // Bind the graphics pipeline, secondary command buffers don't inherit any state
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      m_isFrameDepthPrepass ? m_depthEqualPipeline : m_graphicsPipeline);
+    SetViewportAndScissor(cmdBuffer);
+    mp_geometryArena->Bind(cmdBuffer);
+}
+
+void CDevice::BindDepthState(VkCommandBuffer cmdBuffer) const
+{
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_depthPrepassPipeline);
+    SetViewportAndScissor(cmdBuffer);
+    mp_geometryArena->BindPositions(cmdBuffer);
+}
+
 bool CDevice::DrawEnd()
 {
-    vkCmdEndRenderPass(m_currentCommandBuffer);
-    if (vkEndCommandBuffer(m_currentCommandBuffer) != VK_SUCCESS)
+    // The ring grew while objects pushed their uniforms, the slot's previous frame is done with its set
+    if (m_vecUniformSetGenerations[m_currentFrameIndex] != mp_uniformRing->GetGeneration())
+    {
+        WriteUniformDescriptorSet(m_currentFrameIndex);
+        // Recordings using an updated set are invalid
+        mp_commandCache->Invalidate();
+    }
+    m_frameGraphs[m_frameGraphIndex].pGraph->Execute(m_primaryCommandBuffer, m_currentImageIndex);
+    mp_dynamicResolution->EndFrame(m_primaryCommandBuffer, m_currentFrameIndex);
+    if (vkEndCommandBuffer(m_primaryCommandBuffer) != VK_SUCCESS)
         throw std::runtime_error("Failed to end command buffer.");
 
-    std::array<VkPipelineStageFlags, 1> flags{VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    std::array<VkSemaphore, 1> waitSemaphores{m_semaphoreRenderComplete};
-    std::array<VkSemaphore, 1> signalSemaphores{m_semaphorePresentComplete};
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.waitSemaphoreCount = waitSemaphores.size();
-    submitInfo.pWaitSemaphores = waitSemaphores.data();
-    submitInfo.pWaitDstStageMask = flags.data();
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &m_currentCommandBuffer;
-    submitInfo.signalSemaphoreCount = signalSemaphores.size();
-    submitInfo.pSignalSemaphores = signalSemaphores.data();
-
-    if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_fences[m_currentImageIndex]) != VK_SUCCESS)
-        throw std::runtime_error("Failed to submit queue.");
+    mp_uniformRing->Flush();
+
+    STimelineSubmit submit{};
+    submit.vecCommandBuffers.push_back(m_primaryCommandBuffer);
+    if (!m_isHeadless)
+    {
+        submit.vecBinaryWaitSemaphores.push_back(m_vecImageAcquiredSemaphores[m_currentFrameIndex]);
+        submit.vecBinaryWaitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+        submit.vecBinarySignalSemaphores.push_back(m_vecRenderCompleteSemaphores[m_currentImageIndex]);
+    }
+    // Async uploads only have to finish before the acquire barriers at the start of the frame
+    if (m_uploadWaitValue != 0)
+        submit.vecWaits.push_back({{ETimelineQueue::Transfer, m_uploadWaitValue}, VK_PIPELINE_STAGE_TRANSFER_BIT});
+
+    // Sampled as late as possible, everything recorded this frame reads the camera from the latch
+    mp_cameraLatch->Latch(m_currentFrameIndex);
+    const auto frameValue = mp_timelineSync->Submit(ETimelineQueue::Graphics, submit);
+    m_vecFrameTimelineValues[m_currentFrameIndex] = frameValue;
+    mp_deletionQueue->OnFrameSubmitted(frameValue);
+    mp_framePacer->OnSubmit(m_currentFrameIndex);
+    m_uploadWaitValue = 0;
+    m_currentFrameIndex = (m_currentFrameIndex + 1) % m_framesInFlight;
+
+    // Offscreen frames end in TRANSFER_SRC_OPTIMAL, nothing presents them
+    if (m_isHeadless)
+    {
+        mp_framePacer->EndFrame();
+        return true;
+    }
 
     // after render finishes start presenting the image
     std::array<VkSwapchainKHR, 1> swapchains{m_swapchain};
     VkPresentInfoKHR presentInfoKhr{};
     presentInfoKhr.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    presentInfoKhr.waitSemaphoreCount = signalSemaphores.size();
-    presentInfoKhr.pWaitSemaphores = signalSemaphores.data();
+    presentInfoKhr.waitSemaphoreCount = submit.vecBinarySignalSemaphores.size();
+    presentInfoKhr.pWaitSemaphores = submit.vecBinarySignalSemaphores.data();
     presentInfoKhr.swapchainCount = swapchains.size();
     presentInfoKhr.pSwapchains = swapchains.data();
     presentInfoKhr.pImageIndices = &m_currentImageIndex;
 
     const auto presentRes = vkQueuePresentKHR(m_presentQueue, &presentInfoKhr);
-    if (presentRes == VK_ERROR_OUT_OF_DATE_KHR || presentRes == VK_SUBOPTIMAL_KHR || ShouldRecreateSwapchain())
+    mp_framePacer->EndFrame();
+
+    const auto isPresentModeChanged = mp_framePacer->ConsumePresentModeChange();
+    if (presentRes == VK_ERROR_OUT_OF_DATE_KHR || presentRes == VK_SUBOPTIMAL_KHR || ShouldRecreateSwapchain() ||
+        isPresentModeChanged)
     {
         RecreateSwapchain();
         return false;
@@ -143,8 +387,6 @@ bool CDevice::DrawEnd()
     else if (presentRes != VK_SUCCESS)
         throw std::runtime_error("Failed to present image");
 
-    vkQueueWaitIdle(m_presentQueue);
-
     return true;
 }
 
@@ -166,16 +408,27 @@ void CDevice::CreateDevice(SAppInfo appInfo)
     VkPhysicalDeviceFeatures features{};
     features.fillModeNonSolid = VK_TRUE;
     features.samplerAnisotropy = VK_TRUE;
+    // Optional extensions are only enabled when the device has them
+    auto deviceExtensions = appInfo.deviceExtensions;
+    if (mp_bufferImageManager->GetMemoryBudget().IsExtensionSupported())
+        deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+    // Core in 1.2, CInstance only picks devices that support it
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    timelineFeatures.timelineSemaphore = VK_TRUE;
+
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    createInfo.pNext = nullptr;
-    createInfo.enabledExtensionCount = appInfo.deviceExtensions.size();
-    createInfo.ppEnabledExtensionNames = appInfo.deviceExtensions.data();
+    createInfo.pNext = &timelineFeatures;
+    createInfo.enabledExtensionCount = deviceExtensions.size();
+    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
     createInfo.queueCreateInfoCount = queueCreateInfos.size();
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.pEnabledFeatures = &features;
 
-    if (const auto res = vkCreateDevice(mp_instance->PhysicalDevice(), &createInfo, nullptr, &m_device);
+    if (const auto res =
+            vkCreateDevice(mp_instance->PhysicalDevice(), &createInfo, CHostAllocator::GetCallbacks(), &m_device);
         res != VK_SUCCESS)
         throw std::runtime_error("Failed to create device.");
 }
@@ -185,6 +438,14 @@ void CDevice::CreateQueues()
     // Graphics Queue
     vkGetDeviceQueue(m_device, mp_instance->QueueFamilies().graphicsFamilyIndex.value(), 0, &m_graphicsQueue);
     vkGetDeviceQueue(m_device, mp_instance->QueueFamilies().presentFamilyIndex.value(), 0, &m_presentQueue);
+    vkGetDeviceQueue(m_device, *mp_instance->QueueFamilies().TransferFamily(), 0, &m_transferQueue);
+}
+
+void CDevice::CreateTimelineSync()
+{
+    mp_timelineSync = std::make_unique<CTimelineSync>(m_graphicsQueue, m_transferQueue);
+    // Value 0 is reached from the start, slots that never submitted don't wait
+    m_vecFrameTimelineValues.assign(m_framesInFlight, 0);
 }
 
 VkSurfaceFormatKHR CDevice::GetOptimalSurfaceFormat()
@@ -201,13 +462,15 @@ VkSurfaceFormatKHR CDevice::GetOptimalSurfaceFormat()
 
 VkPresentModeKHR CDevice::GetOptimalPresentMode()
 {
+    const auto requestedMode = mp_framePacer->GetRequestedPresentMode();
     for (const auto &presentMode : mp_instance->SwapchainSupport().surfacePresentModes)
     {
-        if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+        if (presentMode == requestedMode)
         {
             return presentMode;
         }
     }
+    // The only mode every surface has to support
     return VK_PRESENT_MODE_FIFO_KHR;
 }
 
@@ -231,7 +494,7 @@ VkExtent2D CDevice::GetOptimalExtent2D()
     return extent;
 }
 
-void CDevice::CreateSwapchain()
+void CDevice::CreateSwapchain(VkSwapchainKHR oldSwapchain)
 {
     const auto extent = GetOptimalExtent2D();
     const auto format = GetOptimalSurfaceFormat();
@@ -259,7 +522,8 @@ void CDevice::CreateSwapchain()
     createInfo.preTransform = mp_instance->SwapchainSupport().surfaceCapabilities.currentTransform;
     createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     createInfo.clipped = VK_TRUE;
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    // Lets the driver hand over resources, images of the old swapchain can still be presented
+    createInfo.oldSwapchain = oldSwapchain;
     if (mp_instance->QueueFamilies().graphicsFamilyIndex.value() ==
         mp_instance->QueueFamilies().presentFamilyIndex.value())
     {
@@ -272,52 +536,68 @@ void CDevice::CreateSwapchain()
         createInfo.pQueueFamilyIndices = queueFamilyIndices.data();
     }
 
-    if (vkCreateSwapchainKHR(m_device, &createInfo, nullptr, &m_swapchain) != VK_SUCCESS)
+    if (vkCreateSwapchainKHR(m_device, &createInfo, CHostAllocator::GetCallbacks(), &m_swapchain) != VK_SUCCESS)
         throw std::runtime_error("Failed to create swapchain.");
 
     m_extent = extent;
     m_format = format.format;
+    m_presentMode = presentMode;
 }
 
 void CDevice::RecreateSwapchain()
 {
-    vkDeviceWaitIdle(m_device);
-
-    CleanupSwapchain();
-
     mp_instance->UpdateSwaphchainSupport();
-    CreateSwapchain();
+    const auto oldSwapchain = m_swapchain;
+    CreateSwapchain(oldSwapchain);
+
+    // Frames already submitted keep rendering into the old images, everything sized to them is retired with those
+    // frames instead of idling the device. The render graph's passes and the pipelines only depend on the formats and
+    // stay, its framebuffers and transient images are retired the same way when it creates new ones.
+    DeferDestroy([oldSwapchain, imageViews = std::move(m_imageViews),
+                  renderCompleteSemaphores = std::move(m_vecRenderCompleteSemaphores)]() {
+        const auto device = CDevice::GetInstance().GetDevice();
+        for (auto &semaphore : renderCompleteSemaphores)
+            vkDestroySemaphore(device, semaphore, CHostAllocator::GetCallbacks());
+        for (auto &imageView : imageViews)
+            vkDestroyImageView(device, imageView, CHostAllocator::GetCallbacks());
+        vkDestroySwapchainKHR(device, oldSwapchain, CHostAllocator::GetCallbacks());
+    });
+    m_imageViews.clear();
+    m_vecRenderCompleteSemaphores.clear();
+
     CreateSwapchainImages();
     CreateImageViews();
-    CreateDepthImage();
-    CreateCommandBuffers();
-    //    CreateDescriptorPool();
-    //    CreateDescriptorSetLayout();
-    CreatePipelineLayout();
-    CreateRenderPass();
-    CreateGraphicsPipeline();
-    CreateFramebuffers();
+    CreatePresentSemaphores();
+    CreateRenderGraphResources();
+    // The recorded viewport and scissor have the old extent
+    mp_commandCache->Invalidate();
 }
 
 void CDevice::CleanupSwapchain()
 {
-
-    for (auto &framebuffer : m_framebuffers)
+    for (auto &frameGraph : m_frameGraphs)
+        frameGraph.pGraph->Cleanup();
+    mp_upscalePass->Cleanup();
+    vkDestroyPipeline(m_device, m_graphicsPipeline, CHostAllocator::GetCallbacks());
+    vkDestroyPipeline(m_device, m_depthEqualPipeline, CHostAllocator::GetCallbacks());
+    vkDestroyPipeline(m_device, m_depthPrepassPipeline, CHostAllocator::GetCallbacks());
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, CHostAllocator::GetCallbacks());
+    for (auto &semaphore : m_vecRenderCompleteSemaphores)
     {
-        vkDestroyFramebuffer(m_device, framebuffer, nullptr);
+        vkDestroySemaphore(m_device, semaphore, CHostAllocator::GetCallbacks());
     }
-    vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
-    vkDestroyRenderPass(m_device, m_renderPass, nullptr);
-    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
-    vkFreeCommandBuffers(m_device, m_commandPool, m_commandBuffers.size(), m_commandBuffers.data());
-    vkDestroyImage(m_device, m_depthImage, nullptr);
-    vkFreeMemory(m_device, m_depthImageMemory, nullptr);
-    vkDestroyImageView(m_device, m_depthImageView, nullptr);
     for (auto &imageView : m_imageViews)
     {
-        vkDestroyImageView(m_device, imageView, nullptr);
+        vkDestroyImageView(m_device, imageView, CHostAllocator::GetCallbacks());
     }
-    vkDestroySwapchainKHR(m_device, m_swapchain, nullptr);
+    for (auto &imageHandles : m_vecOffscreenImages)
+    {
+        mp_bufferImageManager->DestroyImagesHandles(imageHandles);
+    }
+    m_vecOffscreenImages.clear();
+    // Headless devices don't enable the swapchain extension at all
+    if (m_swapchain != VK_NULL_HANDLE)
+        vkDestroySwapchainKHR(m_device, m_swapchain, CHostAllocator::GetCallbacks());
 }
 
 bool CDevice::ShouldRecreateSwapchain()
@@ -339,58 +619,35 @@ void CDevice::CreateSwapchainImages()
     vkGetSwapchainImagesKHR(m_device, m_swapchain, &imageCount, m_swapchainImages.data());
 }
 
-void CDevice::CreateDepthImage()
+void CDevice::CreateOffscreenImages()
 {
-    m_depthFormat = FindDepthFormat({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D32_SFLOAT_S8_UINT},
-                                    VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+    m_format = kOffscreenColorFormat;
+
     VkImageCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     createInfo.imageType = VK_IMAGE_TYPE_2D;
-    createInfo.format = m_depthFormat;
+    createInfo.format = m_format;
     createInfo.extent.width = m_extent.width;
     createInfo.extent.height = m_extent.height;
-    createInfo.extent.depth = 1.0f;
+    createInfo.extent.depth = 1;
     createInfo.mipLevels = 1;
     createInfo.arrayLayers = 1;
     createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    createInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    // Stored so frames can be read back
+    createInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
     createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    createInfo.queueFamilyIndexCount = 1;
-    createInfo.pQueueFamilyIndices = mp_instance->QueueFamilies().GraphicsFamily();
     createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-    if (const auto res = vkCreateImage(m_device, &createInfo, nullptr, &m_depthImage); res != VK_SUCCESS)
-        throw std::runtime_error("Failed to create depth image.");
-
-    VkMemoryRequirements memReq;
-    vkGetImageMemoryRequirements(m_device, m_depthImage, &memReq);
-
-    VkMemoryAllocateInfo allocateInfo{};
-    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocateInfo.memoryTypeIndex = FindMemoryType(memReq.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    allocateInfo.allocationSize = memReq.size;
-
-    if (const auto res = vkAllocateMemory(m_device, &allocateInfo, nullptr, &m_depthImageMemory); res != VK_SUCCESS)
-        throw std::runtime_error("Failed to allocate depth memory.");
-
-    if (const auto res = vkBindImageMemory(m_device, m_depthImage, m_depthImageMemory, 0); res != VK_SUCCESS)
-        throw std::runtime_error("Failed to bind depth image memory.");
-
-    VkImageViewCreateInfo imageViewCreateInfo{};
-    imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    imageViewCreateInfo.image = m_depthImage;
-    imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    imageViewCreateInfo.format = m_depthFormat;
-    imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-    imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
-    imageViewCreateInfo.subresourceRange.levelCount = 1;
-    imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
-    imageViewCreateInfo.subresourceRange.layerCount = 1;
-
-    if (const auto res = vkCreateImageView(m_device, &imageViewCreateInfo, nullptr, &m_depthImageView);
-        res != VK_SUCCESS)
-        throw std::runtime_error("Failed to create depth image view.");
+    // One per frame in flight, stands in for the swapchain images
+    m_vecOffscreenImages.resize(m_framesInFlight);
+    m_swapchainImages.clear();
+    for (auto &imageHandles : m_vecOffscreenImages)
+    {
+        mp_bufferImageManager->CreateImage(createInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, imageHandles,
+                                           EMemoryCategory::Attachment);
+        m_swapchainImages.push_back(imageHandles.image);
+    }
 }
 
 void CDevice::CreateImageViews()
@@ -415,78 +672,142 @@ void CDevice::CreateImageViews()
         createInfo.subresourceRange.baseArrayLayer = 0;
         createInfo.subresourceRange.layerCount = 1;
 
-        if (vkCreateImageView(m_device, &createInfo, nullptr, &m_imageViews[index++]) != VK_SUCCESS)
+        if (vkCreateImageView(m_device, &createInfo, CHostAllocator::GetCallbacks(), &m_imageViews[index++]) !=
+            VK_SUCCESS)
             throw std::runtime_error("Failed to create image view.");
     }
 }
 
 void CDevice::CreatePipelineLayout()
 {
+    std::array<VkDescriptorSetLayout, 2> setLayouts{m_uniformDescriptorLayout, m_textureDescriptorLayout};
     VkPipelineLayoutCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    createInfo.setLayoutCount = 1;
-    createInfo.pSetLayouts = &m_descriptorLayout;
+    createInfo.setLayoutCount = setLayouts.size();
+    createInfo.pSetLayouts = setLayouts.data();
     createInfo.pushConstantRangeCount = 0;
     createInfo.pPushConstantRanges = nullptr;
 
-    if (vkCreatePipelineLayout(m_device, &createInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS)
+    if (vkCreatePipelineLayout(m_device, &createInfo, CHostAllocator::GetCallbacks(), &m_pipelineLayout) != VK_SUCCESS)
         throw std::runtime_error("Failed to create pipeline layout.");
 }
 
-void CDevice::CreateRenderPass()
-{
-    std::array<VkAttachmentDescription, 2> attachmentDescriptions{};
-    attachmentDescriptions[0].format = m_format;
-    attachmentDescriptions[0].samples = VK_SAMPLE_COUNT_1_BIT;
-    attachmentDescriptions[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachmentDescriptions[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    attachmentDescriptions[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachmentDescriptions[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachmentDescriptions[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachmentDescriptions[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-    attachmentDescriptions[1].format = m_depthFormat;
-    attachmentDescriptions[1].samples = VK_SAMPLE_COUNT_1_BIT;
-    attachmentDescriptions[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachmentDescriptions[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachmentDescriptions[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachmentDescriptions[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachmentDescriptions[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachmentDescriptions[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentReference colorReference{};
-    colorReference.attachment = 0;
-    colorReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentReference depthReference{};
-    depthReference.attachment = 1;
-    depthReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    VkSubpassDescription subpassDescription{};
-    subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpassDescription.colorAttachmentCount = 1;
-    subpassDescription.pColorAttachments = &colorReference;
-    subpassDescription.pDepthStencilAttachment = &depthReference;
-
-    VkSubpassDependency subpassDependency{};
-    subpassDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    subpassDependency.dstSubpass = 0;
-    subpassDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    subpassDependency.srcAccessMask = 0;
-    subpassDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    subpassDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-    VkRenderPassCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    createInfo.attachmentCount = attachmentDescriptions.size();
-    createInfo.pAttachments = attachmentDescriptions.data();
-    createInfo.subpassCount = 1;
-    createInfo.pSubpasses = &subpassDescription;
-    createInfo.dependencyCount = 1;
-    createInfo.pDependencies = &subpassDependency;
-
-    if (vkCreateRenderPass(m_device, &createInfo, nullptr, &m_renderPass) != VK_SUCCESS)
-        throw std::runtime_error("Failed to create render pass.");
+void CDevice::CreateRenderGraph()
+{
+    m_depthFormat = FindDepthFormat({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D32_SFLOAT_S8_UINT},
+                                    VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+    for (const auto isUpscaling : {false, true})
+    {
+        for (const auto isDepthPrepass : {false, true})
+            CreateFrameGraph(isUpscaling, isDepthPrepass);
+    }
+
+    // Every variant's scene, depth pre-pass and overlay passes have the same attachment formats and all of them are
+    // interchangeable, so the pipelines and secondary command buffers made for one variant's passes work with all
+    const auto &upscaleGraph = *m_frameGraphs[GetFrameGraphIndex(true, true)].pGraph;
+    m_renderPass = upscaleGraph.GetRenderPass("Scene");
+    m_overlayRenderPass = upscaleGraph.GetRenderPass("Upscale");
+    m_depthPrepassRenderPass = upscaleGraph.GetRenderPass("DepthPrepass");
+    mp_upscalePass = std::make_unique<CUpscalePass>(m_overlayRenderPass);
+}
+
+void CDevice::CreateFrameGraph(bool isUpscaling, bool isDepthPrepass)
+{
+    auto &frameGraph = m_frameGraphs[GetFrameGraphIndex(isUpscaling, isDepthPrepass)];
+    frameGraph.pGraph = std::make_unique<CRenderGraph>();
+    auto &renderGraph = *frameGraph.pGraph;
+    // Offscreen frames end in TRANSFER_SRC_OPTIMAL so they can be read back
+    frameGraph.backbufferImage = renderGraph.ImportImage(
+        "Backbuffer", m_format, m_isHeadless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    // Same format as the backbuffer, so sampling and writing it both convert through linear. At full resolution an
+    // intermediate target and a fullscreen copy would only cost memory and bandwidth.
+    if (isUpscaling)
+        frameGraph.sceneColorImage = renderGraph.CreateImage("SceneColor", m_format);
+    const auto colorImage = isUpscaling ? frameGraph.sceneColorImage : frameGraph.backbufferImage;
+    const auto depthImage = renderGraph.CreateImage("Depth", m_depthFormat);
+
+    // Depth of the opaque objects from their position stream, the scene then loads it. Without the pre-pass the
+    // scene clears the depth itself and never stores it, so it can stay a lazily allocated transient attachment.
+    if (isDepthPrepass)
+    {
+        SGraphPassDesc depthPrepass{};
+        depthPrepass.name = "DepthPrepass";
+        depthPrepass.depthAttachment.image = depthImage;
+        depthPrepass.depthAttachment.clearValue.depthStencil = {1.0f, 0};
+        depthPrepass.recordFunction = [this](VkCommandBuffer) { RecordDepthPrepass(); };
+        depthPrepass.extentFunction = [this]() { return m_renderExtent; };
+        depthPrepass.isInterchangeable = true;
+        renderGraph.AddPass(std::move(depthPrepass));
+    }
+
+    // The scene at the dynamic resolution
+    SGraphPassDesc scenePass{};
+    scenePass.name = "Scene";
+    SGraphAttachment colorAttachment{};
+    colorAttachment.image = colorImage;
+    colorAttachment.clearValue.color = {0.0f, 0.0f, 0.0f, 1.0f};
+    scenePass.vecColorAttachments.push_back(colorAttachment);
+    // Written either way, lights are never in the pre-pass
+    scenePass.depthAttachment.image = depthImage;
+    scenePass.depthAttachment.load = isDepthPrepass ? EGraphLoad::Load : EGraphLoad::Clear;
+    scenePass.depthAttachment.clearValue.depthStencil = {1.0f, 0};
+    scenePass.recordFunction = [this](VkCommandBuffer) { RecordScenePass(); };
+    scenePass.contentsFunction = [this]() {
+        return IsFrameInSecondaries() ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+    };
+    scenePass.extentFunction = [this]() { return m_renderExtent; };
+    scenePass.isInterchangeable = true;
+    renderGraph.AddPass(std::move(scenePass));
+
+    SGraphPassDesc overlayPass{};
+    SGraphAttachment backbufferAttachment{};
+    backbufferAttachment.image = frameGraph.backbufferImage;
+    if (isUpscaling)
+    {
+        // Covers every backbuffer pixel, nothing has to be cleared
+        overlayPass.name = "Upscale";
+        backbufferAttachment.load = EGraphLoad::DontCare;
+        overlayPass.vecSampledImages.push_back(frameGraph.sceneColorImage);
+        overlayPass.recordFunction = [this](VkCommandBuffer cmdBuffer) { RecordUpscalePass(cmdBuffer); };
+    }
+    else
+    {
+        // The overlay needs a pass without depth, its pipelines are made for the upscale pass
+        overlayPass.name = "Overlay";
+        backbufferAttachment.load = EGraphLoad::Load;
+        overlayPass.recordFunction = [this](VkCommandBuffer) { RecordOverlayPass(); };
+    }
+    overlayPass.vecColorAttachments.push_back(backbufferAttachment);
+    overlayPass.isInterchangeable = true;
+    renderGraph.AddPass(std::move(overlayPass));
+    renderGraph.MarkOutput(frameGraph.backbufferImage);
+    renderGraph.Compile();
+}
+
+void CDevice::CreateRenderGraphResources()
+{
+    m_renderExtent = mp_dynamicResolution->GetRenderExtent(m_extent);
+    m_isUpscaling = IsUpscaleNeeded(m_renderExtent);
+    m_frameGraphIndex = GetFrameGraphIndex(m_isUpscaling, m_isFrameDepthPrepass);
+
+    // Frames still rendering with another variant keep its images until they complete
+    for (auto graphIndex = 0u; graphIndex != m_frameGraphs.size(); ++graphIndex)
+    {
+        if (graphIndex != m_frameGraphIndex)
+            m_frameGraphs[graphIndex].pGraph->ReleaseResources();
+    }
+    const auto &frameGraph = m_frameGraphs[m_frameGraphIndex];
+    frameGraph.pGraph->SetImportedViews(frameGraph.backbufferImage, m_imageViews);
+    frameGraph.pGraph->CreateResources(m_extent);
+    if (m_isUpscaling)
+        mp_upscalePass->SetSource(frameGraph.pGraph->GetImageView(frameGraph.sceneColorImage));
+}
+
+bool CDevice::IsUpscaleNeeded(VkExtent2D renderExtent) const
+{
+    // Kept while dynamic resolution is on, steps around full scale would otherwise recreate images every time
+    return mp_dynamicResolution->IsEnabled() || renderExtent.width != m_extent.width ||
+           renderExtent.height != m_extent.height;
 }
 
 void CDevice::CreateGraphicsPipeline()
@@ -508,22 +829,9 @@ void CDevice::CreateGraphicsPipeline()
     attachmentState.colorWriteMask =
         VK_COLOR_COMPONENT_A_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_R_BIT;
 
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = static_cast<float>(m_extent.width);
-    viewport.height = static_cast<float>(m_extent.height);
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissors = {};
-    scissors.extent = m_extent;
-    scissors.offset = {0, 0};
-
     const auto inputBindingsDesc = vkPrimitives::SVertex::GetInputBindingDescription();
     const auto attributeDesc = vkPrimitives::SVertex::GetAttributeBindingDescription();
-    const auto graphicsPipelineStates =
-        SGraphicsPipelineStates(attachmentState, viewport, scissors, inputBindingsDesc, attributeDesc);
+    const auto graphicsPipelineStates = SGraphicsPipelineStates(attachmentState, inputBindingsDesc, attributeDesc);
     // Create the renderpass
     // Create the graphics pipeline
     VkGraphicsPipelineCreateInfo createInfo{};
@@ -544,100 +852,209 @@ void CDevice::CreateGraphicsPipeline()
     createInfo.subpass = 0;
     createInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-    if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &createInfo, nullptr, &m_graphicsPipeline) != VK_SUCCESS)
+    if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &createInfo, CHostAllocator::GetCallbacks(),
+                                  &m_graphicsPipeline) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create graphics pipeline.");
+
+    // Behind the depth pre-pass only the fragments that laid down the depth are shaded
+    auto depthEqualState = graphicsPipelineStates.depthStencilState;
+    depthEqualState.depthCompareOp = VK_COMPARE_OP_EQUAL;
+    depthEqualState.depthWriteEnable = VK_FALSE;
+    createInfo.pDepthStencilState = &depthEqualState;
+    if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &createInfo, CHostAllocator::GetCallbacks(),
+                                  &m_depthEqualPipeline) != VK_SUCCESS)
         throw std::runtime_error("Failed to create graphics pipeline.");
     // Destroy the shader modules after they are added to the pipeline
-    vkDestroyShaderModule(m_device, vertModule, nullptr);
-    vkDestroyShaderModule(m_device, fragModule, nullptr);
+    vkDestroyShaderModule(m_device, vertModule, CHostAllocator::GetCallbacks());
+    vkDestroyShaderModule(m_device, fragModule, CHostAllocator::GetCallbacks());
 }
 
-void CDevice::CreateFramebuffers()
+void CDevice::CreateDepthPrepassPipeline()
 {
-    m_framebuffers.resize(m_imageViews.size());
-
-    for (auto index = 0; index != m_framebuffers.size(); ++index)
-    {
-        std::array<VkImageView, 2> attachments = {m_imageViews[index], m_depthImageView};
-        VkFramebufferCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        createInfo.renderPass = m_renderPass;
-        createInfo.attachmentCount = attachments.size();
-        createInfo.pAttachments = attachments.data();
-        createInfo.width = m_extent.width;
-        createInfo.height = m_extent.height;
-        createInfo.layers = 1;
-
-        if (vkCreateFramebuffer(m_device, &createInfo, nullptr, &m_framebuffers[index]) != VK_SUCCESS)
-            throw std::runtime_error("Failed to create framebuffer.");
-    }
+    // Vertex stage only, the depth comes from the fixed function tests
+    const auto vertModule =
+        CShaderUtils::CreateShaderModule(m_device, "../assets/shaders/depth.vert", EShaderType::Vert);
+    const std::vector<VkPipelineShaderStageCreateInfo> vecShaderStages{
+        CShaderUtils::ShaderPipelineStageCreateInfo(vertModule, EShaderType::Vert)};
+
+    const auto inputBindingDesc = vkPrimitives::SVertex::GetPositionInputBindingDescription();
+    const auto attributeDesc = vkPrimitives::SVertex::GetPositionAttributeDescription();
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    vertexInputInfo.pVertexBindingDescriptions = &inputBindingDesc;
+    vertexInputInfo.vertexAttributeDescriptionCount = 1;
+    vertexInputInfo.pVertexAttributeDescriptions = &attributeDesc;
+    const auto inputAssemblyInfo = vkStructs::InputAssemblyStateCreateInfo();
+    const auto tessellationInfo = vkStructs::TessellationStateCreateInfo();
+    // Culls like the scene pipeline, so the pre-pass covers exactly the fragments the scene shades
+    const auto rasterizationInfo = vkStructs::RasterizationStateCreateInfo();
+
+    // The pass has no colour attachments
+    VkPipelineColorBlendAttachmentState attachmentState{};
+    auto colorBlendInfo = vkStructs::ColorBlendStateCreateInfo(attachmentState);
+    colorBlendInfo.attachmentCount = 0;
+    colorBlendInfo.pAttachments = nullptr;
+    const auto multisampleInfo = vkStructs::MultisampleStateCreateInfo();
+    const auto depthStencilInfo = vkStructs::DepthStencilStateCreateInfo();
+    const std::vector<VkDynamicState> vecDynamicStates{VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    const auto dynamicInfo = vkStructs::DynamicStateCreateInfo(vecDynamicStates);
+    const auto viewportInfo = vkStructs::ViewportCreateInfo(1, 1);
+
+    // Only binds the uniform set, which the scene's layout starts with
+    const auto pipelineInfo = vkStructs::GraphicsPipelineCreateInfo(
+        vecShaderStages, vertexInputInfo, inputAssemblyInfo, tessellationInfo, viewportInfo, rasterizationInfo,
+        multisampleInfo, depthStencilInfo, colorBlendInfo, dynamicInfo, m_pipelineLayout, m_depthPrepassRenderPass);
+    if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, CHostAllocator::GetCallbacks(),
+                                  &m_depthPrepassPipeline) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create depth pre-pass pipeline.");
+
+    vkDestroyShaderModule(m_device, vertModule, CHostAllocator::GetCallbacks());
 }
 
-void CDevice::CreateCommandPool()
+void CDevice::CreateCommandPools(uint32_t recordingThreadCount)
 {
-    VkCommandPoolCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    createInfo.queueFamilyIndex = *mp_instance->QueueFamilies().GraphicsFamily();
-    createInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-
-    if (vkCreateCommandPool(m_device, &createInfo, nullptr, &m_commandPool) != VK_SUCCESS)
-        throw std::runtime_error("Failed to create command pool.");
+    mp_commandPoolManager = std::make_unique<CCommandPoolManager>(*mp_instance->QueueFamilies().GraphicsFamily(),
+                                                                  m_framesInFlight, recordingThreadCount);
 }
 
-void CDevice::CreateCommandBuffers()
+void CDevice::CreateUploadContext()
 {
-    // Allocate command buffers
-    m_commandBuffers.resize(m_swapchainImages.size());
+    const auto queueFamilies = mp_instance->QueueFamilies();
+    mp_uploadContext = std::make_unique<CUploadContext>(kUploadStagingSize, *queueFamilies.TransferFamily(),
+                                                        queueFamilies.graphicsFamilyIndex.value());
+}
 
-    VkCommandBufferAllocateInfo allocateInfo{};
-    allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocateInfo.commandPool = m_commandPool;
-    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocateInfo.commandBufferCount = static_cast<uint32_t>(m_commandBuffers.size());
+void CDevice::CreateGeometryArena()
+{
+    mp_geometryArena = std::make_unique<CGeometryArena>(kGeometryArenaVertexCount, kGeometryArenaIndexCount);
+}
 
-    if (vkAllocateCommandBuffers(m_device, &allocateInfo, m_commandBuffers.data()) != VK_SUCCESS)
-        throw std::runtime_error("Failed to allocate command buffer.");
+void CDevice::CreateCommandRecorders()
+{
+    // Command buffers themselves come from the pool manager as frames record
+    mp_commandCache = std::make_unique<CCommandCache>(m_framesInFlight);
+    mp_parallelRecorder =
+        std::make_unique<CParallelRecorder>(m_framesInFlight, mp_commandPoolManager->GetThreadCount());
 }
 
 void CDevice::CreateDescriptorPool()
 {
     std::array<VkDescriptorPoolSize, 2> pools{};
 
-    pools[0].descriptorCount = static_cast<uint32_t>(m_swapchainImages.size());
-    pools[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    // The uniform ring shared by every object and the camera latch, a set per frame slot
+    pools[0].descriptorCount = 2 * m_framesInFlight;
+    pools[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 
-    pools[1].descriptorCount = static_cast<uint32_t>(m_swapchainImages.size());
+    // The upscale pass replaces its set on every resize, the old ones live until the frames using them completed
+    const auto upscaleDescriptorSets = m_framesInFlight + 1;
+    pools[1].descriptorCount = kMaxTextureDescriptorSets + upscaleDescriptorSets;
     pools[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 
     VkDescriptorPoolCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    createInfo.maxSets = static_cast<uint32_t>(m_swapchainImages.size()) * 128;
+    // Texture sets are replaced when the defragmenter moves their image
+    createInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+    createInfo.maxSets = kMaxTextureDescriptorSets + upscaleDescriptorSets + m_framesInFlight;
     createInfo.poolSizeCount = pools.size();
     createInfo.pPoolSizes = pools.data();
 
-    if (vkCreateDescriptorPool(m_device, &createInfo, nullptr, &m_descriptorPool) != VK_SUCCESS)
+    if (vkCreateDescriptorPool(m_device, &createInfo, CHostAllocator::GetCallbacks(), &m_descriptorPool) != VK_SUCCESS)
         throw std::runtime_error("Failed to create descriptor pool");
 }
 
 void CDevice::CreateDescriptorSetLayout()
 {
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
-    bindings[0].descriptorCount = 1;
-    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    bindings[0].binding = 0;
-
-    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    bindings[1].descriptorCount = 1;
-    bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-    bindings[1].binding = 1;
-
+    // Set 0: per-object uniforms, bound with a dynamic offset into the uniform ring
+    VkDescriptorSetLayoutBinding uniformBinding{};
+    uniformBinding.descriptorCount = 1;
+    uniformBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    uniformBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    uniformBinding.binding = 0;
+
+    // Set 0 binding 1: the camera, bound with the dynamic offset of the frame's latch region
+    VkDescriptorSetLayoutBinding cameraBinding = uniformBinding;
+    cameraBinding.binding = 1;
+
+    std::array<VkDescriptorSetLayoutBinding, 2> uniformBindings{uniformBinding, cameraBinding};
     VkDescriptorSetLayoutCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    createInfo.bindingCount = bindings.size();
-    createInfo.pBindings = bindings.data();
+    createInfo.bindingCount = uniformBindings.size();
+    createInfo.pBindings = uniformBindings.data();
+
+    if (vkCreateDescriptorSetLayout(m_device, &createInfo, CHostAllocator::GetCallbacks(),
+                                    &m_uniformDescriptorLayout) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create uniform descriptor set layout.");
+
+    // Set 1: per-object texture
+    VkDescriptorSetLayoutBinding textureBinding{};
+    textureBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    textureBinding.descriptorCount = 1;
+    textureBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    textureBinding.binding = 0;
+
+    createInfo.bindingCount = 1;
+    createInfo.pBindings = &textureBinding;
+
+    if (vkCreateDescriptorSetLayout(m_device, &createInfo, CHostAllocator::GetCallbacks(),
+                                    &m_textureDescriptorLayout) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create texture descriptor set layout.");
+}
+
+void CDevice::CreateUniformRing()
+{
+    mp_uniformRing = std::make_unique<CUniformRing>(m_framesInFlight, kUniformRingFrameSize);
+
+    // A set per frame slot, so growing the ring only rewrites sets whose frames have completed or aren't recorded yet
+    const std::vector<VkDescriptorSetLayout> vecLayouts(m_framesInFlight, m_uniformDescriptorLayout);
+    VkDescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.descriptorPool = m_descriptorPool;
+    allocateInfo.descriptorSetCount = m_framesInFlight;
+    allocateInfo.pSetLayouts = vecLayouts.data();
+    m_vecUniformDescriptorSets.resize(m_framesInFlight);
+    if (vkAllocateDescriptorSets(m_device, &allocateInfo, m_vecUniformDescriptorSets.data()) != VK_SUCCESS)
+        throw std::runtime_error("Failed to allocate uniform descriptor sets.");
+
+    m_vecUniformSetGenerations.resize(m_framesInFlight);
+    for (auto frameIndex = 0u; frameIndex != m_framesInFlight; ++frameIndex)
+        WriteUniformDescriptorSet(frameIndex);
+}
+
+void CDevice::WriteUniformDescriptorSet(uint32_t frameIndex)
+{
+    // The ranges cover one object's uniforms and one camera, the dynamic offsets pick the object and the frame's
+    // latch region. The ring binding starts at the frame's region, pushed offsets are relative to it.
+    std::array<VkDescriptorBufferInfo, 2> bufferInfos{};
+    bufferInfos[0].buffer = mp_uniformRing->GetBuffer();
+    bufferInfos[0].offset = mp_uniformRing->GetFrameOffset(frameIndex);
+    bufferInfos[0].range = sizeof(vkPrimitives::SModelUniform);
+    bufferInfos[1].buffer = mp_cameraLatch->GetBuffer();
+    bufferInfos[1].offset = 0;
+    bufferInfos[1].range = sizeof(vkPrimitives::SCameraUniform);
+
+    VkWriteDescriptorSet writeDescriptorSet{};
+    writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    // Both bindings are identical apart from the buffer, the write rolls over from binding 0 into binding 1
+    writeDescriptorSet.descriptorCount = bufferInfos.size();
+    writeDescriptorSet.dstSet = m_vecUniformDescriptorSets[frameIndex];
+    writeDescriptorSet.dstBinding = 0;
+    writeDescriptorSet.dstArrayElement = 0;
+    writeDescriptorSet.pBufferInfo = bufferInfos.data();
+
+    vkUpdateDescriptorSets(m_device, 1, &writeDescriptorSet, 0, nullptr);
+    m_vecUniformSetGenerations[frameIndex] = mp_uniformRing->GetGeneration();
+}
+
+void CDevice::CreateCameraLatch()
+{
+    mp_cameraLatch = std::make_unique<CCameraLatch>(m_framesInFlight);
+}
 
-    if (vkCreateDescriptorSetLayout(m_device, &createInfo, nullptr, &m_descriptorLayout) != VK_SUCCESS)
-        throw std::runtime_error("Failed to create descriptor set layout.");
+std::array<uint32_t, 2> CDevice::GetUniformDynamicOffsets(uint32_t uniformOffset) const
+{
+    return {uniformOffset, mp_cameraLatch->GetOffset(m_currentFrameIndex)};
 }
 
 uint32_t CDevice::FindMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags flags)
@@ -681,38 +1098,127 @@ void CDevice::CreateSemaphores()
 {
     VkSemaphoreCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-    if (vkCreateSemaphore(m_device, &createInfo, nullptr, &m_semaphoreRenderComplete) != VK_SUCCESS ||
-        vkCreateSemaphore(m_device, &createInfo, nullptr, &m_semaphorePresentComplete) != VK_SUCCESS)
-        throw std::runtime_error("Failed to create semaphores.");
+    m_vecImageAcquiredSemaphores.resize(m_framesInFlight);
+    for (auto &semaphore : m_vecImageAcquiredSemaphores)
+    {
+        if (vkCreateSemaphore(m_device, &createInfo, CHostAllocator::GetCallbacks(), &semaphore) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create semaphores.");
+    }
 }
 
-void CDevice::CreateFences()
+void CDevice::CreatePresentSemaphores()
 {
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    VkSemaphoreCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    m_vecRenderCompleteSemaphores.resize(m_swapchainImages.size());
+    for (auto &semaphore : m_vecRenderCompleteSemaphores)
+    {
+        if (vkCreateSemaphore(m_device, &createInfo, CHostAllocator::GetCallbacks(), &semaphore) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create present semaphores.");
+    }
+}
 
-    m_fences.resize(m_swapchainImages.size());
-    for (auto &fence : m_fences)
+void CDevice::PollCompletedFrames()
+{
+    for (auto index = 0u; index != m_framesInFlight; ++index)
     {
-        if (vkCreateFence(m_device, &fenceInfo, nullptr, &fence) != VK_SUCCESS)
-            throw std::runtime_error("Failed to create fences.");
+        if (mp_framePacer->IsFramePending(index) &&
+            mp_timelineSync->IsReached({ETimelineQueue::Graphics, m_vecFrameTimelineValues[index]}))
+            mp_framePacer->OnFrameCompleted(index);
     }
 }
 
+void CDevice::WaitForSubmittedFrames()
+{
+    // Oldest first, a frame never completes before the ones submitted ahead of it
+    std::vector<uint32_t> vecPending;
+    for (auto index = 0u; index != m_framesInFlight; ++index)
+    {
+        if (mp_framePacer->IsFramePending(index))
+            vecPending.push_back(index);
+    }
+    std::sort(vecPending.begin(), vecPending.end(), [this](uint32_t lhs, uint32_t rhs) {
+        return m_vecFrameTimelineValues[lhs] < m_vecFrameTimelineValues[rhs];
+    });
+
+    for (const auto index : vecPending)
+    {
+        mp_timelineSync->Wait({ETimelineQueue::Graphics, m_vecFrameTimelineValues[index]});
+        mp_framePacer->OnFrameCompleted(index);
+    }
+}
+
+void CDevice::SetViewportAndScissor(VkCommandBuffer cmdBuffer) const
+{
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(m_renderExtent.width);
+    viewport.height = static_cast<float>(m_renderExtent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+
+    VkRect2D scissors = {};
+    scissors.extent = m_renderExtent;
+    scissors.offset = {0, 0};
+    vkCmdSetScissor(cmdBuffer, 0, 1, &scissors);
+}
+
+void CDevice::DeferDestroy(std::function<void()> &&deleter)
+{
+    // The next submitted frame is ordered after every earlier frame and every upload recorded so far
+    mp_deletionQueue->Push(std::move(deleter));
+}
+
+void CDevice::InvalidateCommandCache()
+{
+    mp_commandCache->Invalidate();
+}
+
+void CDevice::SetCommandCaching(bool isCommandCaching)
+{
+    m_isCommandCaching = isCommandCaching;
+    mp_commandCache->Invalidate();
+}
+
+void CDevice::SetDepthPrepass(bool isDepthPrepass)
+{
+    // Cached scene draws bind the pipeline of the depth test they were recorded for
+    m_isDepthPrepass = isDepthPrepass;
+    mp_commandCache->Invalidate();
+}
+
+void CDevice::SetParallelRecording(bool isParallelRecording)
+{
+    // A cached scene only replays the buffers of the mode it was recorded in
+    m_isParallelRecording = isParallelRecording;
+    mp_commandCache->Invalidate();
+}
+
 void CDevice::Cleanup()
 {
-    for (auto &fence : m_fences)
+    vkDeviceWaitIdle(m_device);
+    mp_deletionQueue->Flush();
+
+    for (auto &semaphore : m_vecImageAcquiredSemaphores)
     {
-        vkDestroyFence(m_device, fence, nullptr);
+        vkDestroySemaphore(m_device, semaphore, CHostAllocator::GetCallbacks());
     }
-    vkDestroySemaphore(m_device, m_semaphoreRenderComplete, nullptr);
-    vkDestroySemaphore(m_device, m_semaphorePresentComplete, nullptr);
 
-    vkDestroyDescriptorSetLayout(m_device, m_descriptorLayout, nullptr);
-    vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_uniformDescriptorLayout, CHostAllocator::GetCallbacks());
+    vkDestroyDescriptorSetLayout(m_device, m_textureDescriptorLayout, CHostAllocator::GetCallbacks());
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, CHostAllocator::GetCallbacks());
 
+    mp_uploadContext->Cleanup();
     CleanupSwapchain();
-    vkDestroyCommandPool(m_device, m_commandPool, nullptr);
-    vkDestroyDevice(m_device, nullptr);
+    mp_parallelRecorder->Cleanup();
+    mp_commandPoolManager->Cleanup();
+    mp_dynamicResolution->Cleanup();
+    mp_timelineSync->Cleanup();
+    mp_uniformRing->Cleanup();
+    mp_cameraLatch->Cleanup();
+    mp_geometryArena->Cleanup();
+    mp_bufferImageManager->Cleanup();
+    vkDestroyDevice(m_device, CHostAllocator::GetCallbacks());
 }
\ No newline at end of file
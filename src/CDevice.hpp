@@ -1,12 +1,42 @@
 #pragma once
 
 #include "CInstance.hpp"
+#include "CRenderGraph.hpp"
 #include "CWindow.hpp"
 #include "appInfo.hpp"
+#include <array>
+#include <functional>
+#include <memory>
 #include <vector>
 #include <vulkan/vulkan.h>
 
 class CBufferImageManager;
+class CCameraLatch;
+class CCommandCache;
+class CCommandPoolManager;
+class CDefragmenter;
+class CDeletionQueue;
+class CDynamicResolution;
+class CFramePacer;
+class CGeometryArena;
+class CParallelRecorder;
+class CTimelineSync;
+class CUniformRing;
+class CUploadContext;
+class CUpscalePass;
+struct SImageHandles;
+
+// A compiled variant of the frame's render graph, see CDevice::CreateRenderGraph
+struct SFrameGraph
+{
+    std::unique_ptr<CRenderGraph> pGraph;
+    // The swapchain or offscreen image the frame renders into
+    SGraphImage backbufferImage;
+    // The scene before upscaling, only its top left m_renderExtent is rendered. Invalid when the scene renders
+    // straight into the backbuffer.
+    SGraphImage sceneColorImage;
+};
+
 class CDevice
 {
   public:
@@ -32,6 +62,11 @@ class CDevice
         return m_presentQueue;
     }
 
+    const VkQueue GetTransferQueue() const
+    {
+        return m_transferQueue;
+    }
+
     const VkSwapchainKHR GetSwapchain() const
     {
         return m_swapchain;
@@ -47,9 +82,14 @@ class CDevice
         return m_pipelineLayout;
     }
 
-    const VkCommandPool GetCommandPool() const
+    CCommandPoolManager &GetCommandPoolManager() const
+    {
+        return *mp_commandPoolManager;
+    }
+
+    CTimelineSync &GetTimelineSync() const
     {
-        return m_commandPool;
+        return *mp_timelineSync;
     }
 
     const VkDescriptorPool GetDescriptorPool() const
@@ -57,39 +97,170 @@ class CDevice
         return m_descriptorPool;
     }
 
-    const VkDescriptorSetLayout GetDescriptorSetLayout() const
+    const VkDescriptorSetLayout GetUniformDescriptorSetLayout() const
+    {
+        return m_uniformDescriptorLayout;
+    }
+
+    const VkDescriptorSetLayout GetTextureDescriptorSetLayout() const
+    {
+        return m_textureDescriptorLayout;
+    }
+
+    // The current frame slot's set
+    const VkDescriptorSet GetUniformDescriptorSet() const
+    {
+        return m_vecUniformDescriptorSets[m_currentFrameIndex];
+    }
+
+    CUniformRing &GetUniformRing() const
+    {
+        return *mp_uniformRing;
+    }
+
+    CCameraLatch &GetCameraLatch() const
+    {
+        return *mp_cameraLatch;
+    }
+
+    // Offsets for binding the uniform set: the object's uniforms in the ring, then the camera of the current frame
+    std::array<uint32_t, 2> GetUniformDynamicOffsets(uint32_t uniformOffset) const;
+
+    CUploadContext &GetUploadContext() const
+    {
+        return *mp_uploadContext;
+    }
+
+    CGeometryArena &GetGeometryArena() const
+    {
+        return *mp_geometryArena;
+    }
+
+    CDefragmenter &GetDefragmenter() const
+    {
+        return *mp_defragmenter;
+    }
+
+    CFramePacer &GetFramePacer() const
     {
-        return m_descriptorLayout;
+        return *mp_framePacer;
     }
 
+    CCommandCache &GetCommandCache() const
+    {
+        return *mp_commandCache;
+    }
+
+    CParallelRecorder &GetParallelRecorder() const
+    {
+        return *mp_parallelRecorder;
+    }
+
+    CDynamicResolution &GetDynamicResolution() const
+    {
+        return *mp_dynamicResolution;
+    }
+
+    // Records the scene into secondary command buffers once and replays them, see CCommandCache. Applies from the
+    // next DrawBegin.
+    void SetCommandCaching(bool isCommandCaching);
+    bool IsCommandCaching() const
+    {
+        return m_isCommandCaching;
+    }
+
+    // Records RecordParallel's draws on several threads, see CParallelRecorder. Applies from the next DrawBegin.
+    void SetParallelRecording(bool isParallelRecording);
+    bool IsParallelRecording() const
+    {
+        return m_isParallelRecording;
+    }
+
+    // Lays down the depth of the opaque objects in a position-only pass first, the scene pass then only shades the
+    // visible fragments with an EQUAL depth test and no depth writes. Applies from the next DrawBegin.
+    void SetDepthPrepass(bool isDepthPrepass);
+    bool IsDepthPrepass() const
+    {
+        return m_isDepthPrepass;
+    }
+
+    // Called whenever something the scene's draws bake in changes: objects come or go or replace descriptor sets
+    void InvalidateCommandCache();
+
+    // The mode the swapchain was created with, may differ from the one requested from the frame pacer
+    VkPresentModeKHR GetPresentMode() const
+    {
+        return m_presentMode;
+    }
+
+    // Where draws record, with command caching a secondary buffer of the scene or the overlay
     const VkCommandBuffer GetCurrentCommandBuffer() const
     {
         return m_currentCommandBuffer;
     }
 
+    // The render graph's scene pass, every scene pipeline and secondary command buffer is made for it. The scene
+    // passes of the other graph variants are compatible with it.
     const VkRenderPass GetRenderPass() const
     {
         return m_renderPass;
     }
 
+    // The pass that upscales the scene into the backbuffer, the overlay is drawn on top at native resolution. The
+    // overlay pass of the variants without upscaling is compatible with it.
+    const VkRenderPass GetOverlayRenderPass() const
+    {
+        return m_overlayRenderPass;
+    }
+
+    // The graph the frames currently render with
+    const CRenderGraph &GetRenderGraph() const
+    {
+        return *m_frameGraphs[m_frameGraphIndex].pGraph;
+    }
+
     uint32_t GetCurrentImageIndex() const
     {
         return m_currentImageIndex;
     }
 
+    // Selects the per-frame resources, cycles through GetFramesInFlight() rather than the swapchain images
+    uint32_t GetCurrentFrameIndex() const
+    {
+        return m_currentFrameIndex;
+    }
+
+    uint32_t GetFramesInFlight() const
+    {
+        return m_framesInFlight;
+    }
+
     VkExtent2D GetExtent() const
     {
         return m_extent;
     }
 
+    // Part of the extent the scene renders into this frame, see CDynamicResolution
+    VkExtent2D GetRenderExtent() const
+    {
+        return m_renderExtent;
+    }
+
     const CBufferImageManager &GetBufferImageManager() const
     {
         return *mp_bufferImageManager;
     }
 
+    // Null when headless
     GLFWwindow *GetWindow() const
     {
-        return mp_window->Window();
+        return mp_window ? mp_window->Window() : nullptr;
+    }
+
+    // Renders into offscreen images instead of a swapchain, see SAppInfo::isHeadless
+    bool IsHeadless() const
+    {
+        return m_isHeadless;
     }
 
     const CInstance *GetVulkanInstance() const
@@ -98,8 +269,32 @@ class CDevice
     }
 
     void InitDevice(CWindow *window, CInstance *vkInstance, CBufferImageManager *bufferImageManager, SAppInfo appInfo);
+    // Uniforms are pushed in between, DrawEnd records the render graph and with it the scene and the overlay
     bool DrawBegin();
     bool DrawEnd();
+    // Records the scene's draws into the main pass, skipped when the frame replays an earlier recording. Called from
+    // DrawEnd, after the frame's uniforms were pushed.
+    void SetSceneRecorder(std::function<void()> &&sceneRecorder);
+    // Records draws that change every frame on top of the upscaled scene, never cached
+    void SetOverlayRecorder(std::function<void()> &&overlayRecorder);
+    // Records the opaque objects' depth-only draws into the pre-pass, inline every frame. Only called while the
+    // pre-pass is on, after BindDepthState.
+    void SetDepthRecorder(std::function<void()> &&depthRecorder);
+    // Records draws [0, drawCount) of the scene, on several threads when parallel recording is on and into the
+    // current command buffer otherwise. The draws execute before the ones recorded into the current command buffer.
+    void RecordParallel(uint32_t drawCount, const std::function<void(VkCommandBuffer, uint32_t)> &drawFunction);
+    // Pipeline, viewport, scissor and geometry every scene draw expects, thread safe
+    void BindSceneState(VkCommandBuffer cmdBuffer) const;
+    // Pipeline, viewport, scissor and position stream of the depth pre-pass's draws
+    void BindDepthState(VkCommandBuffer cmdBuffer) const;
+    // Blocks until every submitted frame has finished, called before the app idles so the frame latency measurement
+    // doesn't include the idle time
+    void WaitForSubmittedFrames();
+    // Viewport and scissor of the scene's render extent. They are dynamic in every pipeline, draws after something that
+    // changed them set them again.
+    void SetViewportAndScissor(VkCommandBuffer cmdBuffer) const;
+    // Destroys GPU resources once every frame that may still reference them has completed, never idles the device
+    void DeferDestroy(std::function<void()> &&deleter);
     void Cleanup();
 
     uint32_t FindMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags flags);
@@ -108,31 +303,62 @@ class CDevice
     void CreateDevice(SAppInfo appInfo);
     // Queue creation
     void CreateQueues();
+    void CreateTimelineSync();
     // Swapchain creation
     VkSurfaceFormatKHR GetOptimalSurfaceFormat();
     VkPresentModeKHR GetOptimalPresentMode();
     VkExtent2D GetOptimalExtent2D();
-    void CreateSwapchain();
+    void CreateSwapchain(VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE);
     void RecreateSwapchain();
     void CleanupSwapchain();
     bool ShouldRecreateSwapchain();
     // Image creation
     void CreateSwapchainImages();
-    void CreateDepthImage();
+    void CreateOffscreenImages();
     // ImageView creation
     void CreateImageViews();
     void CreatePipelineLayout();
-    void CreateRenderPass();
+    // Passes and images of a frame, the graph's render passes replace a hand-written one
+    void CreateRenderGraph();
+    // The scene upscaled from SceneColor or rendered straight into the backbuffer, with or without the depth pre-pass
+    void CreateFrameGraph(bool isUpscaling, bool isDepthPrepass);
+    static uint32_t GetFrameGraphIndex(bool isUpscaling, bool isDepthPrepass)
+    {
+        return (isUpscaling ? 2 : 0) + (isDepthPrepass ? 1 : 0);
+    }
+    // Sized to the swapchain, recreated with it and when the frames switch between the variants. Only the variant in
+    // use holds images.
+    void CreateRenderGraphResources();
+    // Below the full extent, or while the scale may change, the scene renders into its own target and is upscaled
+    bool IsUpscaleNeeded(VkExtent2D renderExtent) const;
     void CreateGraphicsPipeline();
-    // Framebuffer creation
-    void CreateFramebuffers();
+    void CreateDepthPrepassPipeline();
     // Command pool and buffer creation
-    void CreateCommandPool();
-    void CreateCommandBuffers();
+    void CreateCommandPools(uint32_t recordingThreadCount);
+    void CreateUploadContext();
+    void CreateGeometryArena();
+    void CreateCommandRecorders();
     void CreateDescriptorPool();
     void CreateDescriptorSetLayout();
+    void CreateUniformRing();
+    void WriteUniformDescriptorSet(uint32_t frameIndex);
+    void CreateCameraLatch();
     void CreateSemaphores();
-    void CreateFences();
+    void CreatePresentSemaphores();
+    void PollCompletedFrames();
+    // The scene pass's contents. BeginScene returns false when the frame replays an earlier recording, the scene's
+    // draws are skipped then.
+    void RecordScenePass();
+    bool BeginScene();
+    void EndScene();
+    void RecordDepthPrepass();
+    void RecordUpscalePass(VkCommandBuffer cmdBuffer);
+    void RecordOverlayPass();
+    // The scene goes into secondary command buffers when it is cached or recorded in parallel
+    bool IsFrameInSecondaries() const
+    {
+        return m_isFrameCached || m_isFrameParallel;
+    }
 
     VkFormat FindDepthFormat(std::vector<VkFormat> formats, VkImageTiling tiling, VkFormatFeatureFlags flags);
 
@@ -142,29 +368,73 @@ class CDevice
     CBufferImageManager *mp_bufferImageManager;
 
     VkCommandBuffer m_currentCommandBuffer;
+    VkCommandBuffer m_primaryCommandBuffer;
     uint32_t m_currentImageIndex;
+    uint32_t m_currentFrameIndex = 0;
+    uint32_t m_framesInFlight = 2;
+    bool m_isHeadless = false;
+    bool m_isCommandCaching = false;
+    bool m_isFrameCached = false;
+    bool m_isParallelRecording = false;
+    bool m_isFrameParallel = false;
+    bool m_isDepthPrepass = false;
+    bool m_isFrameDepthPrepass = false;
 
     VkDevice m_device = VK_NULL_HANDLE;
     VkQueue m_graphicsQueue = VK_NULL_HANDLE;
     VkQueue m_presentQueue = VK_NULL_HANDLE;
+    VkQueue m_transferQueue = VK_NULL_HANDLE;
+    std::unique_ptr<CTimelineSync> mp_timelineSync;
     VkFormat m_format;
+    VkPresentModeKHR m_presentMode = VK_PRESENT_MODE_FIFO_KHR;
     VkExtent2D m_extent;
     VkSwapchainKHR m_swapchain = VK_NULL_HANDLE;
+    // Either the swapchain's images or the offscreen ring's
     std::vector<VkImage> m_swapchainImages;
+    std::vector<SImageHandles> m_vecOffscreenImages;
     std::vector<VkImageView> m_imageViews;
-    VkImage m_depthImage;
-    VkImageView m_depthImageView;
-    VkDeviceMemory m_depthImageMemory;
+    // Every combination of upscaling and depth pre-pass, compiled up front so switching only moves the images
+    std::array<SFrameGraph, 4> m_frameGraphs;
+    uint32_t m_frameGraphIndex = 0;
+    bool m_isUpscaling = false;
+    VkExtent2D m_renderExtent{};
+    std::unique_ptr<CDynamicResolution> mp_dynamicResolution;
+    std::unique_ptr<CUpscalePass> mp_upscalePass;
+    std::function<void()> m_sceneRecorder;
+    std::function<void()> m_overlayRecorder;
+    std::function<void()> m_depthRecorder;
     VkFormat m_depthFormat;
     VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    // Owned by the render graph
     VkRenderPass m_renderPass = VK_NULL_HANDLE;
+    VkRenderPass m_overlayRenderPass = VK_NULL_HANDLE;
+    VkRenderPass m_depthPrepassRenderPass = VK_NULL_HANDLE;
     VkPipeline m_graphicsPipeline = VK_NULL_HANDLE;
-    std::vector<VkFramebuffer> m_framebuffers;
-    VkCommandPool m_commandPool = VK_NULL_HANDLE;
-    std::vector<VkCommandBuffer> m_commandBuffers;
+    // Same as m_graphicsPipeline but tests for EQUAL depth without writing it, used behind the depth pre-pass
+    VkPipeline m_depthEqualPipeline = VK_NULL_HANDLE;
+    VkPipeline m_depthPrepassPipeline = VK_NULL_HANDLE;
+    std::unique_ptr<CCommandPoolManager> mp_commandPoolManager;
     VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
-    VkDescriptorSetLayout m_descriptorLayout = VK_NULL_HANDLE;
-    VkSemaphore m_semaphoreRenderComplete = VK_NULL_HANDLE;
-    VkSemaphore m_semaphorePresentComplete = VK_NULL_HANDLE;
-    std::vector<VkFence> m_fences;
+    VkDescriptorSetLayout m_uniformDescriptorLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_textureDescriptorLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> m_vecUniformDescriptorSets;
+    // Uniform ring generation each slot's set was written for
+    std::vector<uint32_t> m_vecUniformSetGenerations;
+    std::unique_ptr<CUniformRing> mp_uniformRing;
+    std::unique_ptr<CCameraLatch> mp_cameraLatch;
+    std::unique_ptr<CUploadContext> mp_uploadContext;
+    std::unique_ptr<CGeometryArena> mp_geometryArena;
+    // Transfer timeline value of the uploads the current frame acquires
+    uint64_t m_uploadWaitValue = 0;
+    // Per frame in flight, like the command buffers
+    std::vector<VkSemaphore> m_vecImageAcquiredSemaphores;
+    // Per swapchain image, an image is only acquired again once its previous present has consumed the semaphore
+    std::vector<VkSemaphore> m_vecRenderCompleteSemaphores;
+    // Graphics timeline value each frame slot's last submission signals
+    std::vector<uint64_t> m_vecFrameTimelineValues;
+    std::unique_ptr<CDeletionQueue> mp_deletionQueue;
+    std::unique_ptr<CDefragmenter> mp_defragmenter;
+    std::unique_ptr<CFramePacer> mp_framePacer;
+    std::unique_ptr<CCommandCache> mp_commandCache;
+    std::unique_ptr<CParallelRecorder> mp_parallelRecorder;
 };
@@ -0,0 +1,175 @@
+#include "CDynamicResolution.hpp"
+#include "CDevice.hpp"
+#include "CHostAllocator.hpp"
+#include "vkStructs.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+// Steps of the applied scale, a few per cent of the pixels each
+constexpr float kScaleStep = 0.05f;
+// Below this a scaled scene is hardly recognisable
+constexpr float kMinScaleBound = 0.25f;
+// Keeps a near-empty frame from asking for an absurd scale
+constexpr double kMinMeasuredMs = 0.1;
+constexpr double kSmoothingFactor = 0.05;
+} // namespace
+
+CDynamicResolution::CDynamicResolution(uint32_t frameCount, bool isEnabled, double targetFrameMs)
+    : m_vecIsTimed(frameCount, false), m_isEnabled(isEnabled), m_targetFrameMs(targetFrameMs)
+{
+    const auto &deviceInstance = CDevice::GetInstance();
+    const auto physicalDevice = deviceInstance.GetVulkanInstance()->PhysicalDevice();
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> vecQueueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, vecQueueFamilies.data());
+    const auto graphicsFamilyIndex = deviceInstance.GetVulkanInstance()->QueueFamilies().graphicsFamilyIndex.value();
+    const auto validBits = vecQueueFamilies[graphicsFamilyIndex].timestampValidBits;
+    if (validBits == 0)
+    {
+        fprintf(stderr, "Dynamic resolution: the graphics queue has no timestamps, rendering at full scale\n");
+        return;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    m_timestampPeriod = properties.limits.timestampPeriod;
+    m_timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    VkQueryPoolCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    createInfo.queryCount = 2 * frameCount;
+    VK_CHECK_RESULT(
+        vkCreateQueryPool(deviceInstance.GetDevice(), &createInfo, CHostAllocator::GetCallbacks(), &m_queryPool))
+}
+
+void CDynamicResolution::SetEnabled(bool isEnabled)
+{
+    m_isEnabled = isEnabled;
+    if (!m_isEnabled)
+        m_scale = m_maxScale;
+    ApplyScale();
+}
+
+void CDynamicResolution::SetTargetFrameMs(double targetFrameMs)
+{
+    const auto clampedMs = std::max(targetFrameMs, kMinMeasuredMs);
+    if (clampedMs == m_targetFrameMs)
+        return;
+
+    m_targetFrameMs = clampedMs;
+    LogSettings();
+}
+
+void CDynamicResolution::SetScaleBounds(float minScale, float maxScale)
+{
+    const auto clampedMax = std::clamp(maxScale, kMinScaleBound, 1.0f);
+    const auto clampedMin = std::clamp(minScale, kMinScaleBound, clampedMax);
+    if (clampedMin == m_minScale && clampedMax == m_maxScale)
+        return;
+
+    m_maxScale = clampedMax;
+    m_minScale = clampedMin;
+    m_scale = m_isEnabled ? std::clamp(m_scale, m_minScale, m_maxScale) : m_maxScale;
+    LogSettings();
+    ApplyScale();
+}
+
+void CDynamicResolution::SetReactionSpeed(float reactionSpeed)
+{
+    const auto clampedSpeed = std::clamp(reactionSpeed, 0.01f, 1.0f);
+    if (clampedSpeed == m_reactionSpeed)
+        return;
+
+    m_reactionSpeed = clampedSpeed;
+    LogSettings();
+}
+
+VkExtent2D CDynamicResolution::GetRenderExtent(VkExtent2D extent) const
+{
+    const auto scale = [this](uint32_t size) {
+        return std::clamp(static_cast<uint32_t>(std::lround(size * m_appliedScale)), 1u, size);
+    };
+    return {scale(extent.width), scale(extent.height)};
+}
+
+void CDynamicResolution::BeginFrame(VkCommandBuffer cmdBuffer, uint32_t frameIndex)
+{
+    if (!IsTimingSupported())
+        return;
+
+    const auto firstQuery = 2 * frameIndex;
+    if (m_vecIsTimed[frameIndex])
+    {
+        // The slot's frame completed, the results are available without waiting
+        std::array<uint64_t, 2> timestamps{};
+        const auto res = vkGetQueryPoolResults(CDevice::GetInstance().GetDevice(), m_queryPool, firstQuery, 2,
+                                               sizeof(timestamps), timestamps.data(), sizeof(uint64_t),
+                                               VK_QUERY_RESULT_64_BIT);
+        if (res == VK_SUCCESS)
+        {
+            const auto ticks = (timestamps[1] - timestamps[0]) & m_timestampMask;
+            Update(ticks * m_timestampPeriod / 1e6);
+        }
+        m_vecIsTimed[frameIndex] = false;
+    }
+
+    vkCmdResetQueryPool(cmdBuffer, m_queryPool, firstQuery, 2);
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, firstQuery);
+}
+
+void CDynamicResolution::EndFrame(VkCommandBuffer cmdBuffer, uint32_t frameIndex)
+{
+    if (!IsTimingSupported())
+        return;
+
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, 2 * frameIndex + 1);
+    m_vecIsTimed[frameIndex] = true;
+}
+
+void CDynamicResolution::Cleanup()
+{
+    vkDestroyQueryPool(CDevice::GetInstance().GetDevice(), m_queryPool, CHostAllocator::GetCallbacks());
+    m_queryPool = VK_NULL_HANDLE;
+}
+
+void CDynamicResolution::Update(double gpuFrameMs)
+{
+    m_statistics.gpuFrameMs = gpuFrameMs;
+    m_statistics.smoothedGpuFrameMs =
+        m_statistics.smoothedGpuFrameMs == 0.0
+            ? gpuFrameMs
+            : m_statistics.smoothedGpuFrameMs + (gpuFrameMs - m_statistics.smoothedGpuFrameMs) * kSmoothingFactor;
+    if (!m_isEnabled)
+        return;
+
+    // GPU time follows the shaded pixels, the square root turns the time ratio into a per-axis scale
+    const auto idealScale =
+        m_scale * static_cast<float>(std::sqrt(m_targetFrameMs / std::max(gpuFrameMs, kMinMeasuredMs)));
+    m_scale = std::clamp(m_scale + (idealScale - m_scale) * m_reactionSpeed, m_minScale, m_maxScale);
+    ApplyScale();
+}
+
+void CDynamicResolution::ApplyScale()
+{
+    const auto steppedScale =
+        std::clamp(std::round(m_scale / kScaleStep) * kScaleStep, m_minScale, m_maxScale);
+    if (steppedScale == m_appliedScale)
+        return;
+
+    m_appliedScale = steppedScale;
+    ++m_statistics.scaleChanges;
+    fprintf(stdout, "Dynamic resolution: scale %.2f, GPU frame %.2f ms (avg %.2f) for a target of %.2f ms\n",
+            m_appliedScale, m_statistics.gpuFrameMs, m_statistics.smoothedGpuFrameMs, m_targetFrameMs);
+}
+
+void CDynamicResolution::LogSettings() const
+{
+    fprintf(stdout, "Dynamic resolution: scale bounds [%.2f, %.2f], reaction speed %.2f, target %.2f ms\n", m_minScale,
+            m_maxScale, m_reactionSpeed, m_targetFrameMs);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+struct SDynamicResolutionStatistics
+{
+    // From the first to the last command of the latest measured frame
+    double gpuFrameMs = 0.0;
+    double smoothedGpuFrameMs = 0.0;
+    // How often the applied scale stepped, each step re-records cached scene command buffers
+    uint64_t scaleChanges = 0;
+};
+
+// Scales the scene's render area to keep the GPU frame time at a target. Every frame slot writes a timestamp at the
+// start and end of its command buffer, the pair is read back once the slot's timeline value is reached, so the
+// controller reacts a frame ring late. The scale is per axis and GPU time is taken to follow the shaded pixels, so
+// each measurement pulls the scale towards scale * sqrt(target / measured), by the reaction speed. The applied scale
+// moves in fixed steps so small fluctuations don't change the viewport, which cached command buffers bake in.
+// Without timestamp support on the graphics queue, or while disabled, the scene renders at the maximum scale.
+// While enabled, or with a maximum scale below 1, CDevice renders the scene into an intermediate target and upscales
+// it into the backbuffer with an extra fullscreen pass. Otherwise the scene goes straight into the backbuffer.
+class CDynamicResolution
+{
+  public:
+    CDynamicResolution(uint32_t frameCount, bool isEnabled, double targetFrameMs);
+
+    void SetEnabled(bool isEnabled);
+    bool IsEnabled() const
+    {
+        return m_isEnabled;
+    }
+    bool IsTimingSupported() const
+    {
+        return m_queryPool != VK_NULL_HANDLE;
+    }
+
+    void SetTargetFrameMs(double targetFrameMs);
+    double GetTargetFrameMs() const
+    {
+        return m_targetFrameMs;
+    }
+    // Clamped to (0, 1], the scene's images are allocated at the full extent
+    void SetScaleBounds(float minScale, float maxScale);
+    float GetMinScale() const
+    {
+        return m_minScale;
+    }
+    float GetMaxScale() const
+    {
+        return m_maxScale;
+    }
+    // Fraction of the correction applied per measured frame, in (0, 1]
+    void SetReactionSpeed(float reactionSpeed);
+    float GetReactionSpeed() const
+    {
+        return m_reactionSpeed;
+    }
+
+    // The applied, stepped scale
+    float GetScale() const
+    {
+        return m_appliedScale;
+    }
+    // Part of extent the scene renders into, never empty
+    VkExtent2D GetRenderExtent(VkExtent2D extent) const;
+
+    // After the slot's previous frame completed and its command buffer began, reads that frame's time and starts timing
+    // this one
+    void BeginFrame(VkCommandBuffer cmdBuffer, uint32_t frameIndex);
+    // Before the command buffer ends
+    void EndFrame(VkCommandBuffer cmdBuffer, uint32_t frameIndex);
+
+    const SDynamicResolutionStatistics &GetStatistics() const
+    {
+        return m_statistics;
+    }
+
+    // The device must be idle
+    void Cleanup();
+
+  private:
+    void Update(double gpuFrameMs);
+    void ApplyScale();
+    // Each setter logs the controller's settings when it changes one of them
+    void LogSettings() const;
+
+    VkQueryPool m_queryPool = VK_NULL_HANDLE;
+    // Nanoseconds per timestamp tick
+    double m_timestampPeriod = 1.0;
+    uint64_t m_timestampMask = ~0ull;
+    // Per frame slot, whether its queries were written by a submitted frame
+    std::vector<bool> m_vecIsTimed;
+
+    bool m_isEnabled = false;
+    double m_targetFrameMs = 0.0;
+    float m_minScale = 0.5f;
+    float m_maxScale = 1.0f;
+    float m_reactionSpeed = 0.1f;
+    // Continuous controller output, m_appliedScale follows it in steps
+    float m_scale = 1.0f;
+    float m_appliedScale = 1.0f;
+    SDynamicResolutionStatistics m_statistics{};
+};
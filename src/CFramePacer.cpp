@@ -0,0 +1,165 @@
+#include "CFramePacer.hpp"
+#include <algorithm>
+#include <thread>
+
+namespace
+{
+// The scheduler wakes sleeping threads up to about a millisecond late, the last stretch is spun
+constexpr auto kSpinThreshold = std::chrono::microseconds(2000);
+// Longest sleep between two completion polls while the limiter waits
+constexpr auto kPollInterval = std::chrono::microseconds(500);
+constexpr double kSmoothingFactor = 0.05;
+// ImGui needs a few frames after input until hover and active states settle
+constexpr uint32_t kGuiSettleFrames = 3;
+// Counts skipped frames until the app reports the display's rate
+constexpr double kDefaultRefreshRate = 60.0;
+
+double ToMilliseconds(CFramePacer::Clock::duration duration)
+{
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+void Smooth(double &smoothed, double value)
+{
+    smoothed = smoothed == 0.0 ? value : smoothed + (value - smoothed) * kSmoothingFactor;
+}
+} // namespace
+
+CFramePacer::CFramePacer(uint32_t framesInFlight, VkPresentModeKHR presentMode, double maxFrameRate)
+    : m_requestedPresentMode(presentMode), m_animationTick(Clock::now()), m_vecSubmitTimes(framesInFlight)
+{
+    SetMaxFrameRate(maxFrameRate);
+    SetRefreshRate(kDefaultRefreshRate);
+}
+
+void CFramePacer::SetPresentMode(VkPresentModeKHR presentMode)
+{
+    if (presentMode == m_requestedPresentMode)
+        return;
+    m_requestedPresentMode = presentMode;
+    m_isPresentModeChanged = true;
+}
+
+bool CFramePacer::ConsumePresentModeChange()
+{
+    const auto isChanged = m_isPresentModeChanged;
+    m_isPresentModeChanged = false;
+    return isChanged;
+}
+
+void CFramePacer::SetMaxFrameRate(double maxFrameRate)
+{
+    m_maxFrameRate = maxFrameRate > 0.0 ? maxFrameRate : 0.0;
+    m_frameInterval = m_maxFrameRate > 0.0 ? std::chrono::duration_cast<Clock::duration>(
+                                                 std::chrono::duration<double>(1.0 / m_maxFrameRate))
+                                           : Clock::duration::zero();
+    m_frameDeadline = {};
+}
+
+void CFramePacer::SetRenderOnDemand(bool isRenderOnDemand)
+{
+    m_isRenderOnDemand = isRenderOnDemand;
+    MarkDirty(EFrameDirty::Gui);
+}
+
+void CFramePacer::SetRefreshRate(double refreshRate)
+{
+    m_refreshInterval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / (refreshRate > 0.0 ? refreshRate : kDefaultRefreshRate)));
+}
+
+void CFramePacer::SetAnimating(bool isAnimating)
+{
+    // The clock resumes from where it stopped, the paused time is skipped
+    if (isAnimating && !m_isAnimating)
+        m_animationTick = Clock::now();
+    m_isAnimating = isAnimating;
+    MarkDirty(EFrameDirty::Scene);
+}
+
+void CFramePacer::MarkDirty(EFrameDirty reason)
+{
+    m_pendingRedraws = std::max(m_pendingRedraws, reason == EFrameDirty::Gui ? kGuiSettleFrames : 1u);
+}
+
+bool CFramePacer::ShouldRender()
+{
+    const auto now = Clock::now();
+    if (m_isIdle)
+    {
+        // Waiting for events wakes up rarely, the frames the idle time would have held are what was skipped
+        const auto interval = m_frameInterval != Clock::duration::zero() ? m_frameInterval : m_refreshInterval;
+        m_skippedFrames += std::chrono::duration<double>(now - m_lastRenderCheck) / interval;
+        m_onDemandStatistics.skippedFrames = static_cast<uint64_t>(m_skippedFrames);
+    }
+    m_lastRenderCheck = now;
+
+    m_isIdle = !IsRedrawNeeded();
+    if (m_isIdle)
+    {
+        ++m_onDemandStatistics.idleWakeups;
+        return false;
+    }
+
+    if (m_pendingRedraws != 0)
+        --m_pendingRedraws;
+    ++m_onDemandStatistics.renderedFrames;
+    return true;
+}
+
+void CFramePacer::BeginFrame(const std::function<void()> &pollCompletions)
+{
+    pollCompletions();
+    const auto waitStart = Clock::now();
+    auto now = waitStart;
+    if (m_frameInterval != Clock::duration::zero() && m_frameDeadline != Clock::time_point{})
+    {
+        while (now < m_frameDeadline)
+        {
+            const auto remaining = m_frameDeadline - now;
+            if (remaining > kSpinThreshold)
+                std::this_thread::sleep_for(std::min<Clock::duration>(remaining - kSpinThreshold, kPollInterval));
+            else
+                std::this_thread::yield();
+            // A frame finishing during the wait would otherwise only be seen after it, its latency would read as
+            // about the frame interval
+            pollCompletions();
+            now = Clock::now();
+        }
+    }
+
+    // Deadlines follow each other so short overshoots don't accumulate, after a long stall the cadence restarts
+    if (m_frameDeadline == Clock::time_point{} || now - m_frameDeadline > m_frameInterval)
+        m_frameDeadline = now + m_frameInterval;
+    else
+        m_frameDeadline += m_frameInterval;
+
+    m_frameStart = now;
+    if (m_isAnimating)
+        m_animationTime += std::chrono::duration<double>(now - m_animationTick).count();
+    m_animationTick = now;
+    m_lastTiming.limiterWaitMs = ToMilliseconds(now - waitStart);
+    Smooth(m_smoothedTiming.limiterWaitMs, m_lastTiming.limiterWaitMs);
+}
+
+void CFramePacer::OnSubmit(uint32_t frameIndex)
+{
+    m_vecSubmitTimes[frameIndex] = Clock::now();
+}
+
+void CFramePacer::OnFrameCompleted(uint32_t frameIndex)
+{
+    auto &submitTime = m_vecSubmitTimes[frameIndex];
+    if (submitTime == Clock::time_point{})
+        return;
+
+    m_lastTiming.submitToCompleteMs = ToMilliseconds(Clock::now() - submitTime);
+    Smooth(m_smoothedTiming.submitToCompleteMs, m_lastTiming.submitToCompleteMs);
+    submitTime = {};
+}
+
+void CFramePacer::EndFrame()
+{
+    m_lastTiming.cpuFrameMs = ToMilliseconds(Clock::now() - m_frameStart);
+    Smooth(m_smoothedTiming.cpuFrameMs, m_lastTiming.cpuFrameMs);
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Why a frame has to be drawn in render-on-demand mode
+enum class EFrameDirty
+{
+    Scene,
+    Camera,
+    Gui,
+    Window
+};
+
+struct SOnDemandStatistics
+{
+    uint64_t renderedFrames = 0;
+    // Frames not drawn while idle: the idle time in frame intervals at the frame rate cap, or at the display's
+    // refresh rate without one
+    uint64_t skippedFrames = 0;
+    // Loop iterations that woke up without anything to draw
+    uint64_t idleWakeups = 0;
+};
+
+struct SFrameTiming
+{
+    // Recording and submitting, from the end of the limiter wait until the present call returned
+    double cpuFrameMs = 0.0;
+    // Time the limiter held the frame back
+    double limiterWaitMs = 0.0;
+    // From vkQueueSubmit until the frame's timeline value was seen reached, the GPU finished rendering it by then.
+    // Presentation comes later still, the swapchain doesn't report it.
+    double submitToCompleteMs = 0.0;
+};
+
+// Decides when frames start and how they are presented. The present mode is only a request, CDevice falls back to
+// FIFO when the surface doesn't support it. The limiter sleeps most of the frame interval and spins the rest since OS
+// sleeps overshoot by up to a scheduler tick. Latency is measured per frame slot from submission until its graphics
+// timeline value is seen reached. BeginFrame has completions polled before and throughout the limiter wait, so with a
+// frame rate cap the measurement is off by at most a poll interval rather than the frame interval, without one by at
+// most the CPU frame.
+// In render-on-demand mode frames are only drawn while something is dirty or an animation runs, the app waits for
+// events in between. Paused animations freeze the animation clock objects animate with.
+class CFramePacer
+{
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    CFramePacer(uint32_t framesInFlight, VkPresentModeKHR presentMode, double maxFrameRate);
+
+    void SetPresentMode(VkPresentModeKHR presentMode);
+    VkPresentModeKHR GetRequestedPresentMode() const
+    {
+        return m_requestedPresentMode;
+    }
+    // True once after the requested mode changed, the swapchain has to be recreated for it to apply
+    bool ConsumePresentModeChange();
+
+    // 0 disables the limiter
+    void SetMaxFrameRate(double maxFrameRate);
+    double GetMaxFrameRate() const
+    {
+        return m_maxFrameRate;
+    }
+
+    void SetRenderOnDemand(bool isRenderOnDemand);
+    bool IsRenderOnDemand() const
+    {
+        return m_isRenderOnDemand;
+    }
+    // Interval skipped frames are counted in while no frame rate cap is set, 60 Hz until set
+    void SetRefreshRate(double refreshRate);
+    void SetAnimating(bool isAnimating);
+    bool IsAnimating() const
+    {
+        return m_isAnimating;
+    }
+    // Seconds of animation, only advances while animating
+    float GetAnimationTime() const
+    {
+        return static_cast<float>(m_animationTime);
+    }
+
+    void MarkDirty(EFrameDirty reason);
+    // False when the app may block until the next event
+    bool IsRedrawNeeded() const
+    {
+        return !m_isRenderOnDemand || m_isAnimating || m_pendingRedraws != 0;
+    }
+    // Decides whether this loop iteration draws and consumes one pending redraw, counts the frames skipped while the
+    // loop waited since the previous call
+    bool ShouldRender();
+    const SOnDemandStatistics &GetOnDemandStatistics() const
+    {
+        return m_onDemandStatistics;
+    }
+
+    // Blocks until the next frame may start, calls pollCompletions before and while it waits so frames that finish in
+    // the meantime are reported through OnFrameCompleted when they do
+    void BeginFrame(const std::function<void()> &pollCompletions);
+    void OnSubmit(uint32_t frameIndex);
+    // Only the first report after a submission of the slot counts
+    void OnFrameCompleted(uint32_t frameIndex);
+    void EndFrame();
+
+    bool IsFramePending(uint32_t frameIndex) const
+    {
+        return m_vecSubmitTimes[frameIndex] != Clock::time_point{};
+    }
+
+    // Values of the latest frame, the latency is the one of the latest completed frame
+    const SFrameTiming &GetLastTiming() const
+    {
+        return m_lastTiming;
+    }
+    // Exponentially smoothed over roughly the last few dozen frames
+    const SFrameTiming &GetSmoothedTiming() const
+    {
+        return m_smoothedTiming;
+    }
+
+  private:
+    VkPresentModeKHR m_requestedPresentMode;
+    bool m_isPresentModeChanged = false;
+
+    double m_maxFrameRate = 0.0;
+    Clock::duration m_frameInterval{};
+    Clock::time_point m_frameDeadline{};
+    Clock::time_point m_frameStart{};
+
+    bool m_isRenderOnDemand = false;
+    bool m_isAnimating = true;
+    double m_animationTime = 0.0;
+    Clock::time_point m_animationTick{};
+    uint32_t m_pendingRedraws = 0;
+    SOnDemandStatistics m_onDemandStatistics{};
+    Clock::duration m_refreshInterval{};
+    // Whether the previous ShouldRender skipped, the time since then was spent idle
+    bool m_isIdle = false;
+    Clock::time_point m_lastRenderCheck{};
+    // Fractional skipped frames, skippedFrames is its integer part
+    double m_skippedFrames = 0.0;
+
+    // Per frame in flight, empty while nothing is pending in the slot
+    std::vector<Clock::time_point> m_vecSubmitTimes;
+
+    SFrameTiming m_lastTiming{};
+    SFrameTiming m_smoothedTiming{};
+};
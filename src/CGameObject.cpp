@@ -1,7 +1,11 @@
 #include "CGameObject.hpp"
+#include "CDefragmenter.hpp"
+#include "CFramePacer.hpp"
+#include "CHostAllocator.hpp"
 #include "CImageLoader.hpp"
 #include "CModelLoader.hpp"
-#include <chrono>
+#include "CUniformRing.hpp"
+#include "CUploadContext.hpp"
 #include <glm/gtc/matrix_transform.hpp>
 
 CGameObject::CGameObject(SModelProps modelProps) : m_modelProps(modelProps)
@@ -9,171 +13,76 @@ CGameObject::CGameObject(SModelProps modelProps) : m_modelProps(modelProps)
     mp_deviceInstance = &CDevice::GetInstance();
     m_mesh = CModelLoader::LoadObjModel(modelProps.objectFile);
 
-    CreateVertexBuffer();
-    CreateIndexBuffer();
-    CreateUniformBuffers();
+    m_meshRange = mp_deviceInstance->GetGeometryArena().Allocate(m_mesh);
     CreateTextureImage();
     CreateTextureSampler();
     CreateDescriptorSets();
+    mp_deviceInstance->InvalidateCommandCache();
 }
 
 void CGameObject::UpdateUniformBuffers()
 {
-    static auto startTime = std::chrono::high_resolution_clock::now();
+    // Stands still while animations are paused
+    const auto time = mp_deviceInstance->GetFramePacer().GetAnimationTime();
 
-    const auto currentTime = std::chrono::high_resolution_clock::now();
-    const auto time = std::chrono::duration<float, std::chrono::seconds ::period>(currentTime - startTime).count();
+    m_modelUniform.model = glm::translate(glm::mat4(1.0f), m_modelProps.modelTransform.translate);
+    m_modelUniform.model = glm::scale(m_modelUniform.model, m_modelProps.modelTransform.scale);
+    m_modelUniform.model = glm::rotate(m_modelUniform.model, time * glm::radians(10.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    // View and projection are latched by the device right before submit
 
-    m_mvp.model = glm::translate(glm::mat4(1.0f), m_modelProps.modelTransform.translate);
-    m_mvp.model = glm::scale(m_mvp.model, m_modelProps.modelTransform.scale);
-    m_mvp.model = glm::rotate(m_mvp.model, time * glm::radians(10.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    m_mvp.view = glm::lookAt(glm::vec3(10.0f, 0.01f, 10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    m_mvp.projection = glm::perspective(
-        glm::radians(45.0f),
-        mp_deviceInstance->GetExtent().width / static_cast<float>(mp_deviceInstance->GetExtent().height), 0.1f, 100.0f);
-    //    m_mvp.projection = glm::ortho(-2.0f, 2.0f, 2.0f, -2.0f, 0.1f, 10.0f);
-    m_mvp.projection[1][1] *= -1;
-
-    void *data;
-    vkMapMemory(mp_deviceInstance->GetDevice(),
-                m_vecUniformBufferHandles[mp_deviceInstance->GetCurrentImageIndex()].memory, 0, sizeof(m_mvp), 0,
-                &data);
-    memcpy(data, &m_mvp, sizeof(m_mvp));
-    vkUnmapMemory(mp_deviceInstance->GetDevice(),
-                  m_vecUniformBufferHandles[mp_deviceInstance->GetCurrentImageIndex()].memory);
-}
-
-void CGameObject::Draw() const
-{
-    VkCommandBuffer cmdBuffer = mp_deviceInstance->GetCurrentCommandBuffer();
-
-    VkDeviceSize offsets = {0};
-    vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &m_vertexBufferHandles.buffer, &offsets);
-
-    vkCmdBindIndexBuffer(cmdBuffer, m_indexBufferHandles.buffer, 0, VK_INDEX_TYPE_UINT16);
-
-    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mp_deviceInstance->GetPipelineLayout(), 0, 1,
-                            &m_vecDescriptorSets[mp_deviceInstance->GetCurrentImageIndex()], 0, nullptr);
-
-    vkCmdDrawIndexed(cmdBuffer, static_cast<uint32_t>(m_mesh.indices.size()), 1, 0, 0, 0);
-}
-
-void CGameObject::CreateVertexBuffer()
-{
-    SBufferHandles stagingHandles{};
-    VkBufferCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    createInfo.size = GetVerticesSize();
-    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    createInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    mp_deviceInstance->GetBufferImageManager().CreateBuffer(
-        createInfo, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, stagingHandles);
-
-    mp_deviceInstance->GetBufferImageManager().MapMemory(stagingHandles, 0, GetVerticesSize(), m_mesh.vertices.data());
-
-    // Create the vertex buffer and copy the staged buffer to it
-    createInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-    mp_deviceInstance->GetBufferImageManager().CreateBuffer(createInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                            m_vertexBufferHandles);
-
-    VkBufferCopy regions{};
-    regions.size = GetVerticesSize();
-    mp_deviceInstance->GetBufferImageManager().CopyBuffer(stagingHandles.buffer, regions, m_vertexBufferHandles.buffer);
-
-    // Destroy the staging buffer
-    mp_deviceInstance->GetBufferImageManager().DestroyBufferHandles(stagingHandles);
+    m_uniformOffset = mp_deviceInstance->GetUniformRing().Push(&m_modelUniform, sizeof(m_modelUniform));
 }
 
-void CGameObject::CreateIndexBuffer()
+void CGameObject::Draw(VkCommandBuffer cmdBuffer) const
 {
-    SBufferHandles stagingHandles{};
-    VkBufferCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    createInfo.size = GetVerticesSize();
-    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    createInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    mp_deviceInstance->GetBufferImageManager().CreateBuffer(
-        createInfo, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, stagingHandles);
-
-    mp_deviceInstance->GetBufferImageManager().MapMemory(stagingHandles, 0, GetIndicesSize(), m_mesh.indices.data());
-
-    // Create the vertex buffer and copy the staged buffer to it
-    createInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-    mp_deviceInstance->GetBufferImageManager().CreateBuffer(createInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                            m_indexBufferHandles);
+    std::array<VkDescriptorSet, 2> descriptorSets{mp_deviceInstance->GetUniformDescriptorSet(), m_textureDescriptorSet};
+    const auto dynamicOffsets = mp_deviceInstance->GetUniformDynamicOffsets(m_uniformOffset);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mp_deviceInstance->GetPipelineLayout(), 0,
+                            descriptorSets.size(), descriptorSets.data(), dynamicOffsets.size(),
+                            dynamicOffsets.data());
 
-    VkBufferCopy regions{};
-    regions.size = GetIndicesSize();
-    mp_deviceInstance->GetBufferImageManager().CopyBuffer(stagingHandles.buffer, regions, m_indexBufferHandles.buffer);
-
-    // Destroy the staging buffer
-    mp_deviceInstance->GetBufferImageManager().DestroyBufferHandles(stagingHandles);
+    vkCmdDrawIndexed(cmdBuffer, m_meshRange.indexCount, 1, m_meshRange.firstIndex, m_meshRange.vertexOffset, 0);
 }
 
-void CGameObject::CreateUniformBuffers()
+void CGameObject::DrawDepth(VkCommandBuffer cmdBuffer) const
 {
-    m_vecUniformBufferHandles.resize(mp_deviceInstance->GetSwapchainImageCount());
+    // The position stream shares the mesh's vertex range, only the uniforms are needed
+    const auto uniformDescriptorSet = mp_deviceInstance->GetUniformDescriptorSet();
+    const auto dynamicOffsets = mp_deviceInstance->GetUniformDynamicOffsets(m_uniformOffset);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mp_deviceInstance->GetPipelineLayout(), 0, 1,
+                            &uniformDescriptorSet, dynamicOffsets.size(), dynamicOffsets.data());
 
-    for (auto &handle : m_vecUniformBufferHandles)
-    {
-        VkBufferCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        createInfo.size = GetUniformSize();
-        createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        createInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-        mp_deviceInstance->GetBufferImageManager().CreateBuffer(
-            createInfo, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, handle);
-    }
+    vkCmdDrawIndexed(cmdBuffer, m_meshRange.indexCount, 1, m_meshRange.firstIndex, m_meshRange.vertexOffset, 0);
 }
 
 void CGameObject::CreateDescriptorSets()
 {
-    m_vecDescriptorSets.resize(mp_deviceInstance->GetSwapchainImageCount());
-
-    std::vector<VkDescriptorSetLayout> layouts(mp_deviceInstance->GetSwapchainImageCount(),
-                                               mp_deviceInstance->GetDescriptorSetLayout());
+    const auto layout = mp_deviceInstance->GetTextureDescriptorSetLayout();
     VkDescriptorSetAllocateInfo allocateInfo{};
     allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocateInfo.descriptorPool = mp_deviceInstance->GetDescriptorPool();
-    allocateInfo.descriptorSetCount = layouts.size();
-    allocateInfo.pSetLayouts = layouts.data();
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &layout;
     if (const auto res =
-            vkAllocateDescriptorSets(mp_deviceInstance->GetDevice(), &allocateInfo, m_vecDescriptorSets.data());
+            vkAllocateDescriptorSets(mp_deviceInstance->GetDevice(), &allocateInfo, &m_textureDescriptorSet);
         res != VK_SUCCESS)
         throw std::runtime_error("Failed to create descriptor set.");
 
-    for (auto i = 0; i != m_vecDescriptorSets.size(); ++i)
-    {
-        VkDescriptorBufferInfo mvpInfo{};
-        mvpInfo.buffer = m_vecUniformBufferHandles[i].buffer;
-        mvpInfo.range = GetUniformSize();
-        mvpInfo.offset = 0;
-
-        VkDescriptorImageInfo texInfo{};
-        texInfo.imageView = m_textureImageHandles.imageView;
-        texInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        texInfo.sampler = m_textureSampler;
-
-        std::array<VkWriteDescriptorSet, 2> writeDescriptorSets{};
-        writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        writeDescriptorSets[0].descriptorCount = 1;
-        writeDescriptorSets[0].dstSet = m_vecDescriptorSets[i];
-        writeDescriptorSets[0].dstBinding = 0;
-        writeDescriptorSets[0].dstArrayElement = 0;
-        writeDescriptorSets[0].pBufferInfo = &mvpInfo;
-
-        writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        writeDescriptorSets[1].descriptorCount = 1;
-        writeDescriptorSets[1].dstSet = m_vecDescriptorSets[i];
-        writeDescriptorSets[1].dstBinding = 1;
-        writeDescriptorSets[1].dstArrayElement = 0;
-        writeDescriptorSets[1].pImageInfo = &texInfo;
-
-        vkUpdateDescriptorSets(mp_deviceInstance->GetDevice(), writeDescriptorSets.size(), writeDescriptorSets.data(),
-                               0, nullptr);
-    }
+    VkDescriptorImageInfo texInfo{};
+    texInfo.imageView = m_textureImageHandles.imageView;
+    texInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    texInfo.sampler = m_textureSampler;
+
+    VkWriteDescriptorSet writeDescriptorSet{};
+    writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writeDescriptorSet.descriptorCount = 1;
+    writeDescriptorSet.dstSet = m_textureDescriptorSet;
+    writeDescriptorSet.dstBinding = 0;
+    writeDescriptorSet.dstArrayElement = 0;
+    writeDescriptorSet.pImageInfo = &texInfo;
+
+    vkUpdateDescriptorSets(mp_deviceInstance->GetDevice(), 1, &writeDescriptorSet, 0, nullptr);
 }
 
 void CGameObject::CreateTextureImage()
@@ -181,18 +90,6 @@ void CGameObject::CreateTextureImage()
     int width, height, channels;
     const auto imageData = CImageLoader::Load2DImage(m_modelProps.textureFile, width, height, channels);
     const auto imageSize = width * height * 4;
-    // Stage image to buffer
-    SBufferHandles stagingHandles{};
-    VkBufferCreateInfo stagingInfo{};
-    stagingInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    stagingInfo.size = imageSize;
-    stagingInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    stagingInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    mp_deviceInstance->GetBufferImageManager().CreateBuffer(
-        stagingInfo, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, stagingHandles);
-
-    mp_deviceInstance->GetBufferImageManager().MapMemory(stagingHandles, 0, imageSize, imageData);
-
     VkImageCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     createInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -204,32 +101,21 @@ void CGameObject::CreateTextureImage()
     createInfo.arrayLayers = 1;
     createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    createInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    createInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
     createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     createInfo.queueFamilyIndexCount = 1;
     createInfo.pQueueFamilyIndices = mp_deviceInstance->GetVulkanInstance()->QueueFamilies().GraphicsFamily();
     createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
     mp_deviceInstance->GetBufferImageManager().CreateImage(createInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                           m_textureImageHandles);
-
-    // Copy the buffer to image
-    VkImageSubresourceLayers layers{};
-    layers.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    layers.mipLevel = 0;
-    layers.baseArrayLayer = 0;
-    layers.layerCount = 1;
+                                                           m_textureImageHandles, EMemoryCategory::Texture);
 
-    VkBufferImageCopy copyRegions{};
-    copyRegions.imageExtent.width = width;
-    copyRegions.imageExtent.height = height;
-    copyRegions.imageExtent.depth = 1;
-    copyRegions.imageSubresource = layers;
-    mp_deviceInstance->GetBufferImageManager().CopyBufferToImage(stagingHandles.buffer, copyRegions,
-                                                                 m_textureImageHandles.image);
+    const VkExtent3D extent{static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1};
+    mp_deviceInstance->GetUploadContext().UploadImage(imageData, imageSize, m_textureImageHandles.image, extent);
+    m_textureDefragmentId = mp_deviceInstance->GetDefragmenter().RegisterImage(m_textureImageHandles, createInfo,
+                                                                               [this]() { OnTextureMoved(); });
 
     CImageLoader::FreeImage(imageData);
-    mp_deviceInstance->GetBufferImageManager().DestroyBufferHandles(stagingHandles);
 }
 
 void CGameObject::CreateTextureSampler()
@@ -252,19 +138,43 @@ void CGameObject::CreateTextureSampler()
     createInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
     createInfo.unnormalizedCoordinates = VK_FALSE;
 
-    if (const auto res = vkCreateSampler(mp_deviceInstance->GetDevice(), &createInfo, nullptr, &m_textureSampler);
+    if (const auto res = vkCreateSampler(mp_deviceInstance->GetDevice(), &createInfo, CHostAllocator::GetCallbacks(),
+                                         &m_textureSampler);
         res != VK_SUCCESS)
         throw std::runtime_error("Failed to create sampler.");
 }
 
+void CGameObject::OnTextureMoved()
+{
+    // Frames in flight still bind the old set, so it is replaced rather than updated in place
+    mp_deviceInstance->DeferDestroy([textureDescriptorSet = m_textureDescriptorSet]() {
+        auto &deviceInstance = CDevice::GetInstance();
+        vkFreeDescriptorSets(deviceInstance.GetDevice(), deviceInstance.GetDescriptorPool(), 1,
+                             &textureDescriptorSet);
+    });
+    CreateDescriptorSets();
+    // Cached recordings still bind the old set
+    mp_deviceInstance->InvalidateCommandCache();
+}
+
 void CGameObject::ObjectCleanup()
 {
-    mp_deviceInstance->GetBufferImageManager().DestroyBufferHandles(m_vertexBufferHandles);
-    mp_deviceInstance->GetBufferImageManager().DestroyBufferHandles(m_indexBufferHandles);
-    for (auto &handle : m_vecUniformBufferHandles)
-    {
-        mp_deviceInstance->GetBufferImageManager().DestroyBufferHandles(handle);
-    }
-    vkDestroySampler(mp_deviceInstance->GetDevice(), m_textureSampler, nullptr);
-    mp_deviceInstance->GetBufferImageManager().DestroyImagesHandles(m_textureImageHandles);
+    mp_deviceInstance->GetDefragmenter().Unregister(m_textureDefragmentId);
+
+    // Frames that drew the object may still be in flight
+    mp_deviceInstance->DeferDestroy([meshRange = m_meshRange, textureSampler = m_textureSampler,
+                                     textureImageHandles = m_textureImageHandles,
+                                     textureDescriptorSet = m_textureDescriptorSet]() mutable {
+        auto &deviceInstance = CDevice::GetInstance();
+        deviceInstance.GetGeometryArena().Free(meshRange);
+        vkFreeDescriptorSets(deviceInstance.GetDevice(), deviceInstance.GetDescriptorPool(), 1,
+                             &textureDescriptorSet);
+        vkDestroySampler(deviceInstance.GetDevice(), textureSampler, CHostAllocator::GetCallbacks());
+        deviceInstance.GetBufferImageManager().DestroyImagesHandles(textureImageHandles);
+    });
+    m_meshRange = {};
+    m_textureSampler = VK_NULL_HANDLE;
+    m_textureImageHandles = {};
+    m_textureDescriptorSet = VK_NULL_HANDLE;
+    mp_deviceInstance->InvalidateCommandCache();
 }
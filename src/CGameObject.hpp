@@ -1,5 +1,6 @@
 #pragma once
 #include "CBufferImageManager.hpp"
+#include "CGeometryArena.hpp"
 #include "CDevice.hpp"
 #include "CObject.hpp"
 #include "vkPrimitives.hpp"
@@ -23,7 +24,9 @@ class CGameObject : public CObject
     explicit CGameObject(SModelProps modelProps);
 
     void UpdateUniformBuffers() override;
-    void Draw() const override;
+    void Draw(VkCommandBuffer cmdBuffer) const override;
+    // Into the depth pre-pass, after CDevice::BindDepthState
+    void DrawDepth(VkCommandBuffer cmdBuffer) const;
     void ObjectCleanup() override;
 
     uint32_t GetVerticesSize() const
@@ -36,26 +39,25 @@ class CGameObject : public CObject
     }
     uint32_t GetUniformSize() const
     {
-        return static_cast<uint32_t>(sizeof(m_mvp));
+        return static_cast<uint32_t>(sizeof(m_modelUniform));
     }
   private:
-    void CreateVertexBuffer();
-    void CreateIndexBuffer();
-    void CreateUniformBuffers();
     void CreateDescriptorSets();
     void CreateTextureImage();
     void CreateTextureSampler();
+    void OnTextureMoved();
 
     CDevice *mp_deviceInstance;
 
-    SBufferHandles m_vertexBufferHandles{};
-    SBufferHandles m_indexBufferHandles{};
-    std::vector<SBufferHandles> m_vecUniformBufferHandles{};
-    std::vector<VkDescriptorSet> m_vecDescriptorSets;
+    SMeshRange m_meshRange{};
+    // Offset of this frame's uniforms in the device's uniform ring
+    uint32_t m_uniformOffset = 0;
+    VkDescriptorSet m_textureDescriptorSet = VK_NULL_HANDLE;
     SImageHandles m_textureImageHandles{};
+    uint32_t m_textureDefragmentId = 0;
     VkSampler m_textureSampler;
 
     vkTools::vkPrimitives::SMesh m_mesh;
-    vkTools::vkPrimitives::SMVP m_mvp{};
+    vkTools::vkPrimitives::SModelUniform m_modelUniform{};
     SModelProps m_modelProps{};
 };
\ No newline at end of file
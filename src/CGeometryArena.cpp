@@ -0,0 +1,91 @@
+#include "CGeometryArena.hpp"
+#include "CUploadContext.hpp"
+#include <cstdio>
+
+using namespace vkTools;
+
+CGeometryArena::CGeometryArena(uint32_t vertexCapacity, uint32_t indexCapacity)
+    : m_vertexAllocator(vertexCapacity), m_indexAllocator(indexCapacity)
+{
+    VkBufferCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    createInfo.size = sizeof(vkPrimitives::SVertex) * static_cast<VkDeviceSize>(vertexCapacity);
+    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    createInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    CDevice::GetInstance().GetBufferImageManager().CreateDeviceBuffer(createInfo, m_vertexBufferHandles,
+                                                                      EMemoryCategory::Geometry);
+
+    // Shares the vertex ranges, a mesh's positions sit at the same element offset as its vertices
+    createInfo.size = sizeof(glm::vec3) * static_cast<VkDeviceSize>(vertexCapacity);
+    CDevice::GetInstance().GetBufferImageManager().CreateDeviceBuffer(createInfo, m_positionBufferHandles,
+                                                                      EMemoryCategory::Geometry);
+
+    createInfo.size = sizeof(uint16_t) * static_cast<VkDeviceSize>(indexCapacity);
+    createInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    CDevice::GetInstance().GetBufferImageManager().CreateDeviceBuffer(createInfo, m_indexBufferHandles,
+                                                                      EMemoryCategory::Geometry);
+}
+
+SMeshRange CGeometryArena::Allocate(const vkPrimitives::SMesh &mesh)
+{
+    // Ranges are counted in elements, so any offset is correctly aligned for its buffer
+    VkDeviceSize vertexOffset, firstIndex;
+    if (!m_vertexAllocator.Allocate(mesh.vertices.size(), 1, vertexOffset))
+        throw std::runtime_error("Geometry arena is out of vertex space.");
+    if (!m_indexAllocator.Allocate(mesh.indices.size(), 1, firstIndex))
+    {
+        m_vertexAllocator.Free(vertexOffset, mesh.vertices.size());
+        throw std::runtime_error("Geometry arena is out of index space.");
+    }
+
+    SMeshRange range{};
+    range.firstIndex = static_cast<uint32_t>(firstIndex);
+    range.indexCount = static_cast<uint32_t>(mesh.indices.size());
+    range.vertexOffset = static_cast<int32_t>(vertexOffset);
+    range.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+
+    auto &uploadContext = CDevice::GetInstance().GetUploadContext();
+    const auto vertexPath =
+        uploadContext.UploadBuffer(mesh.vertices.data(), sizeof(vkPrimitives::SVertex) * mesh.vertices.size(),
+                                   m_vertexBufferHandles, sizeof(vkPrimitives::SVertex) * vertexOffset);
+    const auto positionPath =
+        uploadContext.UploadBuffer(mesh.positions.data(), sizeof(glm::vec3) * mesh.positions.size(),
+                                   m_positionBufferHandles, sizeof(glm::vec3) * vertexOffset);
+    const auto indexPath = uploadContext.UploadBuffer(mesh.indices.data(), sizeof(uint16_t) * mesh.indices.size(),
+                                                      m_indexBufferHandles, sizeof(uint16_t) * firstIndex);
+    range.uploadPath =
+        vertexPath == EUploadPath::Direct && positionPath == EUploadPath::Direct && indexPath == EUploadPath::Direct
+            ? EUploadPath::Direct
+            : EUploadPath::Staged;
+    fprintf(stdout, "Geometry arena: %u vertices and %u indices uploaded %s\n", range.vertexCount, range.indexCount,
+            range.uploadPath == EUploadPath::Direct ? "directly" : "through the staging ring");
+
+    return range;
+}
+
+void CGeometryArena::Free(const SMeshRange &range)
+{
+    m_vertexAllocator.Free(range.vertexOffset, range.vertexCount);
+    m_indexAllocator.Free(range.firstIndex, range.indexCount);
+}
+
+void CGeometryArena::Bind(VkCommandBuffer cmdBuffer) const
+{
+    VkDeviceSize offsets = {0};
+    vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &m_vertexBufferHandles.buffer, &offsets);
+    vkCmdBindIndexBuffer(cmdBuffer, m_indexBufferHandles.buffer, 0, VK_INDEX_TYPE_UINT16);
+}
+
+void CGeometryArena::BindPositions(VkCommandBuffer cmdBuffer) const
+{
+    VkDeviceSize offsets = {0};
+    vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &m_positionBufferHandles.buffer, &offsets);
+    vkCmdBindIndexBuffer(cmdBuffer, m_indexBufferHandles.buffer, 0, VK_INDEX_TYPE_UINT16);
+}
+
+void CGeometryArena::Cleanup()
+{
+    CDevice::GetInstance().GetBufferImageManager().DestroyBufferHandles(m_vertexBufferHandles);
+    CDevice::GetInstance().GetBufferImageManager().DestroyBufferHandles(m_positionBufferHandles);
+    CDevice::GetInstance().GetBufferImageManager().DestroyBufferHandles(m_indexBufferHandles);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "CBufferImageManager.hpp"
+#include "COffsetAllocator.hpp"
+#include "CUploadContext.hpp"
+#include "vkPrimitives.hpp"
+#include <vulkan/vulkan.h>
+
+// Where a mesh lives inside the arena, in vertices and indices rather than bytes so it maps straight onto
+// vkCmdDrawIndexed
+struct SMeshRange
+{
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    int32_t vertexOffset = 0;
+    uint32_t vertexCount = 0;
+    // Staged when any of the mesh's streams went through the staging ring
+    EUploadPath uploadPath = EUploadPath::Staged;
+};
+
+// One device-local vertex buffer and one index buffer shared by every mesh. Both are bound once and meshes are drawn
+// through their range offsets. A third buffer holds only the positions at the same offsets, so depth-only draws use
+// the same ranges with BindPositions instead of Bind.
+class CGeometryArena
+{
+  public:
+    CGeometryArena(uint32_t vertexCapacity, uint32_t indexCapacity);
+
+    // Reserves a range for the mesh and records its upload, throws when the arena is full
+    SMeshRange Allocate(const vkTools::vkPrimitives::SMesh &mesh);
+    // The range must no longer be referenced by any in-flight frame, see CDevice::DeferDestroy
+    void Free(const SMeshRange &range);
+
+    void Bind(VkCommandBuffer cmdBuffer) const;
+    // Position stream and indices, for pipelines made with SVertex::GetPositionInputBindingDescription
+    void BindPositions(VkCommandBuffer cmdBuffer) const;
+    void Cleanup();
+
+    VkBuffer GetVertexBuffer() const
+    {
+        return m_vertexBufferHandles.buffer;
+    }
+
+    VkBuffer GetIndexBuffer() const
+    {
+        return m_indexBufferHandles.buffer;
+    }
+
+  private:
+    SBufferHandles m_vertexBufferHandles{};
+    SBufferHandles m_positionBufferHandles{};
+    SBufferHandles m_indexBufferHandles{};
+    COffsetAllocator m_vertexAllocator;
+    COffsetAllocator m_indexAllocator;
+};
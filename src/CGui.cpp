@@ -1,5 +1,15 @@
+#include "CBufferImageManager.hpp"
+#include "CCommandPoolManager.hpp"
+#include "CCommandCache.hpp"
+#include "CDefragmenter.hpp"
 #include "CDevice.hpp"
+#include "CDynamicResolution.hpp"
+#include "CFramePacer.hpp"
+#include "CHostAllocator.hpp"
+#include "CParallelRecorder.hpp"
+#include "CUploadContext.hpp"
 #include "vkStructs.hpp"
+#include <algorithm>
 
 using namespace vkTools;
 
@@ -24,27 +34,19 @@ void CGui::InitImGui()
     initInfo.Queue = deviceInstance.GetGraphicsQueue();
     initInfo.DescriptorPool = m_guiPool;
     initInfo.MinImageCount = deviceInstance.GetSwapchainImageCount();
-    initInfo.ImageCount = deviceInstance.GetSwapchainImageCount();
+    // The backend cycles its vertex buffers on its own counter, it needs one per frame in flight
+    initInfo.ImageCount = std::max(deviceInstance.GetSwapchainImageCount(), deviceInstance.GetFramesInFlight());
+    initInfo.Allocator = CHostAllocator::GetCallbacks();
 
-    ImGui_ImplVulkan_Init(&initInfo, deviceInstance.GetRenderPass());
-
-    VkCommandBuffer cmdBuffer;
-    const auto cmdAllocateInfo = vkStructs::CommandBufferAllocateInfo(deviceInstance.GetCommandPool());
-    VK_CHECK_RESULT(vkAllocateCommandBuffers(deviceInstance.GetDevice(), &cmdAllocateInfo, &cmdBuffer))
-
-    const auto cmdBeginInfo = vkStructs::CommandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-    VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuffer, &cmdBeginInfo))
+    // Drawn after the upscale, at native resolution
+    ImGui_ImplVulkan_Init(&initInfo, deviceInstance.GetOverlayRenderPass());
 
+    auto &commandPoolManager = deviceInstance.GetCommandPoolManager();
+    const auto cmdBuffer = commandPoolManager.BeginOneShot();
     ImGui_ImplVulkan_CreateFontsTexture(cmdBuffer);
-
-    VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuffer))
-
-    const auto submitInfo = vkStructs::SubmitInfo(1, cmdBuffer);
-    VK_CHECK_RESULT(vkQueueSubmit(deviceInstance.GetGraphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE))
-
-    vkQueueWaitIdle(deviceInstance.GetGraphicsQueue());
-
-    vkFreeCommandBuffers(deviceInstance.GetDevice(), deviceInstance.GetCommandPool(), 1, &cmdBuffer);
+    commandPoolManager.SubmitOneShot(cmdBuffer);
+    // Only the font upload has to finish, frames already in flight keep running
+    commandPoolManager.WaitOneShots();
 }
 
 void CGui::CreateImGuiDescriptorPool()
@@ -62,7 +64,8 @@ void CGui::CreateImGuiDescriptorPool()
                                                 {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1000}};
     const auto createInfo = vkStructs::DescriptorPoolCreateInfo(1000, poolSizes);
 
-    VK_CHECK_RESULT(vkCreateDescriptorPool(CDevice::GetInstance().GetDevice(), &createInfo, nullptr, &m_guiPool))
+    VK_CHECK_RESULT(vkCreateDescriptorPool(CDevice::GetInstance().GetDevice(), &createInfo,
+                                           CHostAllocator::GetCallbacks(), &m_guiPool))
 }
 
 void CGui::Draw()
@@ -73,13 +76,179 @@ void CGui::Draw()
     ImGui::NewFrame();
 
     ImGui::ShowDemoWindow();
+    DrawMemoryWindow();
+    DrawFramePacingWindow();
+    DrawResolutionWindow();
 
     ImGui::Render();
     ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), CDevice::GetInstance().GetCurrentCommandBuffer());
 }
 
+void CGui::DrawMemoryWindow()
+{
+    constexpr auto kMiB = 1024.0f * 1024.0f;
+    const auto &memoryBudget = CDevice::GetInstance().GetBufferImageManager().GetMemoryBudget();
+
+    ImGui::Begin("Memory");
+    ImGui::Text("Budget: %s", memoryBudget.IsExtensionSupported() ? "VK_EXT_memory_budget" : "estimated");
+    for (auto heapIndex = 0u; heapIndex != memoryBudget.GetHeapCount(); ++heapIndex)
+    {
+        const auto &heapBudget = memoryBudget.GetHeapBudget(heapIndex);
+        ImGui::Text("Heap %u: %.1f / %.1f MiB (ours %.1f MiB)", heapIndex, heapBudget.usage / kMiB,
+                    heapBudget.budget / kMiB, heapBudget.reservedBytes / kMiB);
+        ImGui::ProgressBar(heapBudget.Pressure());
+    }
+    ImGui::Separator();
+    for (auto category = 0u; category != static_cast<uint32_t>(EMemoryCategory::Count); ++category)
+    {
+        const auto memoryCategory = static_cast<EMemoryCategory>(category);
+        ImGui::Text("%s: %.1f MiB", CMemoryBudget::GetCategoryName(memoryCategory),
+                    memoryBudget.GetCategoryUsage(memoryCategory) / kMiB);
+    }
+    ImGui::Separator();
+    auto &defragmenter = CDevice::GetInstance().GetDefragmenter();
+    auto isDefragmenting = defragmenter.IsEnabled();
+    if (ImGui::Checkbox("Defragment", &isDefragmenting))
+        defragmenter.SetEnabled(isDefragmenting);
+    const auto &defragStatistics = defragmenter.GetStatistics();
+    ImGui::Text("Moved: %llu allocations, %.1f MiB", static_cast<unsigned long long>(defragStatistics.allocationsMoved),
+                defragStatistics.bytesMoved / kMiB);
+    ImGui::Text("Reclaimed: %.1f MiB", defragStatistics.bytesReclaimed / kMiB);
+    ImGui::Separator();
+    const auto &uploadStatistics = CDevice::GetInstance().GetUploadContext().GetStatistics();
+    ImGui::Text("Direct uploads: %llu, %.1f MiB", static_cast<unsigned long long>(uploadStatistics.directUploads),
+                uploadStatistics.directBytes / kMiB);
+    ImGui::Text("Staged uploads: %llu, %.1f MiB", static_cast<unsigned long long>(uploadStatistics.stagedUploads),
+                uploadStatistics.stagedBytes / kMiB);
+    ImGui::Separator();
+    const auto &graphStatistics = CDevice::GetInstance().GetRenderGraph().GetStatistics();
+    ImGui::Text("Transient images: %u in %u allocations, %.1f MiB (%.1f MiB unaliased)",
+                graphStatistics.transientImages, graphStatistics.transientAllocations,
+                graphStatistics.transientBytes / kMiB, graphStatistics.unaliasedBytes / kMiB);
+    ImGui::Separator();
+    constexpr auto kKiB = 1024.0f;
+    const auto hostStatistics = CHostAllocator::GetInstance().GetStatistics();
+    for (auto scope = 0u; scope != hostStatistics.scopes.size(); ++scope)
+    {
+        const auto &scopeStatistics = hostStatistics.scopes[scope];
+        ImGui::Text("Host %s: %llu live, %.1f KiB, %llu last frame",
+                    CHostAllocator::GetScopeName(static_cast<VkSystemAllocationScope>(scope)),
+                    static_cast<unsigned long long>(scopeStatistics.liveCount), scopeStatistics.liveBytes / kKiB,
+                    static_cast<unsigned long long>(scopeStatistics.frameCount));
+    }
+    ImGui::Text("Host driver internal: %.1f KiB, arena served %llu last frame", hostStatistics.internalBytes / kKiB,
+                static_cast<unsigned long long>(hostStatistics.frameArenaCount));
+    ImGui::End();
+}
+
+void CGui::DrawFramePacingWindow()
+{
+    auto &deviceInstance = CDevice::GetInstance();
+    auto &framePacer = deviceInstance.GetFramePacer();
+
+    ImGui::Begin("Frame pacing");
+    ImGui::Text("Present mode: %s", GetPresentModeName(deviceInstance.GetPresentMode()));
+    for (const auto presentMode : deviceInstance.GetVulkanInstance()->SwapchainSupport().surfacePresentModes)
+    {
+        if (ImGui::RadioButton(GetPresentModeName(presentMode), framePacer.GetRequestedPresentMode() == presentMode))
+            framePacer.SetPresentMode(presentMode);
+    }
+    auto maxFrameRate = static_cast<float>(framePacer.GetMaxFrameRate());
+    if (ImGui::SliderFloat("Max FPS (0 = off)", &maxFrameRate, 0.0f, 480.0f, "%.0f"))
+        framePacer.SetMaxFrameRate(maxFrameRate);
+    auto isRenderOnDemand = framePacer.IsRenderOnDemand();
+    if (ImGui::Checkbox("Render on demand", &isRenderOnDemand))
+        framePacer.SetRenderOnDemand(isRenderOnDemand);
+    auto isAnimating = framePacer.IsAnimating();
+    if (ImGui::Checkbox("Animate", &isAnimating))
+        framePacer.SetAnimating(isAnimating);
+    const auto &onDemandStatistics = framePacer.GetOnDemandStatistics();
+    ImGui::Text("Rendered %llu, skipped %llu frames, %llu idle wakeups",
+                static_cast<unsigned long long>(onDemandStatistics.renderedFrames),
+                static_cast<unsigned long long>(onDemandStatistics.skippedFrames),
+                static_cast<unsigned long long>(onDemandStatistics.idleWakeups));
+    auto isCommandCaching = deviceInstance.IsCommandCaching();
+    if (ImGui::Checkbox("Cache scene command buffers", &isCommandCaching))
+        deviceInstance.SetCommandCaching(isCommandCaching);
+    auto isParallelRecording = deviceInstance.IsParallelRecording();
+    if (ImGui::Checkbox("Record scene in parallel", &isParallelRecording))
+        deviceInstance.SetParallelRecording(isParallelRecording);
+    ImGui::SameLine();
+    ImGui::Text("(%u threads)", deviceInstance.GetParallelRecorder().GetThreadCount());
+    const auto &cacheStatistics = deviceInstance.GetCommandCache().GetStatistics();
+    ImGui::Text("Scene recorded %llu, replayed %llu times",
+                static_cast<unsigned long long>(cacheStatistics.recordedScenes),
+                static_cast<unsigned long long>(cacheStatistics.replayedScenes));
+    const auto &graphStatistics = deviceInstance.GetRenderGraph().GetStatistics();
+    ImGui::Text("Render graph: %u passes, %u culled, %u dependencies", graphStatistics.livePasses,
+                graphStatistics.culledPasses, graphStatistics.dependencies);
+    ImGui::Separator();
+    const auto &lastTiming = framePacer.GetLastTiming();
+    const auto &smoothedTiming = framePacer.GetSmoothedTiming();
+    ImGui::Text("CPU frame: %.2f ms (avg %.2f)", lastTiming.cpuFrameMs, smoothedTiming.cpuFrameMs);
+    ImGui::Text("Limiter wait: %.2f ms (avg %.2f)", lastTiming.limiterWaitMs, smoothedTiming.limiterWaitMs);
+    ImGui::Text("Submit to GPU completion: %.2f ms (avg %.2f)", lastTiming.submitToCompleteMs,
+                smoothedTiming.submitToCompleteMs);
+    ImGui::End();
+}
+
+void CGui::DrawResolutionWindow()
+{
+    auto &deviceInstance = CDevice::GetInstance();
+    auto &dynamicResolution = deviceInstance.GetDynamicResolution();
+
+    ImGui::Begin("Resolution");
+    auto isEnabled = dynamicResolution.IsEnabled();
+    if (ImGui::Checkbox("Dynamic resolution", &isEnabled))
+        dynamicResolution.SetEnabled(isEnabled);
+    if (!dynamicResolution.IsTimingSupported())
+        ImGui::Text("No GPU timestamps, the scene renders at the maximum scale");
+    auto targetFrameMs = static_cast<float>(dynamicResolution.GetTargetFrameMs());
+    if (ImGui::SliderFloat("Target GPU ms", &targetFrameMs, 1.0f, 50.0f, "%.1f"))
+        dynamicResolution.SetTargetFrameMs(targetFrameMs);
+    auto minScale = dynamicResolution.GetMinScale();
+    auto maxScale = dynamicResolution.GetMaxScale();
+    const auto isMinChanged = ImGui::SliderFloat("Min scale", &minScale, 0.25f, 1.0f, "%.2f");
+    const auto isMaxChanged = ImGui::SliderFloat("Max scale", &maxScale, 0.25f, 1.0f, "%.2f");
+    if (isMinChanged || isMaxChanged)
+        dynamicResolution.SetScaleBounds(minScale, maxScale);
+    auto reactionSpeed = dynamicResolution.GetReactionSpeed();
+    if (ImGui::SliderFloat("Reaction speed", &reactionSpeed, 0.01f, 1.0f, "%.2f"))
+        dynamicResolution.SetReactionSpeed(reactionSpeed);
+    // Compare the GPU frame time below with and without it
+    auto isDepthPrepass = deviceInstance.IsDepthPrepass();
+    if (ImGui::Checkbox("Depth pre-pass", &isDepthPrepass))
+        deviceInstance.SetDepthPrepass(isDepthPrepass);
+    ImGui::Separator();
+    const auto renderExtent = deviceInstance.GetRenderExtent();
+    const auto extent = deviceInstance.GetExtent();
+    ImGui::Text("Scale %.2f: %ux%u of %ux%u", dynamicResolution.GetScale(), renderExtent.width, renderExtent.height,
+                extent.width, extent.height);
+    const auto &statistics = dynamicResolution.GetStatistics();
+    ImGui::Text("GPU frame: %.2f ms (avg %.2f)", statistics.gpuFrameMs, statistics.smoothedGpuFrameMs);
+    ImGui::Text("Scale changes: %llu", static_cast<unsigned long long>(statistics.scaleChanges));
+    ImGui::End();
+}
+
+const char *CGui::GetPresentModeName(VkPresentModeKHR presentMode)
+{
+    switch (presentMode)
+    {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        return "Immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+        return "Mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR:
+        return "FIFO";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+        return "FIFO relaxed";
+    default:
+        return "Other";
+    }
+}
+
 void CGui::Cleanup()
 {
-    vkDestroyDescriptorPool(CDevice::GetInstance().GetDevice(), m_guiPool, nullptr);
+    vkDestroyDescriptorPool(CDevice::GetInstance().GetDevice(), m_guiPool, CHostAllocator::GetCallbacks());
     ImGui_ImplVulkan_Shutdown();
 }
@@ -16,5 +16,9 @@ class CGui
   private:
     void InitImGui();
     void CreateImGuiDescriptorPool();
+    void DrawMemoryWindow();
+    void DrawFramePacingWindow();
+    void DrawResolutionWindow();
+    static const char *GetPresentModeName(VkPresentModeKHR presentMode);
     VkDescriptorPool m_guiPool;
 };
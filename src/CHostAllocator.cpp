@@ -0,0 +1,185 @@
+#include "CHostAllocator.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+// Command scope allocations are small and short lived, a few of them in flight at a time
+constexpr size_t kArenaSize = 256 * 1024;
+
+uintptr_t AlignUp(uintptr_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+}
+} // namespace
+
+CHostAllocator &CHostAllocator::GetInstance()
+{
+    static CHostAllocator instance;
+    return instance;
+}
+
+CHostAllocator::CHostAllocator() : mp_arena(std::make_unique<char[]>(kArenaSize))
+{
+    m_callbacks.pUserData = this;
+    m_callbacks.pfnAllocation = Allocate;
+    m_callbacks.pfnReallocation = Reallocate;
+    m_callbacks.pfnFree = Free;
+    m_callbacks.pfnInternalAllocation = OnInternalAllocation;
+    m_callbacks.pfnInternalFree = OnInternalFree;
+}
+
+void CHostAllocator::BeginFrame()
+{
+    std::lock_guard lock(m_mutex);
+    m_frameStatistics = m_statistics;
+    for (auto &scope : m_statistics.scopes)
+    {
+        scope.frameCount = 0;
+        scope.frameBytes = 0;
+    }
+    m_statistics.frameArenaCount = 0;
+}
+
+SHostAllocationStatistics CHostAllocator::GetStatistics() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_frameStatistics;
+}
+
+const char *CHostAllocator::GetScopeName(VkSystemAllocationScope scope)
+{
+    switch (scope)
+    {
+    case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND:
+        return "Command";
+    case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT:
+        return "Object";
+    case VK_SYSTEM_ALLOCATION_SCOPE_CACHE:
+        return "Cache";
+    case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE:
+        return "Device";
+    case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE:
+        return "Instance";
+    default:
+        return "Unknown";
+    }
+}
+
+void *VKAPI_PTR CHostAllocator::Allocate(void *pUserData, size_t size, size_t alignment,
+                                         VkSystemAllocationScope scope)
+{
+    auto &hostAllocator = *static_cast<CHostAllocator *>(pUserData);
+    std::lock_guard lock(hostAllocator.m_mutex);
+    return hostAllocator.AllocateLocked(size, alignment, scope);
+}
+
+void *VKAPI_PTR CHostAllocator::Reallocate(void *pUserData, void *pOriginal, size_t size, size_t alignment,
+                                           VkSystemAllocationScope scope)
+{
+    auto &hostAllocator = *static_cast<CHostAllocator *>(pUserData);
+    std::lock_guard lock(hostAllocator.m_mutex);
+    if (!pOriginal)
+        return hostAllocator.AllocateLocked(size, alignment, scope);
+    if (size == 0)
+    {
+        hostAllocator.FreeLocked(pOriginal);
+        return nullptr;
+    }
+
+    SAllocationHeader header;
+    memcpy(&header, static_cast<char *>(pOriginal) - sizeof(SAllocationHeader), sizeof(SAllocationHeader));
+
+    auto pMemory = hostAllocator.AllocateLocked(size, alignment, scope);
+    if (!pMemory)
+        return nullptr;
+    memcpy(pMemory, pOriginal, std::min(size, header.size));
+    hostAllocator.FreeLocked(pOriginal);
+    return pMemory;
+}
+
+void VKAPI_PTR CHostAllocator::Free(void *pUserData, void *pMemory)
+{
+    if (!pMemory)
+        return;
+    auto &hostAllocator = *static_cast<CHostAllocator *>(pUserData);
+    std::lock_guard lock(hostAllocator.m_mutex);
+    hostAllocator.FreeLocked(pMemory);
+}
+
+void VKAPI_PTR CHostAllocator::OnInternalAllocation(void *pUserData, size_t size, VkInternalAllocationType,
+                                                    VkSystemAllocationScope)
+{
+    auto &hostAllocator = *static_cast<CHostAllocator *>(pUserData);
+    std::lock_guard lock(hostAllocator.m_mutex);
+    hostAllocator.m_statistics.internalBytes += size;
+}
+
+void VKAPI_PTR CHostAllocator::OnInternalFree(void *pUserData, size_t size, VkInternalAllocationType,
+                                              VkSystemAllocationScope)
+{
+    auto &hostAllocator = *static_cast<CHostAllocator *>(pUserData);
+    std::lock_guard lock(hostAllocator.m_mutex);
+    hostAllocator.m_statistics.internalBytes -= size;
+}
+
+void *CHostAllocator::AllocateLocked(size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+    // Keeps the header in front of the returned pointer naturally aligned
+    alignment = std::max(alignment, alignof(std::max_align_t));
+    const auto totalSize = size + alignment + sizeof(SAllocationHeader);
+
+    SAllocationHeader header{};
+    header.size = size;
+    header.scope = scope;
+
+    char *pMemory = nullptr;
+    if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND && m_arenaHead + totalSize <= kArenaSize)
+    {
+        const auto arenaStart = reinterpret_cast<uintptr_t>(mp_arena.get());
+        const auto address = AlignUp(arenaStart + m_arenaHead + sizeof(SAllocationHeader), alignment);
+        pMemory = reinterpret_cast<char *>(address);
+        m_arenaHead = address + size - arenaStart;
+        ++m_arenaOutstanding;
+        ++m_statistics.frameArenaCount;
+    }
+    else
+    {
+        header.pBase = malloc(totalSize);
+        if (!header.pBase)
+            return nullptr;
+        const auto address =
+            AlignUp(reinterpret_cast<uintptr_t>(header.pBase) + sizeof(SAllocationHeader), alignment);
+        pMemory = reinterpret_cast<char *>(address);
+    }
+    memcpy(pMemory - sizeof(SAllocationHeader), &header, sizeof(SAllocationHeader));
+
+    auto &scopeStatistics = m_statistics.scopes[scope];
+    ++scopeStatistics.liveCount;
+    scopeStatistics.liveBytes += size;
+    ++scopeStatistics.frameCount;
+    scopeStatistics.frameBytes += size;
+    return pMemory;
+}
+
+void CHostAllocator::FreeLocked(void *pMemory)
+{
+    SAllocationHeader header;
+    memcpy(&header, static_cast<char *>(pMemory) - sizeof(SAllocationHeader), sizeof(SAllocationHeader));
+
+    auto &scopeStatistics = m_statistics.scopes[header.scope];
+    --scopeStatistics.liveCount;
+    scopeStatistics.liveBytes -= header.size;
+
+    if (header.pBase)
+    {
+        free(header.pBase);
+        return;
+    }
+
+    // Arena memory is only reused once every command allocation handed out from it is back
+    if (--m_arenaOutstanding == 0)
+        m_arenaHead = 0;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vulkan/vulkan.h>
+
+struct SHostScopeStatistics
+{
+    uint64_t liveCount = 0;
+    size_t liveBytes = 0;
+    // Allocations made during one frame
+    uint64_t frameCount = 0;
+    size_t frameBytes = 0;
+};
+
+struct SHostAllocationStatistics
+{
+    // Indexed by VkSystemAllocationScope
+    std::array<SHostScopeStatistics, VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1> scopes{};
+    // Memory the driver allocated on its own and only told us about
+    size_t internalBytes = 0;
+    // Command scope allocations of one frame served by the arena instead of the heap
+    uint64_t frameArenaCount = 0;
+};
+
+// Host memory callbacks passed to every Vulkan create, destroy and memory call so driver allocations show up in our
+// statistics. Command scope allocations only live for the duration of one Vulkan call, they are bump allocated from
+// an arena that rewinds whenever none of them is outstanding.
+class CHostAllocator
+{
+  public:
+    static CHostAllocator &GetInstance();
+    static const VkAllocationCallbacks *GetCallbacks()
+    {
+        return &GetInstance().m_callbacks;
+    }
+
+    // Closes the statistics of the frame before, see GetStatistics
+    void BeginFrame();
+    // Live values and counters of the last closed frame
+    SHostAllocationStatistics GetStatistics() const;
+
+    static const char *GetScopeName(VkSystemAllocationScope scope);
+
+  private:
+    struct SAllocationHeader
+    {
+        // Start of the heap block, null when the allocation lives in the arena
+        void *pBase = nullptr;
+        size_t size = 0;
+        VkSystemAllocationScope scope = VK_SYSTEM_ALLOCATION_SCOPE_OBJECT;
+    };
+
+    CHostAllocator();
+
+    static void *VKAPI_PTR Allocate(void *pUserData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+    static void *VKAPI_PTR Reallocate(void *pUserData, void *pOriginal, size_t size, size_t alignment,
+                                      VkSystemAllocationScope scope);
+    static void VKAPI_PTR Free(void *pUserData, void *pMemory);
+    static void VKAPI_PTR OnInternalAllocation(void *pUserData, size_t size, VkInternalAllocationType type,
+                                               VkSystemAllocationScope scope);
+    static void VKAPI_PTR OnInternalFree(void *pUserData, size_t size, VkInternalAllocationType type,
+                                         VkSystemAllocationScope scope);
+
+    // Both expect m_mutex to be held
+    void *AllocateLocked(size_t size, size_t alignment, VkSystemAllocationScope scope);
+    void FreeLocked(void *pMemory);
+
+    VkAllocationCallbacks m_callbacks{};
+    mutable std::mutex m_mutex;
+    SHostAllocationStatistics m_statistics{};
+    SHostAllocationStatistics m_frameStatistics{};
+
+    std::unique_ptr<char[]> mp_arena;
+    size_t m_arenaHead = 0;
+    uint32_t m_arenaOutstanding = 0;
+};
@@ -1,4 +1,5 @@
 #include "CInstance.hpp"
+#include "CHostAllocator.hpp"
 #include "vkStructs.hpp"
 
 using namespace vkTools;
@@ -6,9 +7,11 @@ using namespace vkTools;
 CInstance::CInstance(GLFWwindow *window, SAppInfo appInfo) : m_appInfo(appInfo)
 {
     CreateInstance();
-    mp_validationLayer = std::make_unique<CValidationLayer>(m_instance, appInfo.layers);
+    if (!m_appInfo.layers.empty())
+        mp_validationLayer = std::make_unique<CValidationLayer>(m_instance, appInfo.layers);
 
-    CreateSurface(window);
+    if (!m_appInfo.isHeadless)
+        CreateSurface(window);
     CreatePhysicalDevice();
 }
 
@@ -18,12 +21,13 @@ void CInstance::CreateInstance()
         throw std::runtime_error("Validation layers not available.");
 
     const auto applicationInfo = vkStructs::ApplicationInfo();
-    const auto extensions = CVulkanHelpers::GetVulkanInstanceExtensions();
+    const auto extensions =
+        CVulkanHelpers::GetVulkanInstanceExtensions(m_appInfo.isHeadless, !m_appInfo.layers.empty());
     VkDebugUtilsMessengerCreateInfoEXT debugInfo;
     CValidationLayer::PopulateDebugMessengerCreateInfo(debugInfo);
     const auto instanceInfo = vkStructs::InstanceCreateInfo(applicationInfo, extensions, m_appInfo.layers, debugInfo);
 
-    VK_CHECK_RESULT(vkCreateInstance(&instanceInfo, nullptr, &m_instance))
+    VK_CHECK_RESULT(vkCreateInstance(&instanceInfo, CHostAllocator::GetCallbacks(), &m_instance))
 }
 
 void CInstance::CreateSurface(GLFWwindow *window)
@@ -31,7 +35,7 @@ void CInstance::CreateSurface(GLFWwindow *window)
     if (!window)
         throw std::runtime_error("Window doesn't exist, create it first.");
 
-    VK_CHECK_RESULT(glfwCreateWindowSurface(m_instance, window, nullptr, &m_surface))
+    VK_CHECK_RESULT(glfwCreateWindowSurface(m_instance, window, CHostAllocator::GetCallbacks(), &m_surface))
 }
 
 void CInstance::CreatePhysicalDevice()
@@ -49,11 +53,19 @@ void CInstance::CreatePhysicalDevice()
                 m_queueFamilies.graphicsFamilyIndex = index;
             }
 
-            VkBool32 isSupported;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, index, m_surface, &isSupported);
-            if (isSupported)
+            if (m_appInfo.isHeadless)
             {
-                m_queueFamilies.presentFamilyIndex = index;
+                // Nothing is presented, the graphics family stands in so the queue setup stays the same
+                m_queueFamilies.presentFamilyIndex = m_queueFamilies.graphicsFamilyIndex;
+            }
+            else
+            {
+                VkBool32 isSupported;
+                vkGetPhysicalDeviceSurfaceSupportKHR(device, index, m_surface, &isSupported);
+                if (isSupported)
+                {
+                    m_queueFamilies.presentFamilyIndex = index;
+                }
             }
 
             // If device has the necessary conditions use it
@@ -64,6 +76,7 @@ void CInstance::CreatePhysicalDevice()
 
             ++index;
         }
+        m_queueFamilies.transferFamilyIndex = FindTransferFamily(queueFamilies);
 
         if (CheckIfDeviceSuitable(device))
         {
@@ -96,13 +109,52 @@ std::vector<VkQueueFamilyProperties> CInstance::FindQueueFamiliesForDevice(const
     return queueFamilies;
 }
 
+std::optional<uint32_t> CInstance::FindTransferFamily(const std::vector<VkQueueFamilyProperties> &queueFamilies)
+{
+    // Prefer a transfer-only family (usually the DMA engine), then anything that isn't the graphics family
+    std::optional<uint32_t> separateFamily;
+    for (auto index = 0u; index != queueFamilies.size(); ++index)
+    {
+        const auto flags = queueFamilies[index].queueFlags;
+        if (!(flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) ||
+            queueFamilies[index].queueCount == 0)
+            continue;
+
+        if (!(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+            return index;
+        if (!separateFamily && !(flags & VK_QUEUE_GRAPHICS_BIT))
+            separateFamily = index;
+    }
+    return separateFamily;
+}
+
 bool CInstance::CheckIfDeviceSuitable(const VkPhysicalDevice device)
 {
     const auto extensionsValid = CVulkanHelpers::CheckForVulkanInstanceExtensions(device, m_appInfo.deviceExtensions);
+    const auto featuresValid = CheckForTimelineSemaphores(device);
+    if (m_appInfo.isHeadless)
+        return m_queueFamilies.HaveValues() && extensionsValid && featuresValid;
+
     CVulkanHelpers::GetSupportForSwapchain(device, m_surface, m_swapchainSupport);
 
-    return m_queueFamilies.HaveValues() && extensionsValid && !m_swapchainSupport.surfaceFormats.empty() &&
-           !m_swapchainSupport.surfacePresentModes.empty();
+    return m_queueFamilies.HaveValues() && extensionsValid && featuresValid &&
+           !m_swapchainSupport.surfaceFormats.empty() && !m_swapchainSupport.surfacePresentModes.empty();
+}
+
+bool CInstance::CheckForTimelineSemaphores(const VkPhysicalDevice device)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+    if (properties.apiVersion < VK_API_VERSION_1_2)
+        return false;
+
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &timelineFeatures;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+    return timelineFeatures.timelineSemaphore == VK_TRUE;
 }
 
 void CInstance::UpdateSwaphchainSupport()
@@ -112,7 +164,9 @@ void CInstance::UpdateSwaphchainSupport()
 
 CInstance::~CInstance()
 {
-    mp_validationLayer->DestroyDebugMessenger(m_instance);
-    vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
-    vkDestroyInstance(m_instance, nullptr);
+    if (mp_validationLayer)
+        mp_validationLayer->DestroyDebugMessenger(m_instance);
+    if (m_surface != VK_NULL_HANDLE)
+        vkDestroySurfaceKHR(m_instance, m_surface, CHostAllocator::GetCallbacks());
+    vkDestroyInstance(m_instance, CHostAllocator::GetCallbacks());
 }
@@ -56,7 +56,10 @@ class CInstance
   private:
     std::vector<VkPhysicalDevice> FindPhysicalDevices();
     std::vector<VkQueueFamilyProperties> FindQueueFamiliesForDevice(const VkPhysicalDevice device);
+    std::optional<uint32_t> FindTransferFamily(const std::vector<VkQueueFamilyProperties> &queueFamilies);
     bool CheckIfDeviceSuitable(const VkPhysicalDevice device);
+    // CDevice synchronises every queue through timeline semaphores, see CTimelineSync
+    bool CheckForTimelineSemaphores(const VkPhysicalDevice device);
 
   private:
     VkInstance m_instance = VK_NULL_HANDLE;
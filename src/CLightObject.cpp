@@ -1,9 +1,11 @@
 #include "CLightObject.hpp"
+#include "CFramePacer.hpp"
+#include "CHostAllocator.hpp"
 #include "CImageLoader.hpp"
 #include "CModelLoader.hpp"
 #include "CShaderUtils.hpp"
+#include "CUniformRing.hpp"
 #include "vkStructs.hpp"
-#include <chrono>
 #include <glm/gtc/matrix_transform.hpp>
 
 using namespace vkTools;
@@ -14,169 +16,35 @@ CLightObject::CLightObject(vkPrimitives::STransform transform) : m_transform(tra
     mp_deviceInstance = &CDevice::GetInstance();
     m_mesh = CModelLoader::LoadObjModel("../assets/models/cube.obj");
 
-    CreateVertexBuffer();
-    CreateIndexBuffer();
-    CreateUniformBuffers();
-    CreateDescriptorSets();
-    CreateGraphicsPipeline();
-}
-
-void CLightObject::CleanupGraphicsPipeline()
-{
-    vkDestroyPipelineLayout(mp_deviceInstance->GetDevice(), m_graphicsPipelineLayout, nullptr);
-    vkDestroyPipeline(mp_deviceInstance->GetDevice(), m_graphicsPipeline, nullptr);
-}
-void CLightObject::RecreateGraphicsPipeline()
-{
+    m_meshRange = mp_deviceInstance->GetGeometryArena().Allocate(m_mesh);
     CreateGraphicsPipeline();
+    mp_deviceInstance->InvalidateCommandCache();
 }
 
 void CLightObject::UpdateUniformBuffers()
 {
-    static auto startTime = std::chrono::high_resolution_clock::now();
-
-    const auto currentTime = std::chrono::high_resolution_clock::now();
-    const auto time = std::chrono::duration<float, std::chrono::seconds ::period>(currentTime - startTime).count();
-
-    m_mvp.model = glm::translate(glm::mat4(1.0f), m_transform.translate);
-    m_mvp.model = glm::scale(m_mvp.model, m_transform.scale);
-    m_mvp.model = glm::rotate(m_mvp.model, time * glm::radians(10.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    m_mvp.view = glm::lookAt(glm::vec3(10.0f, 0.01f, 10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    m_mvp.projection = glm::perspective(
-        glm::radians(45.0f),
-        mp_deviceInstance->GetExtent().width / static_cast<float>(mp_deviceInstance->GetExtent().height), 0.1f, 100.0f);
-    //    m_mvp.projection = glm::ortho(-2.0f, 2.0f, 2.0f, -2.0f, 0.1f, 10.0f);
-    m_mvp.projection[1][1] *= -1;
-
-    void *data;
-    vkMapMemory(mp_deviceInstance->GetDevice(),
-                m_vecUniformBufferHandles[mp_deviceInstance->GetCurrentImageIndex()].memory, 0, sizeof(m_mvp), 0,
-                &data);
-    memcpy(data, &m_mvp, sizeof(m_mvp));
-    vkUnmapMemory(mp_deviceInstance->GetDevice(),
-                  m_vecUniformBufferHandles[mp_deviceInstance->GetCurrentImageIndex()].memory);
-}
-
-void CLightObject::Draw() const
-{
-    VkCommandBuffer cmdBuffer = mp_deviceInstance->GetCurrentCommandBuffer();
-
-    VkDeviceSize offsets = {0};
-
-    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
-    vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &m_vertexBufferHandles.buffer, &offsets);
-
-    vkCmdBindIndexBuffer(cmdBuffer, m_indexBufferHandles.buffer, 0, VK_INDEX_TYPE_UINT16);
-
-    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mp_deviceInstance->GetPipelineLayout(), 0, 1,
-                            &m_vecDescriptorSets[mp_deviceInstance->GetCurrentImageIndex()], 0, nullptr);
+    // Stands still while animations are paused
+    const auto time = mp_deviceInstance->GetFramePacer().GetAnimationTime();
 
-    vkCmdDrawIndexed(cmdBuffer, static_cast<uint32_t>(m_mesh.indices.size()), 1, 0, 0, 0);
-}
+    m_modelUniform.model = glm::translate(glm::mat4(1.0f), m_transform.translate);
+    m_modelUniform.model = glm::scale(m_modelUniform.model, m_transform.scale);
+    m_modelUniform.model = glm::rotate(m_modelUniform.model, time * glm::radians(10.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    // View and projection are latched by the device right before submit
 
-void CLightObject::CreateVertexBuffer()
-{
-    SBufferHandles stagingHandles{};
-    VkBufferCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    createInfo.size = GetVerticesSize();
-    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    createInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    mp_deviceInstance->GetBufferImageManager().CreateBuffer(
-        createInfo, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, stagingHandles);
-
-    mp_deviceInstance->GetBufferImageManager().MapMemory(stagingHandles, 0, GetVerticesSize(), m_mesh.vertices.data());
-
-    // Create the vertex buffer and copy the staged buffer to it
-    createInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-    mp_deviceInstance->GetBufferImageManager().CreateBuffer(createInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                            m_vertexBufferHandles);
-
-    VkBufferCopy regions{};
-    regions.size = GetVerticesSize();
-    mp_deviceInstance->GetBufferImageManager().CopyBuffer(stagingHandles.buffer, regions, m_vertexBufferHandles.buffer);
-
-    // Destroy the staging buffer
-    mp_deviceInstance->GetBufferImageManager().DestroyBufferHandles(stagingHandles);
+    m_uniformOffset = mp_deviceInstance->GetUniformRing().Push(&m_modelUniform, sizeof(m_modelUniform));
 }
 
-void CLightObject::CreateIndexBuffer()
+void CLightObject::Draw(VkCommandBuffer cmdBuffer) const
 {
-    SBufferHandles stagingHandles{};
-    VkBufferCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    createInfo.size = GetVerticesSize();
-    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    createInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    mp_deviceInstance->GetBufferImageManager().CreateBuffer(
-        createInfo, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, stagingHandles);
-
-    mp_deviceInstance->GetBufferImageManager().MapMemory(stagingHandles, 0, GetIndicesSize(), m_mesh.indices.data());
-
-    // Create the vertex buffer and copy the staged buffer to it
-    createInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-    mp_deviceInstance->GetBufferImageManager().CreateBuffer(createInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                            m_indexBufferHandles);
-
-    VkBufferCopy regions{};
-    regions.size = GetIndicesSize();
-    mp_deviceInstance->GetBufferImageManager().CopyBuffer(stagingHandles.buffer, regions, m_indexBufferHandles.buffer);
-
-    // Destroy the staging buffer
-    mp_deviceInstance->GetBufferImageManager().DestroyBufferHandles(stagingHandles);
-}
+    // Viewport, scissor and geometry stay bound from the start of the scene
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
 
-void CLightObject::CreateUniformBuffers()
-{
-    m_vecUniformBufferHandles.resize(mp_deviceInstance->GetSwapchainImageCount());
-
-    for (auto &handle : m_vecUniformBufferHandles)
-    {
-        VkBufferCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        createInfo.size = GetUniformSize();
-        createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        createInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-        mp_deviceInstance->GetBufferImageManager().CreateBuffer(
-            createInfo, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, handle);
-    }
-}
+    const auto uniformDescriptorSet = mp_deviceInstance->GetUniformDescriptorSet();
+    const auto dynamicOffsets = mp_deviceInstance->GetUniformDynamicOffsets(m_uniformOffset);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipelineLayout, 0, 1,
+                            &uniformDescriptorSet, dynamicOffsets.size(), dynamicOffsets.data());
 
-void CLightObject::CreateDescriptorSets()
-{
-    m_vecDescriptorSets.resize(mp_deviceInstance->GetSwapchainImageCount());
-
-    std::vector<VkDescriptorSetLayout> layouts(mp_deviceInstance->GetSwapchainImageCount(),
-                                               mp_deviceInstance->GetDescriptorSetLayout());
-    VkDescriptorSetAllocateInfo allocateInfo{};
-    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocateInfo.descriptorPool = mp_deviceInstance->GetDescriptorPool();
-    allocateInfo.descriptorSetCount = layouts.size();
-    allocateInfo.pSetLayouts = layouts.data();
-    if (const auto res =
-            vkAllocateDescriptorSets(mp_deviceInstance->GetDevice(), &allocateInfo, m_vecDescriptorSets.data());
-        res != VK_SUCCESS)
-        throw std::runtime_error("Failed to create descriptor set.");
-
-    for (auto i = 0; i != m_vecDescriptorSets.size(); ++i)
-    {
-        VkDescriptorBufferInfo mvpInfo{};
-        mvpInfo.buffer = m_vecUniformBufferHandles[i].buffer;
-        mvpInfo.range = GetUniformSize();
-        mvpInfo.offset = 0;
-
-        std::array<VkWriteDescriptorSet, 1> writeDescriptorSets{};
-        writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        writeDescriptorSets[0].descriptorCount = 1;
-        writeDescriptorSets[0].dstSet = m_vecDescriptorSets[i];
-        writeDescriptorSets[0].dstBinding = 0;
-        writeDescriptorSets[0].dstArrayElement = 0;
-        writeDescriptorSets[0].pBufferInfo = &mvpInfo;
-
-        vkUpdateDescriptorSets(mp_deviceInstance->GetDevice(), writeDescriptorSets.size(), writeDescriptorSets.data(),
-                               0, nullptr);
-    }
+    vkCmdDrawIndexed(cmdBuffer, m_meshRange.indexCount, 1, m_meshRange.firstIndex, m_meshRange.vertexOffset, 0);
 }
 
 void CLightObject::CreateGraphicsPipeline()
@@ -204,17 +72,15 @@ void CLightObject::CreateGraphicsPipeline()
     const auto colorBlendInfo = vkStructs::ColorBlendStateCreateInfo(attachmentState);
     const auto multisampleInfo = vkStructs::MultisampleStateCreateInfo();
     const auto depthStencilInfo = vkStructs::DepthStencilStateCreateInfo();
-    const auto dynamicInfo = vkStructs::DynamicStateCreateInfo();
-
-    std::vector<VkViewport> vecViewports{{0.0f, 0.0f, static_cast<float>(mp_deviceInstance->GetExtent().width),
-                                          static_cast<float>(mp_deviceInstance->GetExtent().height), 0.0f, 1.0f}};
-    std::vector<VkRect2D> vecScissors{{{0, 0}, mp_deviceInstance->GetExtent()}};
-    const auto viewportinfo = vkStructs::ViewportCreateInfo(vecViewports, vecScissors);
+    // Resizing the swapchain never rebuilds the pipeline
+    const std::vector<VkDynamicState> vecDynamicStates{VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    const auto dynamicInfo = vkStructs::DynamicStateCreateInfo(vecDynamicStates);
+    const auto viewportinfo = vkStructs::ViewportCreateInfo(1, 1);
 
-    std::vector<VkDescriptorSetLayout> vecLayouts{mp_deviceInstance->GetDescriptorSetLayout()};
+    std::vector<VkDescriptorSetLayout> vecLayouts{mp_deviceInstance->GetUniformDescriptorSetLayout()};
     const auto pipelineInfo = vkStructs::PipelineLayoutCreateInfo(vecLayouts);
-    VK_CHECK_RESULT(
-        vkCreatePipelineLayout(mp_deviceInstance->GetDevice(), &pipelineInfo, nullptr, &m_graphicsPipelineLayout))
+    VK_CHECK_RESULT(vkCreatePipelineLayout(mp_deviceInstance->GetDevice(), &pipelineInfo,
+                                           CHostAllocator::GetCallbacks(), &m_graphicsPipelineLayout))
 
     const auto graphicsPipelineInfo = vkStructs::GraphicsPipelineCreateInfo(
         vecShaderStages, vertexInputInfo, inputAssemblyInfo, tessellationInfo, viewportinfo, rasterizationInfo,
@@ -222,20 +88,24 @@ void CLightObject::CreateGraphicsPipeline()
         mp_deviceInstance->GetRenderPass());
 
     VK_CHECK_RESULT(vkCreateGraphicsPipelines(mp_deviceInstance->GetDevice(), VK_NULL_HANDLE, 1, &graphicsPipelineInfo,
-                                              nullptr, &m_graphicsPipeline))
+                                              CHostAllocator::GetCallbacks(), &m_graphicsPipeline))
 
-    vkDestroyShaderModule(mp_deviceInstance->GetDevice(), vertModule, nullptr);
-    vkDestroyShaderModule(mp_deviceInstance->GetDevice(), fragModule, nullptr);
+    vkDestroyShaderModule(mp_deviceInstance->GetDevice(), vertModule, CHostAllocator::GetCallbacks());
+    vkDestroyShaderModule(mp_deviceInstance->GetDevice(), fragModule, CHostAllocator::GetCallbacks());
 }
 
 void CLightObject::ObjectCleanup()
 {
-    mp_deviceInstance->GetBufferImageManager().DestroyBufferHandles(m_vertexBufferHandles);
-    mp_deviceInstance->GetBufferImageManager().DestroyBufferHandles(m_indexBufferHandles);
-    for (auto &handle : m_vecUniformBufferHandles)
-    {
-        mp_deviceInstance->GetBufferImageManager().DestroyBufferHandles(handle);
-    }
-
-    CleanupGraphicsPipeline();
+    // Frames that drew the object may still be in flight
+    mp_deviceInstance->DeferDestroy([meshRange = m_meshRange, graphicsPipelineLayout = m_graphicsPipelineLayout,
+                                     graphicsPipeline = m_graphicsPipeline]() {
+        auto &deviceInstance = CDevice::GetInstance();
+        deviceInstance.GetGeometryArena().Free(meshRange);
+        vkDestroyPipelineLayout(deviceInstance.GetDevice(), graphicsPipelineLayout, CHostAllocator::GetCallbacks());
+        vkDestroyPipeline(deviceInstance.GetDevice(), graphicsPipeline, CHostAllocator::GetCallbacks());
+    });
+    m_meshRange = {};
+    m_graphicsPipelineLayout = VK_NULL_HANDLE;
+    m_graphicsPipeline = VK_NULL_HANDLE;
+    mp_deviceInstance->InvalidateCommandCache();
 }
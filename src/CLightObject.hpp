@@ -1,6 +1,7 @@
 #pragma once
 
 #include "CBufferImageManager.hpp"
+#include "CGeometryArena.hpp"
 #include "CObject.hpp"
 #include "vkPrimitives.hpp"
 
@@ -10,10 +11,8 @@ class CLightObject : public CObject
     explicit CLightObject(vkTools::vkPrimitives::STransform transform = {glm::vec3(1.0f), glm::vec3(0.25f),
                                                                          glm::vec3(1.0f)});
 
-    void CleanupGraphicsPipeline();
-    void RecreateGraphicsPipeline();
     void UpdateUniformBuffers() override;
-    void Draw() const override;
+    void Draw(VkCommandBuffer cmdBuffer) const override;
     void ObjectCleanup() override;
 
     uint32_t GetVerticesSize() const
@@ -26,27 +25,22 @@ class CLightObject : public CObject
     }
     uint32_t GetUniformSize() const
     {
-        return static_cast<uint32_t>(sizeof(m_mvp));
+        return static_cast<uint32_t>(sizeof(m_modelUniform));
     }
 
   private:
-    void CreateVertexBuffer();
-    void CreateIndexBuffer();
-    void CreateUniformBuffers();
-    void CreateDescriptorSets();
     void CreateGraphicsPipeline();
 
     CDevice *mp_deviceInstance;
 
-    SBufferHandles m_vertexBufferHandles{};
-    SBufferHandles m_indexBufferHandles{};
-    std::vector<SBufferHandles> m_vecUniformBufferHandles{};
-    std::vector<VkDescriptorSet> m_vecDescriptorSets;
+    SMeshRange m_meshRange{};
+    // Offset of this frame's uniforms in the device's uniform ring
+    uint32_t m_uniformOffset = 0;
 
     VkPipelineLayout m_graphicsPipelineLayout;
     VkPipeline m_graphicsPipeline;
 
     vkTools::vkPrimitives::SMesh m_mesh;
-    vkTools::vkPrimitives::SMVP m_mvp{};
+    vkTools::vkPrimitives::SModelUniform m_modelUniform{};
     vkTools::vkPrimitives::STransform m_transform;
 };
@@ -0,0 +1,361 @@
+#include "CMemoryAllocator.hpp"
+#include "CDevice.hpp"
+#include "CHostAllocator.hpp"
+#include <algorithm>
+
+namespace
+{
+constexpr VkDeviceSize kDefaultBlockSize = 64ull * 1024 * 1024;
+constexpr VkDeviceSize kSmallHeapSize = 1024ull * 1024 * 1024;
+} // namespace
+
+CMemoryAllocator::CMemoryAllocator(VkPhysicalDevice physicalDevice) : m_budget(physicalDevice)
+{
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_memoryProperties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    m_bufferImageGranularity = properties.limits.bufferImageGranularity;
+    m_nonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+}
+
+SMemoryAllocation CMemoryAllocator::Allocate(const VkMemoryRequirements &resourceMemReq,
+                                             VkMemoryPropertyFlags memFlags, EResourceKind kind,
+                                             EMemoryCategory category)
+{
+    const auto memoryTypeIndex = FindMemoryType(resourceMemReq.memoryTypeBits, memFlags, resourceMemReq.size);
+    const auto memReq = AlignToAtoms(resourceMemReq, memoryTypeIndex);
+    m_budget.OnAllocate(category, memReq.size);
+
+    // Large resources get their own allocation instead of eating most of a block. Lazily allocated memory is only
+    // committed as a pass touches it, so it is never pooled.
+    if (memReq.size > GetBlockSize(memoryTypeIndex) / 2 ||
+        m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+    {
+        auto allocation = AllocateDedicated(memReq, memoryTypeIndex);
+        allocation.category = category;
+        return allocation;
+    }
+
+    // Without a granularity requirement buffers and images can share blocks
+    if (m_bufferImageGranularity <= 1)
+        kind = EResourceKind::Linear;
+
+    SMemoryAllocation allocation{};
+    allocation.memoryTypeIndex = memoryTypeIndex;
+    allocation.size = memReq.size;
+    allocation.category = category;
+
+    for (auto &block : m_blocks[memoryTypeIndex])
+    {
+        if (block->kind == kind && block->allocator.Allocate(memReq.size, memReq.alignment, allocation.offset))
+        {
+            allocation.pBlock = block.get();
+            break;
+        }
+    }
+
+    if (!allocation.pBlock)
+    {
+        allocation.pBlock = CreateBlock(memoryTypeIndex, kind);
+        if (!allocation.pBlock->allocator.Allocate(memReq.size, memReq.alignment, allocation.offset))
+            throw std::runtime_error("Failed to sub-allocate from a new memory block.");
+    }
+
+    ++allocation.pBlock->allocationCount;
+    allocation.memory = allocation.pBlock->memory;
+    allocation.isCoherent =
+        m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    if (allocation.pBlock->pMapped)
+        allocation.pMapped = static_cast<char *>(allocation.pBlock->pMapped) + allocation.offset;
+    return allocation;
+}
+
+void CMemoryAllocator::Free(SMemoryAllocation &allocation)
+{
+    if (allocation.memory == VK_NULL_HANDLE)
+        return;
+
+    m_budget.OnFree(allocation.category, allocation.size);
+    if (!allocation.pBlock)
+    {
+        vkFreeMemory(CDevice::GetInstance().GetDevice(), allocation.memory, CHostAllocator::GetCallbacks());
+        --m_dedicatedCount[allocation.memoryTypeIndex];
+        m_dedicatedBytes[allocation.memoryTypeIndex] -= allocation.size;
+        m_budget.OnRelease(m_memoryProperties.memoryTypes[allocation.memoryTypeIndex].heapIndex, allocation.size);
+    }
+    else
+    {
+        allocation.pBlock->allocator.Free(allocation.offset, allocation.size);
+        --allocation.pBlock->allocationCount;
+    }
+
+    allocation = {};
+}
+
+bool CMemoryAllocator::CanReallocate(const SMemoryAllocation &allocation) const
+{
+    if (!allocation.pBlock)
+        return false;
+
+    const auto sourceUsedSize = allocation.pBlock->allocator.GetUsedSize();
+    for (const auto &block : m_blocks[allocation.memoryTypeIndex])
+    {
+        if (block.get() != allocation.pBlock && block->kind == allocation.pBlock->kind &&
+            block->allocator.GetUsedSize() >= sourceUsedSize &&
+            block->allocator.GetLargestFreeRange() >= allocation.size)
+            return true;
+    }
+    return false;
+}
+
+bool CMemoryAllocator::Reallocate(const SMemoryAllocation &allocation, const VkMemoryRequirements &resourceMemReq,
+                                  SMemoryAllocation &newAllocation)
+{
+    if (!allocation.pBlock || !(resourceMemReq.memoryTypeBits & (1 << allocation.memoryTypeIndex)))
+        return false;
+
+    const auto memReq = AlignToAtoms(resourceMemReq, allocation.memoryTypeIndex);
+
+    const auto sourceUsedSize = allocation.pBlock->allocator.GetUsedSize();
+    for (auto &block : m_blocks[allocation.memoryTypeIndex])
+    {
+        if (block.get() == allocation.pBlock || block->kind != allocation.pBlock->kind ||
+            block->allocator.GetUsedSize() < sourceUsedSize)
+            continue;
+
+        VkDeviceSize offset;
+        if (!block->allocator.Allocate(memReq.size, memReq.alignment, offset))
+            continue;
+
+        newAllocation = allocation;
+        newAllocation.memory = block->memory;
+        newAllocation.pBlock = block.get();
+        newAllocation.offset = offset;
+        newAllocation.size = memReq.size;
+        newAllocation.pMapped = block->pMapped ? static_cast<char *>(block->pMapped) + offset : nullptr;
+        ++block->allocationCount;
+        m_budget.OnAllocate(newAllocation.category, newAllocation.size);
+        return true;
+    }
+    return false;
+}
+
+VkDeviceSize CMemoryAllocator::ReleaseEmptyBlocks(VkMemoryPropertyFlags flags)
+{
+    VkDeviceSize releasedBytes = 0;
+    for (auto typeIndex = 0u; typeIndex != m_memoryProperties.memoryTypeCount; ++typeIndex)
+    {
+        if ((m_memoryProperties.memoryTypes[typeIndex].propertyFlags & flags) != flags)
+            continue;
+
+        auto &blocks = m_blocks[typeIndex];
+        for (auto it = blocks.begin(); it != blocks.end();)
+        {
+            if ((*it)->allocationCount != 0)
+            {
+                ++it;
+                continue;
+            }
+
+            vkFreeMemory(CDevice::GetInstance().GetDevice(), (*it)->memory, CHostAllocator::GetCallbacks());
+            m_budget.OnRelease(m_memoryProperties.memoryTypes[typeIndex].heapIndex, (*it)->allocator.GetSize());
+            releasedBytes += (*it)->allocator.GetSize();
+            it = blocks.erase(it);
+        }
+    }
+    return releasedBytes;
+}
+
+void CMemoryAllocator::Flush(const SMemoryAllocation &allocation, VkDeviceSize offset, VkDeviceSize size) const
+{
+    if (allocation.isCoherent || !allocation.pMapped)
+        return;
+
+    const auto range = GetMappedRange(allocation, offset, size);
+    if (const auto res = vkFlushMappedMemoryRanges(CDevice::GetInstance().GetDevice(), 1, &range); res != VK_SUCCESS)
+        throw std::runtime_error("Failed to flush mapped memory.");
+}
+
+void CMemoryAllocator::Invalidate(const SMemoryAllocation &allocation, VkDeviceSize offset, VkDeviceSize size) const
+{
+    if (allocation.isCoherent || !allocation.pMapped)
+        return;
+
+    const auto range = GetMappedRange(allocation, offset, size);
+    if (const auto res = vkInvalidateMappedMemoryRanges(CDevice::GetInstance().GetDevice(), 1, &range);
+        res != VK_SUCCESS)
+        throw std::runtime_error("Failed to invalidate mapped memory.");
+}
+
+std::vector<SHeapStatistics> CMemoryAllocator::GetHeapStatistics() const
+{
+    std::vector<SHeapStatistics> heapStatistics(m_memoryProperties.memoryHeapCount);
+
+    for (auto typeIndex = 0u; typeIndex != m_memoryProperties.memoryTypeCount; ++typeIndex)
+    {
+        auto &stats = heapStatistics[m_memoryProperties.memoryTypes[typeIndex].heapIndex];
+        for (const auto &block : m_blocks[typeIndex])
+        {
+            ++stats.blockCount;
+            stats.allocationCount += block->allocationCount;
+            stats.reservedBytes += block->allocator.GetSize();
+            stats.usedBytes += block->allocator.GetUsedSize();
+            stats.freeRangeCount += block->allocator.GetFreeRangeCount();
+            stats.largestFreeRange = std::max(stats.largestFreeRange, block->allocator.GetLargestFreeRange());
+        }
+        stats.dedicatedAllocationCount += m_dedicatedCount[typeIndex];
+        stats.allocationCount += m_dedicatedCount[typeIndex];
+        stats.reservedBytes += m_dedicatedBytes[typeIndex];
+        stats.usedBytes += m_dedicatedBytes[typeIndex];
+    }
+
+    return heapStatistics;
+}
+
+bool CMemoryAllocator::HasMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags flags, VkDeviceSize size) const
+{
+    for (auto i = 0u; i != m_memoryProperties.memoryTypeCount; ++i)
+    {
+        if ((memoryTypeBits & (1 << i)) && (m_memoryProperties.memoryTypes[i].propertyFlags & flags) == flags &&
+            (size == 0 || m_budget.CanReserve(m_memoryProperties.memoryTypes[i].heapIndex, size)))
+            return true;
+    }
+    return false;
+}
+
+uint32_t CMemoryAllocator::FindMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags flags,
+                                          VkDeviceSize size) const
+{
+    auto firstMatch = VK_MAX_MEMORY_TYPES;
+    for (auto i = 0u; i != m_memoryProperties.memoryTypeCount; ++i)
+    {
+        if (memoryTypeBits & (1 << i))
+        {
+            if ((m_memoryProperties.memoryTypes[i].propertyFlags & flags) == flags)
+            {
+                if (m_budget.CanReserve(m_memoryProperties.memoryTypes[i].heapIndex, size))
+                    return i;
+                if (firstMatch == VK_MAX_MEMORY_TYPES)
+                    firstMatch = i;
+            }
+        }
+    }
+    // Every matching heap is over budget, let the driver decide whether the allocation still fits
+    if (firstMatch != VK_MAX_MEMORY_TYPES)
+        return firstMatch;
+    throw std::runtime_error("Failed to find a suitable memory type.");
+}
+
+void CMemoryAllocator::Cleanup()
+{
+    for (auto &blocks : m_blocks)
+    {
+        for (auto &block : blocks)
+        {
+            vkFreeMemory(CDevice::GetInstance().GetDevice(), block->memory, CHostAllocator::GetCallbacks());
+            m_budget.OnRelease(m_memoryProperties.memoryTypes[block->memoryTypeIndex].heapIndex,
+                               block->allocator.GetSize());
+        }
+        blocks.clear();
+    }
+}
+
+SMemoryAllocation CMemoryAllocator::AllocateDedicated(const VkMemoryRequirements &memReq, uint32_t memoryTypeIndex)
+{
+    VkMemoryAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = memReq.size;
+    allocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+    SMemoryAllocation allocation{};
+    if (const auto res = vkAllocateMemory(CDevice::GetInstance().GetDevice(), &allocateInfo,
+                                          CHostAllocator::GetCallbacks(), &allocation.memory);
+        res != VK_SUCCESS)
+        throw std::runtime_error("Failed to allocate dedicated device memory.");
+
+    allocation.size = memReq.size;
+    allocation.memoryTypeIndex = memoryTypeIndex;
+    allocation.isCoherent =
+        m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    allocation.pMapped = MapWholeMemory(allocation.memory, memoryTypeIndex);
+
+    ++m_dedicatedCount[memoryTypeIndex];
+    m_dedicatedBytes[memoryTypeIndex] += memReq.size;
+    m_budget.OnReserve(m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex, memReq.size);
+    return allocation;
+}
+
+SMemoryBlock *CMemoryAllocator::CreateBlock(uint32_t memoryTypeIndex, EResourceKind kind)
+{
+    auto block = std::make_unique<SMemoryBlock>(GetBlockSize(memoryTypeIndex));
+    block->memoryTypeIndex = memoryTypeIndex;
+    block->kind = kind;
+
+    VkMemoryAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = block->allocator.GetSize();
+    allocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+    if (const auto res = vkAllocateMemory(CDevice::GetInstance().GetDevice(), &allocateInfo,
+                                          CHostAllocator::GetCallbacks(), &block->memory);
+        res != VK_SUCCESS)
+        throw std::runtime_error("Failed to allocate device memory block.");
+    block->pMapped = MapWholeMemory(block->memory, memoryTypeIndex);
+    m_budget.OnReserve(m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex, block->allocator.GetSize());
+
+    m_blocks[memoryTypeIndex].push_back(std::move(block));
+    return m_blocks[memoryTypeIndex].back().get();
+}
+
+VkDeviceSize CMemoryAllocator::GetBlockSize(uint32_t memoryTypeIndex) const
+{
+    const auto heapIndex = m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    const auto heapSize = m_memoryProperties.memoryHeaps[heapIndex].size;
+    return heapSize <= kSmallHeapSize ? heapSize / 8 : kDefaultBlockSize;
+}
+
+void *CMemoryAllocator::MapWholeMemory(VkDeviceMemory memory, uint32_t memoryTypeIndex) const
+{
+    // Host visible memory stays mapped for its whole lifetime, vkFreeMemory implicitly unmaps it
+    if (!(m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+        return nullptr;
+
+    void *pMapped;
+    if (const auto res = vkMapMemory(CDevice::GetInstance().GetDevice(), memory, 0, VK_WHOLE_SIZE, 0, &pMapped);
+        res != VK_SUCCESS)
+        throw std::runtime_error("Failed to map device memory.");
+    return pMapped;
+}
+
+VkMemoryRequirements CMemoryAllocator::AlignToAtoms(const VkMemoryRequirements &memReq,
+                                                   uint32_t memoryTypeIndex) const
+{
+    const auto flags = m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+    if (!(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) || (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+        return memReq;
+
+    // Flushes and invalidates are widened to whole atoms, an allocation sharing an atom with its neighbour would
+    // discard or publish the neighbour's CPU writes
+    auto alignedMemReq = memReq;
+    alignedMemReq.alignment = std::max(memReq.alignment, m_nonCoherentAtomSize);
+    alignedMemReq.size = (memReq.size + m_nonCoherentAtomSize - 1) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+    return alignedMemReq;
+}
+
+VkMappedMemoryRange CMemoryAllocator::GetMappedRange(const SMemoryAllocation &allocation, VkDeviceSize offset,
+                                                     VkDeviceSize size) const
+{
+    const auto memorySize = allocation.pBlock ? allocation.pBlock->allocator.GetSize() : allocation.size;
+    const auto begin = (allocation.offset + offset) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+    const auto end = std::min(
+        (allocation.offset + offset + size + m_nonCoherentAtomSize - 1) / m_nonCoherentAtomSize * m_nonCoherentAtomSize,
+        memorySize);
+
+    VkMappedMemoryRange range{};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = allocation.memory;
+    range.offset = begin;
+    range.size = end - begin;
+    return range;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "CMemoryBudget.hpp"
+#include "COffsetAllocator.hpp"
+#include <array>
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Linear resources (buffers, linear images) and optimal images are kept in separate blocks when the device has a
+// bufferImageGranularity, so neighbours inside a block never alias the same page.
+enum class EResourceKind
+{
+    Linear,
+    Optimal
+};
+
+struct SMemoryBlock;
+
+struct SMemoryAllocation
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    // Block the allocation lives in, null for dedicated allocations
+    SMemoryBlock *pBlock = nullptr;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    uint32_t memoryTypeIndex = 0;
+    EMemoryCategory category = EMemoryCategory::Other;
+    // Persistent CPU pointer to the start of the allocation, null unless the memory is host visible
+    void *pMapped = nullptr;
+    bool isCoherent = false;
+};
+
+struct SMemoryBlock
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    void *pMapped = nullptr;
+    uint32_t memoryTypeIndex = 0;
+    EResourceKind kind = EResourceKind::Linear;
+    uint32_t allocationCount = 0;
+    COffsetAllocator allocator;
+
+    explicit SMemoryBlock(VkDeviceSize size) : allocator(size)
+    {
+    }
+};
+
+struct SHeapStatistics
+{
+    uint32_t blockCount = 0;
+    uint32_t dedicatedAllocationCount = 0;
+    uint32_t allocationCount = 0;
+    VkDeviceSize reservedBytes = 0;
+    VkDeviceSize usedBytes = 0;
+    uint32_t freeRangeCount = 0;
+    VkDeviceSize largestFreeRange = 0;
+
+    // 0 when all free space in the heap's blocks is one contiguous range, approaching 1 as it splinters
+    float Fragmentation() const
+    {
+        const auto freeBytes = reservedBytes - usedBytes;
+        return freeBytes == 0 ? 0.0f : 1.0f - static_cast<float>(largestFreeRange) / static_cast<float>(freeBytes);
+    }
+};
+
+class CMemoryAllocator
+{
+  public:
+    explicit CMemoryAllocator(VkPhysicalDevice physicalDevice);
+
+    SMemoryAllocation Allocate(const VkMemoryRequirements &memReq, VkMemoryPropertyFlags memFlags, EResourceKind kind,
+                               EMemoryCategory category);
+    void Free(SMemoryAllocation &allocation);
+    // With a size, the type's heap must also have that much budget left
+    bool HasMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags flags, VkDeviceSize size = 0) const;
+    // Cheap pre-check for Reallocate, assumes the new resource has the same size as the current one
+    bool CanReallocate(const SMemoryAllocation &allocation) const;
+    // Places a new allocation in another block of the same type and kind that is at least as full as the current one,
+    // returns false when none has room. Used by the defragmenter to empty sparse blocks.
+    bool Reallocate(const SMemoryAllocation &allocation, const VkMemoryRequirements &memReq,
+                    SMemoryAllocation &newAllocation);
+    // Frees blocks without allocations in memory types that have all of the flags, returns the bytes given back
+    VkDeviceSize ReleaseEmptyBlocks(VkMemoryPropertyFlags flags);
+
+    // Only needed for non-coherent memory, ranges are relative to the allocation and get widened to nonCoherentAtomSize
+    void Flush(const SMemoryAllocation &allocation, VkDeviceSize offset, VkDeviceSize size) const;
+    void Invalidate(const SMemoryAllocation &allocation, VkDeviceSize offset, VkDeviceSize size) const;
+
+    std::vector<SHeapStatistics> GetHeapStatistics() const;
+    // Prefers a type whose heap can still take the size within its budget, falls back to the first match
+    uint32_t FindMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags flags, VkDeviceSize size = 0) const;
+
+    CMemoryBudget &GetBudget()
+    {
+        return m_budget;
+    }
+
+    // Frees every block, must run before the device is destroyed
+    void Cleanup();
+
+  private:
+    SMemoryAllocation AllocateDedicated(const VkMemoryRequirements &memReq, uint32_t memoryTypeIndex);
+    SMemoryBlock *CreateBlock(uint32_t memoryTypeIndex, EResourceKind kind);
+    VkDeviceSize GetBlockSize(uint32_t memoryTypeIndex) const;
+    void *MapWholeMemory(VkDeviceMemory memory, uint32_t memoryTypeIndex) const;
+    // Whole nonCoherentAtomSize units for host visible memory that isn't coherent, unchanged otherwise
+    VkMemoryRequirements AlignToAtoms(const VkMemoryRequirements &memReq, uint32_t memoryTypeIndex) const;
+    VkMappedMemoryRange GetMappedRange(const SMemoryAllocation &allocation, VkDeviceSize offset,
+                                       VkDeviceSize size) const;
+
+    VkPhysicalDeviceMemoryProperties m_memoryProperties{};
+    VkDeviceSize m_bufferImageGranularity = 1;
+    VkDeviceSize m_nonCoherentAtomSize = 1;
+    CMemoryBudget m_budget;
+
+    std::array<std::vector<std::unique_ptr<SMemoryBlock>>, VK_MAX_MEMORY_TYPES> m_blocks;
+    std::array<uint32_t, VK_MAX_MEMORY_TYPES> m_dedicatedCount{};
+    std::array<VkDeviceSize, VK_MAX_MEMORY_TYPES> m_dedicatedBytes{};
+};
@@ -0,0 +1,134 @@
+#include "CMemoryBudget.hpp"
+#include "CVulkanHelpers.hpp"
+#include <algorithm>
+
+namespace
+{
+// Without the extension leave headroom for other processes and the driver's own allocations
+constexpr float kFallbackBudgetFraction = 0.8f;
+} // namespace
+
+CMemoryBudget::CMemoryBudget(VkPhysicalDevice physicalDevice) : m_physicalDevice(physicalDevice)
+{
+    m_isExtensionSupported =
+        CVulkanHelpers::CheckForVulkanInstanceExtensions(physicalDevice, {VK_EXT_MEMORY_BUDGET_EXTENSION_NAME});
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    m_heapBudgets.resize(memoryProperties.memoryHeapCount);
+    for (auto heapIndex = 0u; heapIndex != memoryProperties.memoryHeapCount; ++heapIndex)
+    {
+        auto &heapBudget = m_heapBudgets[heapIndex];
+        heapBudget.size = memoryProperties.memoryHeaps[heapIndex].size;
+        heapBudget.budget = static_cast<VkDeviceSize>(heapBudget.size * kFallbackBudgetFraction);
+    }
+}
+
+void CMemoryBudget::Update()
+{
+    if (m_isExtensionSupported)
+    {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+        memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        memoryProperties.pNext = &budgetProperties;
+        vkGetPhysicalDeviceMemoryProperties2(m_physicalDevice, &memoryProperties);
+
+        for (auto heapIndex = 0u; heapIndex != m_heapBudgets.size(); ++heapIndex)
+        {
+            auto &heapBudget = m_heapBudgets[heapIndex];
+            heapBudget.budget = budgetProperties.heapBudget[heapIndex];
+            heapBudget.usage = budgetProperties.heapUsage[heapIndex];
+        }
+    }
+    else
+    {
+        for (auto &heapBudget : m_heapBudgets)
+        {
+            heapBudget.usage = heapBudget.reservedBytes;
+        }
+    }
+
+    for (auto &callback : m_vecCallbacks)
+    {
+        for (auto heapIndex = 0u; heapIndex != m_heapBudgets.size(); ++heapIndex)
+        {
+            const auto isAbove = m_heapBudgets[heapIndex].Pressure() >= callback.threshold;
+            if (isAbove != callback.vecIsAbove[heapIndex])
+            {
+                callback.vecIsAbove[heapIndex] = isAbove;
+                callback.callback(heapIndex, m_heapBudgets[heapIndex], isAbove);
+            }
+        }
+    }
+}
+
+void CMemoryBudget::OnReserve(uint32_t heapIndex, VkDeviceSize size)
+{
+    auto &heapBudget = m_heapBudgets[heapIndex];
+    heapBudget.reservedBytes += size;
+    heapBudget.usage += size;
+}
+
+void CMemoryBudget::OnRelease(uint32_t heapIndex, VkDeviceSize size)
+{
+    auto &heapBudget = m_heapBudgets[heapIndex];
+    heapBudget.reservedBytes -= size;
+    heapBudget.usage -= std::min(heapBudget.usage, size);
+}
+
+void CMemoryBudget::OnAllocate(EMemoryCategory category, VkDeviceSize size)
+{
+    m_categoryUsage[static_cast<size_t>(category)] += size;
+}
+
+void CMemoryBudget::OnFree(EMemoryCategory category, VkDeviceSize size)
+{
+    m_categoryUsage[static_cast<size_t>(category)] -= size;
+}
+
+bool CMemoryBudget::CanReserve(uint32_t heapIndex, VkDeviceSize size) const
+{
+    const auto &heapBudget = m_heapBudgets[heapIndex];
+    return heapBudget.usage + size <= heapBudget.budget;
+}
+
+const char *CMemoryBudget::GetCategoryName(EMemoryCategory category)
+{
+    switch (category)
+    {
+    case EMemoryCategory::Geometry:
+        return "Geometry";
+    case EMemoryCategory::Texture:
+        return "Texture";
+    case EMemoryCategory::Uniform:
+        return "Uniform";
+    case EMemoryCategory::Attachment:
+        return "Attachment";
+    case EMemoryCategory::Staging:
+        return "Staging";
+    default:
+        return "Other";
+    }
+}
+
+uint32_t CMemoryBudget::AddThresholdCallback(float threshold, MemoryThresholdCallback &&callback)
+{
+    SThresholdCallback thresholdCallback{};
+    thresholdCallback.id = m_nextCallbackId++;
+    thresholdCallback.threshold = threshold;
+    thresholdCallback.callback = std::move(callback);
+    thresholdCallback.vecIsAbove.resize(m_heapBudgets.size(), false);
+    m_vecCallbacks.push_back(std::move(thresholdCallback));
+    return m_vecCallbacks.back().id;
+}
+
+void CMemoryBudget::RemoveThresholdCallback(uint32_t id)
+{
+    m_vecCallbacks.erase(std::remove_if(m_vecCallbacks.begin(), m_vecCallbacks.end(),
+                                        [id](const SThresholdCallback &callback) { return callback.id == id; }),
+                         m_vecCallbacks.end());
+}
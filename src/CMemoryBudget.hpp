@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// What an allocation is used for, only used for accounting
+enum class EMemoryCategory
+{
+    Geometry,
+    Texture,
+    Uniform,
+    Attachment,
+    Staging,
+    Other,
+    Count
+};
+
+struct SHeapBudget
+{
+    VkDeviceSize size = 0;
+    // How much the process can allocate from the heap before the driver starts paging or failing allocations
+    VkDeviceSize budget = 0;
+    // Process wide usage as last reported by the driver plus our own changes since
+    VkDeviceSize usage = 0;
+    // Device memory we allocated from the heap ourselves
+    VkDeviceSize reservedBytes = 0;
+
+    float Pressure() const
+    {
+        return budget == 0 ? 0.0f : static_cast<float>(usage) / static_cast<float>(budget);
+    }
+};
+
+// Called with the heap's current numbers whenever its pressure crosses the threshold, in either direction
+using MemoryThresholdCallback = std::function<void(uint32_t heapIndex, const SHeapBudget &heapBudget, bool isAbove)>;
+
+// Per heap budgets from VK_EXT_memory_budget (or a fraction of the heap size without it) next to our own usage per
+// category. Update is called once a frame, threshold callbacks fire from there.
+class CMemoryBudget
+{
+  public:
+    explicit CMemoryBudget(VkPhysicalDevice physicalDevice);
+
+    bool IsExtensionSupported() const
+    {
+        return m_isExtensionSupported;
+    }
+
+    void Update();
+
+    // Device memory allocations, per heap
+    void OnReserve(uint32_t heapIndex, VkDeviceSize size);
+    void OnRelease(uint32_t heapIndex, VkDeviceSize size);
+    // Resource allocations, per category
+    void OnAllocate(EMemoryCategory category, VkDeviceSize size);
+    void OnFree(EMemoryCategory category, VkDeviceSize size);
+
+    bool CanReserve(uint32_t heapIndex, VkDeviceSize size) const;
+
+    uint32_t GetHeapCount() const
+    {
+        return static_cast<uint32_t>(m_heapBudgets.size());
+    }
+
+    const SHeapBudget &GetHeapBudget(uint32_t heapIndex) const
+    {
+        return m_heapBudgets[heapIndex];
+    }
+
+    VkDeviceSize GetCategoryUsage(EMemoryCategory category) const
+    {
+        return m_categoryUsage[static_cast<size_t>(category)];
+    }
+
+    static const char *GetCategoryName(EMemoryCategory category);
+
+    // Threshold is a fraction of the heap budget, returns an id for RemoveThresholdCallback
+    uint32_t AddThresholdCallback(float threshold, MemoryThresholdCallback &&callback);
+    void RemoveThresholdCallback(uint32_t id);
+
+  private:
+    struct SThresholdCallback
+    {
+        uint32_t id;
+        float threshold;
+        MemoryThresholdCallback callback;
+        // Which side of the threshold each heap was on at the last update
+        std::vector<bool> vecIsAbove;
+    };
+
+    VkPhysicalDevice m_physicalDevice;
+    bool m_isExtensionSupported = false;
+
+    // Usage is refreshed by Update and moved by our own reservations in between
+    std::vector<SHeapBudget> m_heapBudgets;
+    std::array<VkDeviceSize, static_cast<size_t>(EMemoryCategory::Count)> m_categoryUsage{};
+
+    uint32_t m_nextCallbackId = 1;
+    std::vector<SThresholdCallback> m_vecCallbacks;
+};
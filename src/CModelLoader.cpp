@@ -25,6 +25,7 @@ SMesh CModelLoader::LoadObjModel(std::string objFile)
     // TODO this only takes the first shape
     SMesh mesh;
     mesh.vertices.resize(attrib.vertices.size() / 3);
+    mesh.positions.resize(mesh.vertices.size());
     mesh.indices.resize(shapes[0].mesh.indices.size());
     mesh.name = shapes[0].name;
 
@@ -55,6 +56,7 @@ SMesh CModelLoader::LoadObjModel(std::string objFile)
                 vertex.uv = {tx, ty};
 
                 mesh.vertices[ind.vertex_index] = vertex;
+                mesh.positions[ind.vertex_index] = vertex.position;
                 mesh.indices[indexIndex++] = ind.vertex_index;
             }
             index_offset += fv;
@@ -10,6 +10,7 @@ class CObject
 {
   public:
     virtual void UpdateUniformBuffers() = 0;
-    virtual void Draw() const = 0;
+    // May run on a recording thread, only the command buffer is written
+    virtual void Draw(VkCommandBuffer cmdBuffer) const = 0;
     virtual void ObjectCleanup() = 0;
 };
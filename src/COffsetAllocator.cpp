@@ -0,0 +1,85 @@
+#include "COffsetAllocator.hpp"
+#include <algorithm>
+
+COffsetAllocator::COffsetAllocator(VkDeviceSize size) : m_size(size)
+{
+    m_freeRanges.emplace(0, size);
+}
+
+bool COffsetAllocator::Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset)
+{
+    if (size == 0)
+        return false;
+    alignment = std::max<VkDeviceSize>(alignment, 1);
+
+    // Find the smallest free range that still fits the request after alignment
+    auto bestRange = m_freeRanges.end();
+    for (auto it = m_freeRanges.begin(); it != m_freeRanges.end(); ++it)
+    {
+        const auto alignedOffset = (it->first + alignment - 1) / alignment * alignment;
+        const auto padding = alignedOffset - it->first;
+        if (padding + size > it->second)
+            continue;
+
+        if (bestRange == m_freeRanges.end() || it->second < bestRange->second)
+        {
+            bestRange = it;
+            if (it->second == padding + size)
+                break;
+        }
+    }
+    if (bestRange == m_freeRanges.end())
+        return false;
+
+    const auto rangeOffset = bestRange->first;
+    const auto rangeSize = bestRange->second;
+    const auto alignedOffset = (rangeOffset + alignment - 1) / alignment * alignment;
+    const auto padding = alignedOffset - rangeOffset;
+    m_freeRanges.erase(bestRange);
+
+    // Alignment padding and the tail stay free
+    if (padding > 0)
+        m_freeRanges.emplace(rangeOffset, padding);
+    if (const auto tail = rangeSize - padding - size; tail > 0)
+        m_freeRanges.emplace(alignedOffset + size, tail);
+
+    m_usedSize += size;
+    offset = alignedOffset;
+    return true;
+}
+
+void COffsetAllocator::Free(VkDeviceSize offset, VkDeviceSize size)
+{
+    if (size == 0)
+        return;
+
+    auto it = m_freeRanges.emplace(offset, size).first;
+
+    // Merge with the following range
+    if (const auto next = std::next(it); next != m_freeRanges.end() && it->first + it->second == next->first)
+    {
+        it->second += next->second;
+        m_freeRanges.erase(next);
+    }
+    // Merge with the preceding range
+    if (it != m_freeRanges.begin())
+    {
+        if (const auto prev = std::prev(it); prev->first + prev->second == it->first)
+        {
+            prev->second += it->second;
+            m_freeRanges.erase(it);
+        }
+    }
+
+    m_usedSize -= size;
+}
+
+VkDeviceSize COffsetAllocator::GetLargestFreeRange() const
+{
+    VkDeviceSize largest = 0;
+    for (const auto &[offset, size] : m_freeRanges)
+    {
+        largest = std::max(largest, size);
+    }
+    return largest;
+}
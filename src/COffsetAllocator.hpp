@@ -0,0 +1,44 @@
+#pragma once
+
+#include <map>
+#include <vulkan/vulkan.h>
+
+// Best-fit free-list allocator over a [0, size) range. Knows nothing about Vulkan objects, it only hands out
+// offsets, so it can back memory blocks as well as ranges inside a single buffer.
+class COffsetAllocator
+{
+  public:
+    explicit COffsetAllocator(VkDeviceSize size);
+
+    // Returns false if no free range can hold the aligned request
+    bool Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset);
+    void Free(VkDeviceSize offset, VkDeviceSize size);
+
+    VkDeviceSize GetSize() const
+    {
+        return m_size;
+    }
+
+    VkDeviceSize GetUsedSize() const
+    {
+        return m_usedSize;
+    }
+
+    bool IsEmpty() const
+    {
+        return m_usedSize == 0;
+    }
+
+    uint32_t GetFreeRangeCount() const
+    {
+        return static_cast<uint32_t>(m_freeRanges.size());
+    }
+
+    VkDeviceSize GetLargestFreeRange() const;
+
+  private:
+    VkDeviceSize m_size;
+    VkDeviceSize m_usedSize = 0;
+    // Offset -> size of every free range, kept coalesced
+    std::map<VkDeviceSize, VkDeviceSize> m_freeRanges;
+};
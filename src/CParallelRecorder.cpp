@@ -0,0 +1,140 @@
+#include "CParallelRecorder.hpp"
+#include "CCommandPoolManager.hpp"
+#include "CDevice.hpp"
+#include "vkStructs.hpp"
+#include <algorithm>
+
+using namespace vkTools;
+
+namespace
+{
+// Below this a thread spends more time waking up than recording
+constexpr uint32_t kMinDrawsPerThread = 256;
+} // namespace
+
+CParallelRecorder::CParallelRecorder(uint32_t frameCount, uint32_t threadCount) : m_vecRecordedBuffers(frameCount)
+{
+    for (auto threadIndex = 1u; threadIndex < threadCount; ++threadIndex)
+        m_vecWorkers.emplace_back([this, threadIndex]() { WorkerLoop(threadIndex); });
+}
+
+void CParallelRecorder::BeginFrame(uint32_t frameIndex)
+{
+    m_vecRecordedBuffers[frameIndex].clear();
+}
+
+void CParallelRecorder::Record(uint32_t frameIndex, VkRenderPass renderPass, uint32_t drawCount,
+                               const DrawFunction &drawFunction)
+{
+    if (drawCount == 0)
+        return;
+
+    const auto threadCount = GetThreadCount();
+    const auto rangeCount = std::clamp((drawCount + kMinDrawsPerThread - 1) / kMinDrawsPerThread, 1u, threadCount);
+    {
+        std::lock_guard lock(m_mutex);
+        m_frameIndex = frameIndex;
+        m_renderPass = renderPass;
+        m_drawCount = drawCount;
+        m_rangeCount = rangeCount;
+        m_rangeSize = (drawCount + rangeCount - 1) / rangeCount;
+        mp_drawFunction = &drawFunction;
+        m_vecRangeBuffers.assign(rangeCount, VK_NULL_HANDLE);
+        m_pendingRanges = rangeCount - 1;
+        m_exception = nullptr;
+        ++m_generation;
+    }
+    if (rangeCount > 1)
+        m_workAvailable.notify_all();
+
+    // The calling thread records the first range while the workers record the others
+    std::exception_ptr exception;
+    try
+    {
+        RecordRange(0);
+    }
+    catch (...)
+    {
+        exception = std::current_exception();
+    }
+
+    std::unique_lock lock(m_mutex);
+    m_workDone.wait(lock, [this]() { return m_pendingRanges == 0; });
+    mp_drawFunction = nullptr;
+    if (!exception)
+        exception = m_exception;
+    if (exception)
+        std::rethrow_exception(exception);
+
+    auto &vecRecordedBuffers = m_vecRecordedBuffers[frameIndex];
+    vecRecordedBuffers.insert(vecRecordedBuffers.end(), m_vecRangeBuffers.begin(), m_vecRangeBuffers.end());
+}
+
+void CParallelRecorder::Cleanup()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_isStopping = true;
+    }
+    m_workAvailable.notify_all();
+    for (auto &worker : m_vecWorkers)
+        worker.join();
+    m_vecWorkers.clear();
+    m_vecRecordedBuffers.clear();
+}
+
+void CParallelRecorder::WorkerLoop(uint32_t threadIndex)
+{
+    uint64_t seenGeneration = 0;
+    while (true)
+    {
+        {
+            std::unique_lock lock(m_mutex);
+            m_workAvailable.wait(lock, [&]() { return m_isStopping || m_generation != seenGeneration; });
+            if (m_isStopping)
+                return;
+            seenGeneration = m_generation;
+            if (threadIndex >= m_rangeCount)
+                continue;
+        }
+
+        std::exception_ptr exception;
+        try
+        {
+            RecordRange(threadIndex);
+        }
+        catch (...)
+        {
+            exception = std::current_exception();
+        }
+
+        {
+            std::lock_guard lock(m_mutex);
+            if (exception && !m_exception)
+                m_exception = exception;
+            --m_pendingRanges;
+        }
+        m_workDone.notify_one();
+    }
+}
+
+void CParallelRecorder::RecordRange(uint32_t threadIndex)
+{
+    const auto cmdBuffer = CDevice::GetInstance().GetCommandPoolManager().Acquire(
+        ECommandPoolSet::Scene, m_frameIndex, threadIndex, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+    m_vecRangeBuffers[threadIndex] = cmdBuffer;
+    const auto inheritanceInfo = vkStructs::CommandBufferInheritanceInfo(m_renderPass);
+    // Not one-time, the command cache may replay the recording
+    auto beginInfo = vkStructs::CommandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuffer, &beginInfo))
+
+    // Secondaries inherit no state from the primary or from each other
+    CDevice::GetInstance().BindSceneState(cmdBuffer);
+    const auto first = threadIndex * m_rangeSize;
+    const auto end = std::min(first + m_rangeSize, m_drawCount);
+    for (auto index = first; index < end; ++index)
+        (*mp_drawFunction)(cmdBuffer, index);
+
+    VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuffer))
+}
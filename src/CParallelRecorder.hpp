@@ -0,0 +1,68 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Records a list of draws on several threads. The draws are split into contiguous ranges, every thread records its
+// range into its own secondary command buffer from its pool of the Scene pool set (see CCommandPoolManager), so no
+// recording state is shared. The calling thread takes the first range and waits for the workers, the buffers are
+// returned in range order so the primary executes the draws in the same order a serial recording would.
+class CParallelRecorder
+{
+  public:
+    // Records the draw at index into the command buffer, called concurrently for different indices
+    using DrawFunction = std::function<void(VkCommandBuffer cmdBuffer, uint32_t index)>;
+
+    // Threads includes the calling thread
+    CParallelRecorder(uint32_t frameCount, uint32_t threadCount);
+
+    // Forgets the frame's previous recording, the frame's Scene pool set must have been reset
+    void BeginFrame(uint32_t frameIndex);
+    // Each secondary starts with the scene state bound, see CDevice::BindSceneState. Blocks until every range is done.
+    void Record(uint32_t frameIndex, VkRenderPass renderPass, uint32_t drawCount, const DrawFunction &drawFunction);
+    // The secondaries of the frame's latest recording in draw order
+    const std::vector<VkCommandBuffer> &GetCommandBuffers(uint32_t frameIndex) const
+    {
+        return m_vecRecordedBuffers[frameIndex];
+    }
+
+    uint32_t GetThreadCount() const
+    {
+        return static_cast<uint32_t>(m_vecWorkers.size()) + 1;
+    }
+
+    // Stops the workers
+    void Cleanup();
+
+  private:
+    void WorkerLoop(uint32_t threadIndex);
+    void RecordRange(uint32_t threadIndex);
+
+    // Per frame in flight
+    std::vector<std::vector<VkCommandBuffer>> m_vecRecordedBuffers;
+    // Per range of the current job, each written only by the thread recording it
+    std::vector<VkCommandBuffer> m_vecRangeBuffers;
+    std::vector<std::thread> m_vecWorkers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_workDone;
+    uint64_t m_generation = 0;
+    uint32_t m_pendingRanges = 0;
+    bool m_isStopping = false;
+    std::exception_ptr m_exception;
+
+    // The job of the current generation, only written while no worker records
+    uint32_t m_frameIndex = 0;
+    VkRenderPass m_renderPass = VK_NULL_HANDLE;
+    uint32_t m_drawCount = 0;
+    uint32_t m_rangeCount = 0;
+    uint32_t m_rangeSize = 0;
+    const DrawFunction *mp_drawFunction = nullptr;
+};
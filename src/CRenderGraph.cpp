@@ -0,0 +1,606 @@
+#include "CRenderGraph.hpp"
+#include "CBufferImageManager.hpp"
+#include "CDevice.hpp"
+#include "CHostAllocator.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+constexpr VkAccessFlags kWriteAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                       VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT |
+                                       VK_ACCESS_TRANSFER_WRITE_BIT;
+constexpr VkImageUsageFlags kAttachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                               VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                                               VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+constexpr VkPipelineStageFlags kDepthStages =
+    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+// Every stage and access an image use of a pass can have, see CollectUses
+constexpr VkPipelineStageFlags kPassStages =
+    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | kDepthStages | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+constexpr VkAccessFlags kPassAccess = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                                      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+VkAttachmentLoadOp GetLoadOp(EGraphLoad load)
+{
+    switch (load)
+    {
+    case EGraphLoad::Clear:
+        return VK_ATTACHMENT_LOAD_OP_CLEAR;
+    case EGraphLoad::Load:
+        return VK_ATTACHMENT_LOAD_OP_LOAD;
+    default:
+        return VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    }
+}
+} // namespace
+
+CRenderGraph::CRenderGraph() : mp_transientImages(std::make_unique<STransientImages>())
+{
+}
+
+CRenderGraph::~CRenderGraph() = default;
+
+SGraphImage CRenderGraph::ImportImage(const std::string &name, VkFormat format, VkImageLayout finalLayout)
+{
+    SImage image{};
+    image.name = name;
+    image.format = format;
+    image.isImported = true;
+    image.finalLayout = finalLayout;
+    m_vecImages.push_back(std::move(image));
+    return {static_cast<uint32_t>(m_vecImages.size() - 1)};
+}
+
+SGraphImage CRenderGraph::CreateImage(const std::string &name, VkFormat format, VkImageUsageFlags extraUsage)
+{
+    SImage image{};
+    image.name = name;
+    image.format = format;
+    image.usage = extraUsage;
+    m_vecImages.push_back(std::move(image));
+    return {static_cast<uint32_t>(m_vecImages.size() - 1)};
+}
+
+void CRenderGraph::AddPass(SGraphPassDesc &&desc)
+{
+    SPass pass{};
+    pass.desc = std::move(desc);
+    m_vecPasses.push_back(std::move(pass));
+}
+
+void CRenderGraph::MarkOutput(SGraphImage image)
+{
+    m_vecImages.at(image.index).isOutput = true;
+}
+
+void CRenderGraph::Compile()
+{
+    for (auto &pass : m_vecPasses)
+        CollectUses(pass);
+
+    // A pure reader needs every writer of the image, a writer only the ones declared before it. Only reads keep a
+    // pass alive, a pass that is merely ordered after another one doesn't need its output.
+    const auto passCount = static_cast<uint32_t>(m_vecPasses.size());
+    PassDependencies vecReadDependencies(passCount);
+    PassDependencies vecDependencies(passCount);
+    for (auto passIndex = 0u; passIndex != passCount; ++passIndex)
+    {
+        for (const auto &use : m_vecPasses[passIndex].vecUses)
+        {
+            for (auto writerIndex = 0u; writerIndex != passCount; ++writerIndex)
+            {
+                const auto &vecWriterUses = m_vecPasses[writerIndex].vecUses;
+                const auto isWriter =
+                    std::any_of(vecWriterUses.begin(), vecWriterUses.end(), [&use](const SImageUse &other) {
+                        return other.imageIndex == use.imageIndex && other.isWrite;
+                    });
+                if (writerIndex == passIndex || !isWriter || (use.isWrite && writerIndex > passIndex))
+                    continue;
+                vecDependencies[passIndex].push_back(writerIndex);
+                if (use.isRead)
+                    vecReadDependencies[passIndex].push_back(writerIndex);
+            }
+        }
+    }
+
+    CullPasses(vecReadDependencies);
+    SortPasses(vecDependencies);
+
+    m_vecImageUses.assign(m_vecImages.size(), {});
+    for (auto orderIndex = 0u; orderIndex != m_vecOrder.size(); ++orderIndex)
+    {
+        const auto &vecUses = m_vecPasses[m_vecOrder[orderIndex]].vecUses;
+        for (auto useIndex = 0u; useIndex != vecUses.size(); ++useIndex)
+        {
+            m_vecImages[vecUses[useIndex].imageIndex].usage |= vecUses[useIndex].usage;
+            m_vecImageUses[vecUses[useIndex].imageIndex].emplace_back(orderIndex, useIndex);
+        }
+    }
+
+    m_transientLastStages = 0;
+    m_transientLastWrites = 0;
+    for (auto imageIndex = 0u; imageIndex != m_vecImages.size(); ++imageIndex)
+    {
+        if (m_vecImages[imageIndex].isImported || m_vecImageUses[imageIndex].empty())
+            continue;
+        const auto [orderIndex, useIndex] = m_vecImageUses[imageIndex].back();
+        const auto &lastUse = m_vecPasses[m_vecOrder[orderIndex]].vecUses[useIndex];
+        m_transientLastStages |= lastUse.stageMask;
+        m_transientLastWrites |= lastUse.accessMask & kWriteAccess;
+    }
+
+    m_statistics = {};
+    m_statistics.livePasses = static_cast<uint32_t>(m_vecOrder.size());
+    m_statistics.culledPasses = passCount - m_statistics.livePasses;
+    for (auto orderIndex = 0u; orderIndex != m_vecOrder.size(); ++orderIndex)
+        CreateRenderPass(orderIndex);
+}
+
+void CRenderGraph::SetImportedViews(SGraphImage image, const std::vector<VkImageView> &vecViews)
+{
+    auto &importedImage = m_vecImages.at(image.index);
+    if (!importedImage.isImported)
+        throw std::runtime_error("Render graph image '" + importedImage.name + "' isn't imported.");
+    importedImage.vecImportedViews = vecViews;
+}
+
+void CRenderGraph::CreateResources(VkExtent2D extent)
+{
+    DestroyResources(true);
+    m_extent = extent;
+
+    const auto &bufferImageManager = CDevice::GetInstance().GetBufferImageManager();
+    std::vector<STransientImageDesc> vecDescs;
+    for (auto imageIndex = 0u; imageIndex != m_vecImages.size(); ++imageIndex)
+    {
+        auto &image = m_vecImages[imageIndex];
+        const auto &vecImageUses = m_vecImageUses[imageIndex];
+        if (image.isImported || vecImageUses.empty())
+            continue;
+
+        STransientImageDesc desc{};
+        desc.createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        desc.createInfo.imageType = VK_IMAGE_TYPE_2D;
+        desc.createInfo.format = image.format;
+        desc.createInfo.extent = {extent.width, extent.height, 1};
+        desc.createInfo.mipLevels = 1;
+        desc.createInfo.arrayLayers = 1;
+        desc.createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        desc.createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        desc.createInfo.usage = image.usage;
+        desc.createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        desc.createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        // Attachments that are never read back after their pass can stay in tile memory
+        const auto isReadLater = std::any_of(vecImageUses.begin() + 1, vecImageUses.end(), [this](const auto &entry) {
+            return m_vecPasses[m_vecOrder[entry.first]].vecUses[entry.second].isRead;
+        });
+        if (!(image.usage & ~kAttachmentUsage) && !isReadLater)
+            desc.createInfo.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        desc.firstPass = vecImageUses.front().first;
+        desc.lastPass = vecImageUses.back().first;
+
+        image.transientIndex = static_cast<uint32_t>(vecDescs.size());
+        vecDescs.push_back(desc);
+    }
+    bufferImageManager.CreateTransientImages(vecDescs, *mp_transientImages);
+
+    m_statistics.transientImages = static_cast<uint32_t>(mp_transientImages->vecImages.size());
+    m_statistics.transientAllocations = static_cast<uint32_t>(mp_transientImages->vecAllocations.size());
+    m_statistics.transientBytes = 0;
+    m_statistics.unaliasedBytes = 0;
+    for (const auto &allocation : mp_transientImages->vecAllocations)
+        m_statistics.transientBytes += allocation.size;
+    for (const auto &imageHandles : mp_transientImages->vecImages)
+    {
+        VkMemoryRequirements memReq;
+        vkGetImageMemoryRequirements(CDevice::GetInstance().GetDevice(), imageHandles.image, &memReq);
+        m_statistics.unaliasedBytes += memReq.size;
+    }
+
+    for (const auto passIndex : m_vecOrder)
+    {
+        auto &pass = m_vecPasses[passIndex];
+        // Sampled images are not part of the framebuffer
+        std::vector<const SImage *> vecAttachmentImages;
+        size_t viewCount = 1;
+        for (const auto &use : pass.vecUses)
+        {
+            if (!use.isAttachment)
+                continue;
+            const auto &image = m_vecImages[use.imageIndex];
+            vecAttachmentImages.push_back(&image);
+            if (!image.isImported)
+                continue;
+            if (image.vecImportedViews.empty() || (viewCount > 1 && image.vecImportedViews.size() != viewCount))
+                throw std::runtime_error("Render graph image '" + image.name + "' has no matching imported views.");
+            viewCount = image.vecImportedViews.size();
+        }
+
+        pass.vecFramebuffers.resize(viewCount);
+        for (auto viewIndex = 0u; viewIndex != viewCount; ++viewIndex)
+        {
+            std::vector<VkImageView> vecViews;
+            for (const auto *pImage : vecAttachmentImages)
+            {
+                const auto &vecTransients = mp_transientImages->vecImages;
+                vecViews.push_back(pImage->isImported ? pImage->vecImportedViews[viewIndex]
+                                                      : vecTransients[pImage->transientIndex].imageView);
+            }
+
+            VkFramebufferCreateInfo createInfo{};
+            createInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            createInfo.renderPass = pass.renderPass;
+            createInfo.attachmentCount = static_cast<uint32_t>(vecViews.size());
+            createInfo.pAttachments = vecViews.data();
+            createInfo.width = extent.width;
+            createInfo.height = extent.height;
+            createInfo.layers = 1;
+            if (vkCreateFramebuffer(CDevice::GetInstance().GetDevice(), &createInfo, CHostAllocator::GetCallbacks(),
+                                    &pass.vecFramebuffers[viewIndex]) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create render graph framebuffer.");
+        }
+    }
+}
+
+void CRenderGraph::Execute(VkCommandBuffer cmdBuffer, uint32_t importedViewIndex)
+{
+    for (const auto passIndex : m_vecOrder)
+    {
+        const auto &pass = m_vecPasses[passIndex];
+        VkRenderPassBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        beginInfo.renderPass = pass.renderPass;
+        beginInfo.framebuffer = pass.vecFramebuffers[pass.vecFramebuffers.size() > 1 ? importedViewIndex : 0];
+        beginInfo.renderArea.offset = {0, 0};
+        beginInfo.renderArea.extent = pass.desc.extentFunction ? pass.desc.extentFunction() : m_extent;
+        beginInfo.clearValueCount = static_cast<uint32_t>(pass.vecClearValues.size());
+        beginInfo.pClearValues = pass.vecClearValues.data();
+        const auto contents =
+            pass.desc.contentsFunction ? pass.desc.contentsFunction() : VK_SUBPASS_CONTENTS_INLINE;
+
+        vkCmdBeginRenderPass(cmdBuffer, &beginInfo, contents);
+        if (pass.desc.recordFunction)
+            pass.desc.recordFunction(cmdBuffer);
+        vkCmdEndRenderPass(cmdBuffer);
+    }
+}
+
+void CRenderGraph::ReleaseResources()
+{
+    DestroyResources(true);
+    m_extent = {};
+}
+
+VkRenderPass CRenderGraph::GetRenderPass(const std::string &passName) const
+{
+    const auto pass = std::find_if(m_vecPasses.begin(), m_vecPasses.end(),
+                                   [&passName](const SPass &pass) { return pass.desc.name == passName; });
+    if (pass == m_vecPasses.end())
+        throw std::runtime_error("Render graph has no pass '" + passName + "'.");
+    return pass->renderPass;
+}
+
+VkImageView CRenderGraph::GetImageView(SGraphImage image) const
+{
+    const auto &graphImage = m_vecImages.at(image.index);
+    if (graphImage.isImported || graphImage.transientIndex == UINT32_MAX)
+        return VK_NULL_HANDLE;
+    return mp_transientImages->vecImages[graphImage.transientIndex].imageView;
+}
+
+void CRenderGraph::Cleanup()
+{
+    DestroyResources(false);
+    for (auto &pass : m_vecPasses)
+    {
+        vkDestroyRenderPass(CDevice::GetInstance().GetDevice(), pass.renderPass, CHostAllocator::GetCallbacks());
+        pass.renderPass = VK_NULL_HANDLE;
+    }
+}
+
+void CRenderGraph::CollectUses(SPass &pass) const
+{
+    pass.vecUses.clear();
+    pass.vecClearValues.clear();
+    const auto addUse = [this, &pass](SGraphImage image, const SImageUse &use) {
+        if (image.index >= m_vecImages.size())
+            throw std::runtime_error("Render graph pass '" + pass.desc.name + "' uses an undeclared image.");
+        const auto isUsed = std::any_of(pass.vecUses.begin(), pass.vecUses.end(),
+                                        [&image](const SImageUse &other) { return other.imageIndex == image.index; });
+        if (isUsed)
+            throw std::runtime_error("Render graph pass '" + pass.desc.name + "' uses '" +
+                                     m_vecImages[image.index].name + "' more than once.");
+        pass.vecUses.push_back(use);
+        pass.vecUses.back().imageIndex = image.index;
+    };
+
+    for (const auto &attachment : pass.desc.vecColorAttachments)
+    {
+        SImageUse use{};
+        use.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        use.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        use.stageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        use.isAttachment = true;
+        use.isWrite = true;
+        use.isRead = attachment.load == EGraphLoad::Load;
+        use.accessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | (use.isRead ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT : 0);
+        addUse(attachment.image, use);
+        pass.vecClearValues.push_back(attachment.clearValue);
+    }
+
+    if (const auto &attachment = pass.desc.depthAttachment; attachment.image.IsValid())
+    {
+        if (attachment.isReadOnly && attachment.load != EGraphLoad::Load)
+            throw std::runtime_error("Render graph pass '" + pass.desc.name + "' has to load its read-only depth.");
+        SImageUse use{};
+        use.layout = attachment.isReadOnly ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                                           : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        use.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        use.stageMask = kDepthStages;
+        use.accessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                         (attachment.isReadOnly ? 0 : VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+        use.isAttachment = true;
+        use.isWrite = !attachment.isReadOnly;
+        use.isRead = attachment.load == EGraphLoad::Load;
+        addUse(attachment.image, use);
+        pass.vecClearValues.push_back(attachment.clearValue);
+    }
+
+    for (const auto image : pass.desc.vecSampledImages)
+    {
+        SImageUse use{};
+        use.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        use.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+        use.stageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        use.accessMask = VK_ACCESS_SHADER_READ_BIT;
+        use.isRead = true;
+        addUse(image, use);
+    }
+}
+
+void CRenderGraph::CullPasses(const PassDependencies &vecReadDependencies)
+{
+    std::vector<uint32_t> vecPending;
+    for (auto passIndex = 0u; passIndex != m_vecPasses.size(); ++passIndex)
+    {
+        auto &pass = m_vecPasses[passIndex];
+        pass.isLive = std::any_of(pass.vecUses.begin(), pass.vecUses.end(), [this](const SImageUse &use) {
+            return use.isWrite && m_vecImages[use.imageIndex].isOutput;
+        });
+        if (pass.isLive)
+            vecPending.push_back(passIndex);
+    }
+
+    while (!vecPending.empty())
+    {
+        const auto passIndex = vecPending.back();
+        vecPending.pop_back();
+        for (const auto dependency : vecReadDependencies[passIndex])
+        {
+            if (m_vecPasses[dependency].isLive)
+                continue;
+            m_vecPasses[dependency].isLive = true;
+            vecPending.push_back(dependency);
+        }
+    }
+}
+
+void CRenderGraph::SortPasses(const PassDependencies &vecDependencies)
+{
+    // Kahn's algorithm, always taking the earliest declared pass that is ready
+    std::vector<uint32_t> vecWaitingCounts(m_vecPasses.size(), 0);
+    for (auto passIndex = 0u; passIndex != m_vecPasses.size(); ++passIndex)
+    {
+        if (!m_vecPasses[passIndex].isLive)
+            continue;
+        for (const auto dependency : vecDependencies[passIndex])
+            vecWaitingCounts[passIndex] += m_vecPasses[dependency].isLive ? 1 : 0;
+    }
+
+    m_vecOrder.clear();
+    std::vector<bool> vecIsOrdered(m_vecPasses.size(), false);
+    while (true)
+    {
+        auto next = UINT32_MAX;
+        for (auto passIndex = 0u; passIndex != m_vecPasses.size() && next == UINT32_MAX; ++passIndex)
+        {
+            if (m_vecPasses[passIndex].isLive && !vecIsOrdered[passIndex] && vecWaitingCounts[passIndex] == 0)
+                next = passIndex;
+        }
+        if (next == UINT32_MAX)
+            break;
+
+        vecIsOrdered[next] = true;
+        m_vecOrder.push_back(next);
+        for (auto passIndex = 0u; passIndex != m_vecPasses.size(); ++passIndex)
+        {
+            const auto &vecPassDependencies = vecDependencies[passIndex];
+            if (m_vecPasses[passIndex].isLive)
+                vecWaitingCounts[passIndex] -=
+                    static_cast<uint32_t>(std::count(vecPassDependencies.begin(), vecPassDependencies.end(), next));
+        }
+    }
+
+    const auto liveCount =
+        std::count_if(m_vecPasses.begin(), m_vecPasses.end(), [](const SPass &pass) { return pass.isLive; });
+    if (m_vecOrder.size() != static_cast<size_t>(liveCount))
+        throw std::runtime_error("Render graph passes depend on each other in a cycle.");
+}
+
+void CRenderGraph::CreateRenderPass(uint32_t orderIndex)
+{
+    auto &pass = m_vecPasses[m_vecOrder[orderIndex]];
+
+    std::vector<VkAttachmentDescription> vecAttachments;
+    std::vector<VkAttachmentReference> vecColorReferences;
+    VkAttachmentReference depthReference{};
+    auto hasDepth = false;
+
+    // Everything the pass has to wait for, and what has to wait for transitions at its end
+    VkSubpassDependency incoming{};
+    incoming.srcSubpass = VK_SUBPASS_EXTERNAL;
+    incoming.dstSubpass = 0;
+    VkSubpassDependency outgoing{};
+    outgoing.srcSubpass = 0;
+    outgoing.dstSubpass = VK_SUBPASS_EXTERNAL;
+
+    for (auto useIndex = 0u; useIndex != pass.vecUses.size(); ++useIndex)
+    {
+        const auto &use = pass.vecUses[useIndex];
+        const auto &image = m_vecImages[use.imageIndex];
+        const auto &vecImageUses = m_vecImageUses[use.imageIndex];
+        const auto position =
+            std::find(vecImageUses.begin(), vecImageUses.end(), std::make_pair(orderIndex, useIndex)) -
+            vecImageUses.begin();
+        const auto getUse = [this, &vecImageUses](size_t index) -> const SImageUse & {
+            return m_vecPasses[m_vecOrder[vecImageUses[index].first]].vecUses[vecImageUses[index].second];
+        };
+        const auto *pPrevious = position > 0 ? &getUse(position - 1) : nullptr;
+        const auto hasNext = position + 1 < static_cast<ptrdiff_t>(vecImageUses.size());
+        const auto *pNext = hasNext ? &getUse(position + 1) : nullptr;
+
+        if (!pPrevious && use.isRead)
+            throw std::runtime_error("Render graph pass '" + pass.desc.name + "' reads '" + image.name +
+                                     "' before any pass writes it.");
+
+        if (pPrevious)
+        {
+            // Reads after reads in the same layout don't race
+            if (pPrevious->isWrite || use.isWrite)
+            {
+                incoming.srcStageMask |= pPrevious->stageMask;
+                incoming.srcAccessMask |= pPrevious->accessMask & kWriteAccess;
+                incoming.dstStageMask |= use.stageMask;
+                incoming.dstAccessMask |= use.accessMask;
+            }
+        }
+        else
+        {
+            // Imported images are handed over by the swapchain acquire, transient ones may share memory with any
+            // other transient image or still be in use by the previous frame
+            incoming.srcStageMask |= image.isImported
+                                         ? VkPipelineStageFlags{VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT}
+                                         : m_transientLastStages;
+            incoming.srcAccessMask |= image.isImported ? 0 : m_transientLastWrites;
+            incoming.dstStageMask |= use.stageMask;
+            incoming.dstAccessMask |= use.accessMask;
+        }
+
+        if (!use.isAttachment)
+            continue;
+
+        const auto isNextRead = pNext && pNext->isRead;
+        VkAttachmentDescription description{};
+        description.format = image.format;
+        description.samples = VK_SAMPLE_COUNT_1_BIT;
+        // Colour attachments come first in vecUses, like in the description
+        const auto &attachment = useIndex < pass.desc.vecColorAttachments.size()
+                                     ? pass.desc.vecColorAttachments[useIndex]
+                                     : pass.desc.depthAttachment;
+        description.loadOp = GetLoadOp(attachment.load);
+        description.storeOp =
+            isNextRead || (!pNext && (image.isImported || image.isOutput)) ? VK_ATTACHMENT_STORE_OP_STORE
+                                                                          : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        // An attachment is already in this layout unless the previous use only sampled it
+        description.initialLayout = !use.isRead              ? VK_IMAGE_LAYOUT_UNDEFINED
+                                    : pPrevious->isAttachment ? use.layout
+                                                              : pPrevious->layout;
+        description.finalLayout = isNextRead                           ? pNext->layout
+                                  : !pNext && image.isImported ? image.finalLayout
+                                                               : use.layout;
+
+        if (description.finalLayout != use.layout)
+        {
+            outgoing.srcStageMask |= use.stageMask;
+            outgoing.srcAccessMask |= use.accessMask & kWriteAccess;
+            outgoing.dstStageMask |=
+                isNextRead ? pNext->stageMask : VkPipelineStageFlags{VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT};
+            outgoing.dstAccessMask |= isNextRead ? pNext->accessMask : 0;
+        }
+
+        VkAttachmentReference reference{};
+        reference.attachment = static_cast<uint32_t>(vecAttachments.size());
+        reference.layout = use.layout;
+        vecAttachments.push_back(description);
+        if (use.layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+        {
+            vecColorReferences.push_back(reference);
+        }
+        else
+        {
+            depthReference = reference;
+            hasDepth = true;
+        }
+    }
+
+    VkSubpassDescription subpassDescription{};
+    subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpassDescription.colorAttachmentCount = static_cast<uint32_t>(vecColorReferences.size());
+    subpassDescription.pColorAttachments = vecColorReferences.data();
+    subpassDescription.pDepthStencilAttachment = hasDepth ? &depthReference : nullptr;
+
+    // A superset of the hazards above for any neighbours, including the swapchain acquire and aliased transients
+    if (pass.desc.isInterchangeable)
+    {
+        incoming.srcStageMask = kPassStages;
+        incoming.srcAccessMask = kPassAccess & kWriteAccess;
+        incoming.dstStageMask = kPassStages;
+        incoming.dstAccessMask = kPassAccess;
+        outgoing.srcStageMask = kPassStages;
+        outgoing.srcAccessMask = kPassAccess & kWriteAccess;
+        outgoing.dstStageMask = kPassStages;
+        outgoing.dstAccessMask = kPassAccess;
+    }
+
+    std::vector<VkSubpassDependency> vecDependencies;
+    if (incoming.srcStageMask != 0)
+        vecDependencies.push_back(incoming);
+    if (outgoing.srcStageMask != 0)
+        vecDependencies.push_back(outgoing);
+    m_statistics.dependencies += static_cast<uint32_t>(vecDependencies.size());
+
+    VkRenderPassCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    createInfo.attachmentCount = static_cast<uint32_t>(vecAttachments.size());
+    createInfo.pAttachments = vecAttachments.data();
+    createInfo.subpassCount = 1;
+    createInfo.pSubpasses = &subpassDescription;
+    createInfo.dependencyCount = static_cast<uint32_t>(vecDependencies.size());
+    createInfo.pDependencies = vecDependencies.data();
+
+    if (vkCreateRenderPass(CDevice::GetInstance().GetDevice(), &createInfo, CHostAllocator::GetCallbacks(),
+                           &pass.renderPass) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create render pass for '" + pass.desc.name + "'.");
+}
+
+void CRenderGraph::DestroyResources(bool isDeferred)
+{
+    std::vector<VkFramebuffer> vecFramebuffers;
+    for (auto &pass : m_vecPasses)
+    {
+        vecFramebuffers.insert(vecFramebuffers.end(), pass.vecFramebuffers.begin(), pass.vecFramebuffers.end());
+        pass.vecFramebuffers.clear();
+    }
+    for (auto &image : m_vecImages)
+        image.transientIndex = UINT32_MAX;
+    if (vecFramebuffers.empty() && mp_transientImages->vecImages.empty())
+        return;
+
+    auto destroy = [vecFramebuffers, transientImages = std::move(*mp_transientImages)]() mutable {
+        auto &deviceInstance = CDevice::GetInstance();
+        for (auto &framebuffer : vecFramebuffers)
+            vkDestroyFramebuffer(deviceInstance.GetDevice(), framebuffer, CHostAllocator::GetCallbacks());
+        deviceInstance.GetBufferImageManager().DestroyTransientImages(transientImages);
+    };
+    *mp_transientImages = {};
+
+    // Frames already submitted may still render with them
+    if (isDeferred)
+        CDevice::GetInstance().DeferDestroy(std::move(destroy));
+    else
+        destroy();
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+struct STransientImages;
+
+// Handle of an image declared to a CRenderGraph
+struct SGraphImage
+{
+    uint32_t index = UINT32_MAX;
+
+    bool IsValid() const
+    {
+        return index != UINT32_MAX;
+    }
+};
+
+// What an attachment starts with when its pass begins
+enum class EGraphLoad
+{
+    Clear,
+    // The pass overwrites every pixel it keeps
+    DontCare,
+    // What the previous pass writing the image left in it
+    Load
+};
+
+struct SGraphAttachment
+{
+    SGraphImage image;
+    EGraphLoad load = EGraphLoad::Clear;
+    VkClearValue clearValue{};
+    // Depth only, the pass tests against the depth without writing it. Has to load.
+    bool isReadOnly = false;
+};
+
+struct SGraphPassDesc
+{
+    std::string name;
+    std::vector<SGraphAttachment> vecColorAttachments;
+    // No depth when the image is invalid
+    SGraphAttachment depthAttachment;
+    // Read by fragment shaders, written by earlier passes
+    std::vector<SGraphImage> vecSampledImages;
+    // Records the pass's draws, called between beginning and ending its render pass
+    std::function<void(VkCommandBuffer cmdBuffer)> recordFunction;
+    // Asked every time the pass records, inline contents when not set
+    std::function<VkSubpassContents()> contentsFunction;
+    // Render area from the origin, asked every time the pass records, the graph's extent when not set. Images are
+    // always created at the graph's extent, a pass may only render into part of them.
+    std::function<VkExtent2D()> extentFunction;
+    // Synchronised with the same external dependencies as every other interchangeable pass, whatever its neighbours
+    // are. Two such passes with the same attachment formats, in this graph or another one, have compatible render
+    // passes, pipelines and secondary command buffers made for one can be used in the other.
+    bool isInterchangeable = false;
+};
+
+struct SRenderGraphStatistics
+{
+    uint32_t livePasses = 0;
+    uint32_t culledPasses = 0;
+    // External subpass dependencies of all render passes, the graph's only synchronisation
+    uint32_t dependencies = 0;
+    uint32_t transientImages = 0;
+    uint32_t transientAllocations = 0;
+    VkDeviceSize transientBytes = 0;
+    // What the transient images would take without aliasing
+    VkDeviceSize unaliasedBytes = 0;
+};
+
+// Frame graph of render passes. Passes declare the images they write as attachments and the ones they read, Compile
+// derives everything else once:
+// - Order: a pass sampling an image runs after every pass writing it, passes writing or loading the same image keep
+//   their declaration order. Independent passes also keep it.
+// - Culling: only passes that write an output, or an image a live pass reads, are executed.
+// - Synchronisation: every pass gets its own VkRenderPass whose attachment layouts and external subpass dependencies
+//   cover the hazards with the previous and next use of each image, so no barrier is recorded by hand. Attachments
+//   leave a pass in the layout of their next use and are only stored when something reads them later.
+//   Interchangeable passes trade the exact hazards for a fixed pair of dependencies covering every stage a pass uses.
+// - Memory: transient images with disjoint pass ranges share memory, see CBufferImageManager::CreateTransientImages.
+//   The first use of a transient image has to discard its contents and waits for the last use of every transient.
+// Imported images belong to someone else, like the swapchain. They are UNDEFINED when a frame starts and are left in
+// their final layout.
+class CRenderGraph
+{
+  public:
+    CRenderGraph();
+    ~CRenderGraph();
+
+    // finalLayout is what the owner expects after the frame. The first use waits for colour attachment output, which
+    // is where the frame's submission waits for the swapchain image.
+    SGraphImage ImportImage(const std::string &name, VkFormat format, VkImageLayout finalLayout);
+    // Usage follows from the passes, extraUsage is added to it
+    SGraphImage CreateImage(const std::string &name, VkFormat format, VkImageUsageFlags extraUsage = 0);
+    void AddPass(SGraphPassDesc &&desc);
+    void MarkOutput(SGraphImage image);
+
+    // Orders and culls the passes and creates their render passes, after everything was declared
+    void Compile();
+    // One view per image the owner rotates through, Execute selects one of them
+    void SetImportedViews(SGraphImage image, const std::vector<VkImageView> &vecViews);
+    // Transient images and framebuffers for the extent, the previous ones are retired with CDevice::DeferDestroy
+    void CreateResources(VkExtent2D extent);
+    // Retires the transient images and framebuffers the same way, Execute needs CreateResources again afterwards
+    void ReleaseResources();
+    // Records every live pass in order
+    void Execute(VkCommandBuffer cmdBuffer, uint32_t importedViewIndex);
+
+    // Null when the pass was culled
+    VkRenderPass GetRenderPass(const std::string &passName) const;
+    VkImageView GetImageView(SGraphImage image) const;
+    VkExtent2D GetExtent() const
+    {
+        return m_extent;
+    }
+
+    const SRenderGraphStatistics &GetStatistics() const
+    {
+        return m_statistics;
+    }
+
+    // The device must be idle
+    void Cleanup();
+
+  private:
+    struct SImage
+    {
+        std::string name;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkImageUsageFlags usage = 0;
+        bool isImported = false;
+        bool isOutput = false;
+        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        std::vector<VkImageView> vecImportedViews;
+        // Into m_transientImages, UINT32_MAX when no live pass uses the image
+        uint32_t transientIndex = UINT32_MAX;
+    };
+
+    // One access of an image by a pass
+    struct SImageUse
+    {
+        uint32_t imageIndex = 0;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageUsageFlags usage = 0;
+        VkPipelineStageFlags stageMask = 0;
+        VkAccessFlags accessMask = 0;
+        bool isAttachment = false;
+        bool isWrite = false;
+        // Depends on what earlier passes wrote
+        bool isRead = false;
+    };
+
+    struct SPass
+    {
+        SGraphPassDesc desc;
+        // Colour attachments, then depth, then sampled images
+        std::vector<SImageUse> vecUses;
+        std::vector<VkClearValue> vecClearValues;
+        bool isLive = false;
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        // One per imported view when the pass renders into an imported image
+        std::vector<VkFramebuffer> vecFramebuffers;
+    };
+
+    using PassDependencies = std::vector<std::vector<uint32_t>>;
+
+    void CollectUses(SPass &pass) const;
+    void CullPasses(const PassDependencies &vecReadDependencies);
+    void SortPasses(const PassDependencies &vecDependencies);
+    void CreateRenderPass(uint32_t orderIndex);
+    void DestroyResources(bool isDeferred);
+
+    std::vector<SImage> m_vecImages;
+    std::vector<SPass> m_vecPasses;
+    // Live passes in execution order
+    std::vector<uint32_t> m_vecOrder;
+    // Per image, the positions in m_vecOrder and use indices of its uses in execution order
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> m_vecImageUses;
+    // Last use of every transient image, the first use of any transient image waits for all of them
+    VkPipelineStageFlags m_transientLastStages = 0;
+    VkAccessFlags m_transientLastWrites = 0;
+    std::unique_ptr<STransientImages> mp_transientImages;
+    VkExtent2D m_extent{};
+    SRenderGraphStatistics m_statistics{};
+};
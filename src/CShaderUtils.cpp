@@ -1,4 +1,5 @@
 #include "CShaderUtils.hpp"
+#include "CHostAllocator.hpp"
 
 std::vector<char> CShaderUtils::ReadGlsl(const std::string &filename)
 {
@@ -28,7 +29,8 @@ VkShaderModule CShaderUtils::CreateShaderModule(const VkDevice device, const std
     createInfo.pCode = spirv.data();
 
     VkShaderModule shaderModule;
-    if (const auto res = vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule); res != VK_SUCCESS)
+    if (const auto res = vkCreateShaderModule(device, &createInfo, CHostAllocator::GetCallbacks(), &shaderModule);
+        res != VK_SUCCESS)
         throw std::runtime_error("Failed to create shader module.");
 
     return shaderModule;
@@ -0,0 +1,122 @@
+#include "CTimelineSync.hpp"
+#include "CDevice.hpp"
+#include "CHostAllocator.hpp"
+#include "vkStructs.hpp"
+
+CTimelineSync::CTimelineSync(VkQueue graphicsQueue, VkQueue transferQueue)
+{
+    m_timelines[static_cast<size_t>(ETimelineQueue::Graphics)].queue = graphicsQueue;
+    m_timelines[static_cast<size_t>(ETimelineQueue::Transfer)].queue = transferQueue;
+
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    createInfo.pNext = &typeInfo;
+    for (auto &timeline : m_timelines)
+    {
+        VK_CHECK_RESULT(vkCreateSemaphore(CDevice::GetInstance().GetDevice(), &createInfo,
+                                          CHostAllocator::GetCallbacks(), &timeline.semaphore))
+    }
+}
+
+uint64_t CTimelineSync::Submit(ETimelineQueue queue, const STimelineSubmit &submit)
+{
+    auto &timeline = GetTimeline(queue);
+    const auto signalValue = timeline.lastSubmitted + 1;
+
+    // Binary semaphores ignore their entry in the value arrays
+    auto vecWaitSemaphores = submit.vecBinaryWaitSemaphores;
+    auto vecWaitStages = submit.vecBinaryWaitStages;
+    std::vector<uint64_t> vecWaitValues(vecWaitSemaphores.size(), 0);
+    for (const auto &wait : submit.vecWaits)
+    {
+        // Waiting for a point the CPU already saw reached costs the GPU nothing, leave it out
+        if (wait.point.value <= GetTimeline(wait.point.queue).completed)
+            continue;
+        vecWaitSemaphores.push_back(GetTimeline(wait.point.queue).semaphore);
+        vecWaitStages.push_back(wait.stageMask);
+        vecWaitValues.push_back(wait.point.value);
+    }
+
+    auto vecSignalSemaphores = submit.vecBinarySignalSemaphores;
+    std::vector<uint64_t> vecSignalValues(vecSignalSemaphores.size(), 0);
+    vecSignalSemaphores.push_back(timeline.semaphore);
+    vecSignalValues.push_back(signalValue);
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(vecWaitValues.size());
+    timelineInfo.pWaitSemaphoreValues = vecWaitValues.data();
+    timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(vecSignalValues.size());
+    timelineInfo.pSignalSemaphoreValues = vecSignalValues.data();
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(vecWaitSemaphores.size());
+    submitInfo.pWaitSemaphores = vecWaitSemaphores.data();
+    submitInfo.pWaitDstStageMask = vecWaitStages.data();
+    submitInfo.commandBufferCount = static_cast<uint32_t>(submit.vecCommandBuffers.size());
+    submitInfo.pCommandBuffers = submit.vecCommandBuffers.data();
+    submitInfo.signalSemaphoreCount = static_cast<uint32_t>(vecSignalSemaphores.size());
+    submitInfo.pSignalSemaphores = vecSignalSemaphores.data();
+    VK_CHECK_RESULT(vkQueueSubmit(timeline.queue, 1, &submitInfo, VK_NULL_HANDLE))
+
+    timeline.lastSubmitted = signalValue;
+    return signalValue;
+}
+
+uint64_t CTimelineSync::Submit(ETimelineQueue queue, VkCommandBuffer cmdBuffer)
+{
+    STimelineSubmit submit{};
+    submit.vecCommandBuffers.push_back(cmdBuffer);
+    return Submit(queue, submit);
+}
+
+uint64_t CTimelineSync::GetCompleted(ETimelineQueue queue)
+{
+    auto &timeline = GetTimeline(queue);
+    if (timeline.completed < timeline.lastSubmitted)
+    {
+        VK_CHECK_RESULT(
+            vkGetSemaphoreCounterValue(CDevice::GetInstance().GetDevice(), timeline.semaphore, &timeline.completed))
+    }
+    return timeline.completed;
+}
+
+bool CTimelineSync::IsReached(STimelinePoint point)
+{
+    if (point.value <= GetTimeline(point.queue).completed)
+        return true;
+    return point.value <= GetCompleted(point.queue);
+}
+
+void CTimelineSync::Wait(STimelinePoint point)
+{
+    auto &timeline = GetTimeline(point.queue);
+    if (point.value <= timeline.completed)
+        return;
+    if (point.value > timeline.lastSubmitted)
+        throw std::runtime_error("Waiting for a timeline value nothing was submitted to signal.");
+
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &timeline.semaphore;
+    waitInfo.pValues = &point.value;
+    VK_CHECK_RESULT(vkWaitSemaphores(CDevice::GetInstance().GetDevice(), &waitInfo, UINT64_MAX))
+    timeline.completed = point.value;
+}
+
+void CTimelineSync::Cleanup()
+{
+    for (auto &timeline : m_timelines)
+    {
+        vkDestroySemaphore(CDevice::GetInstance().GetDevice(), timeline.semaphore, CHostAllocator::GetCallbacks());
+        timeline.semaphore = VK_NULL_HANDLE;
+    }
+}
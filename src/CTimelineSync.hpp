@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Queues that submit through CTimelineSync, each has its own timeline
+enum class ETimelineQueue
+{
+    Graphics,
+    Transfer,
+    Count
+};
+
+// A point on one queue's timeline, reached once every submission up to the one that signaled value completed
+struct STimelinePoint
+{
+    ETimelineQueue queue = ETimelineQueue::Graphics;
+    uint64_t value = 0;
+};
+
+// The GPU work a submission waits for before the given stages start
+struct STimelineWait
+{
+    STimelinePoint point;
+    VkPipelineStageFlags stageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+};
+
+// One submission. Binary semaphores are only for the swapchain, which can't wait on or signal timelines.
+struct STimelineSubmit
+{
+    std::vector<VkCommandBuffer> vecCommandBuffers;
+    std::vector<STimelineWait> vecWaits;
+    std::vector<VkSemaphore> vecBinaryWaitSemaphores;
+    std::vector<VkPipelineStageFlags> vecBinaryWaitStages;
+    std::vector<VkSemaphore> vecBinarySignalSemaphores;
+};
+
+// GPU/CPU synchronisation through one timeline semaphore per queue. Every submission signals the next value of its
+// queue's timeline, so a value names a point in that queue's submission order and everything submitted before it is
+// done once it is reached. Signals complete in submission order, waiting for a value is all it takes to know a frame,
+// an upload batch or a one-shot finished, no fences have to be pooled or reset. Cross-queue dependencies are waits on
+// another queue's value. Completed values are cached, IsReached only asks the driver when the cache is behind.
+class CTimelineSync
+{
+  public:
+    CTimelineSync(VkQueue graphicsQueue, VkQueue transferQueue);
+
+    // Returns the value the submission signals on the queue's timeline
+    uint64_t Submit(ETimelineQueue queue, const STimelineSubmit &submit);
+    uint64_t Submit(ETimelineQueue queue, VkCommandBuffer cmdBuffer);
+
+    // The value of the queue's latest submission, waiting for it drains the queue
+    uint64_t GetLastSubmitted(ETimelineQueue queue) const
+    {
+        return GetTimeline(queue).lastSubmitted;
+    }
+    uint64_t GetCompleted(ETimelineQueue queue);
+    bool IsReached(STimelinePoint point);
+    // Blocks until the GPU reached the point, returns right away for points already known to be reached
+    void Wait(STimelinePoint point);
+
+    // The device must be idle
+    void Cleanup();
+
+  private:
+    struct STimeline
+    {
+        VkQueue queue = VK_NULL_HANDLE;
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+        uint64_t lastSubmitted = 0;
+        uint64_t completed = 0;
+    };
+
+    STimeline &GetTimeline(ETimelineQueue queue)
+    {
+        return m_timelines[static_cast<size_t>(queue)];
+    }
+    const STimeline &GetTimeline(ETimelineQueue queue) const
+    {
+        return m_timelines[static_cast<size_t>(queue)];
+    }
+
+    std::array<STimeline, static_cast<size_t>(ETimelineQueue::Count)> m_timelines;
+};
@@ -0,0 +1,76 @@
+#include "CUniformRing.hpp"
+#include <algorithm>
+#include <cstdio>
+
+CUniformRing::CUniformRing(uint32_t frameCount, VkDeviceSize frameSize) : m_frameCount(frameCount)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(CDevice::GetInstance().GetVulkanInstance()->GetPhysicalDevice(), &properties);
+    m_alignment = properties.limits.minUniformBufferOffsetAlignment;
+    m_frameSize = (frameSize + m_alignment - 1) / m_alignment * m_alignment;
+    CreateBuffer();
+}
+
+void CUniformRing::BeginFrame(uint32_t frameIndex)
+{
+    m_frameIndex = frameIndex % m_frameCount;
+    m_head = 0;
+}
+
+uint32_t CUniformRing::Push(const void *pData, VkDeviceSize size)
+{
+    const auto offset = m_head;
+    if (offset + size > m_frameSize)
+        Grow(offset + size);
+
+    memcpy(static_cast<char *>(m_bufferHandles.allocation.pMapped) + GetFrameOffset(m_frameIndex) + offset, pData,
+           size);
+    m_head = (offset + size + m_alignment - 1) / m_alignment * m_alignment;
+
+    return static_cast<uint32_t>(offset);
+}
+
+void CUniformRing::Flush() const
+{
+    if (m_head != 0)
+        CDevice::GetInstance().GetBufferImageManager().FlushMemory(m_bufferHandles, GetFrameOffset(m_frameIndex),
+                                                                   m_head);
+}
+
+void CUniformRing::Cleanup()
+{
+    CDevice::GetInstance().GetBufferImageManager().DestroyBufferHandles(m_bufferHandles);
+}
+
+void CUniformRing::CreateBuffer()
+{
+    VkBufferCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    createInfo.size = m_frameSize * m_frameCount;
+    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    createInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    CDevice::GetInstance().GetBufferImageManager().CreateBuffer(createInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                                                m_bufferHandles, EMemoryCategory::Uniform);
+}
+
+void CUniformRing::Grow(VkDeviceSize requiredSize)
+{
+    auto &deviceInstance = CDevice::GetInstance();
+    auto oldHandles = m_bufferHandles;
+    const auto oldFrameOffset = GetFrameOffset(m_frameIndex);
+
+    // Doubling keeps the number of regrowths logarithmic in the object count
+    m_frameSize = std::max(m_frameSize * 2, (requiredSize + m_alignment - 1) / m_alignment * m_alignment);
+    CreateBuffer();
+    ++m_generation;
+
+    // Offsets already handed out this frame stay valid, the other frames push theirs again before they are recorded
+    memcpy(static_cast<char *>(m_bufferHandles.allocation.pMapped) + GetFrameOffset(m_frameIndex),
+           static_cast<const char *>(oldHandles.allocation.pMapped) + oldFrameOffset, m_head);
+    deviceInstance.DeferDestroy([oldHandles]() mutable {
+        CDevice::GetInstance().GetBufferImageManager().DestroyBufferHandles(oldHandles);
+    });
+
+    fprintf(stdout, "Uniform ring: grown to %llu KiB per frame\n",
+            static_cast<unsigned long long>(m_frameSize / 1024));
+}
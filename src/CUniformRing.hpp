@@ -0,0 +1,49 @@
+#pragma once
+
+#include "CBufferImageManager.hpp"
+#include <vulkan/vulkan.h>
+
+// One persistently mapped uniform buffer split into a region per frame. Objects push their per-frame data with a
+// bump allocation and bind it through a single UNIFORM_BUFFER_DYNAMIC descriptor with the returned offset. A push that
+// doesn't fit grows every region, the old buffer is retired with the frames still reading it.
+class CUniformRing
+{
+  public:
+    CUniformRing(uint32_t frameCount, VkDeviceSize frameSize);
+
+    // Rewinds to the start of the frame's region, the frame's previous submission must have completed
+    void BeginFrame(uint32_t frameIndex);
+    // Copies the data into the current frame's region and returns its dynamic offset, relative to the region. Must not
+    // be called while the frame is recorded, growing replaces the buffer the frame's descriptor set points at.
+    uint32_t Push(const void *pData, VkDeviceSize size);
+    // Flushes everything pushed this frame, must be called before the frame is submitted
+    void Flush() const;
+    void Cleanup();
+
+    VkBuffer GetBuffer() const
+    {
+        return m_bufferHandles.buffer;
+    }
+    VkDeviceSize GetFrameOffset(uint32_t frameIndex) const
+    {
+        return (frameIndex % m_frameCount) * m_frameSize;
+    }
+    // Changes whenever the buffer is replaced, descriptor sets written for another generation are stale
+    uint32_t GetGeneration() const
+    {
+        return m_generation;
+    }
+
+  private:
+    void CreateBuffer();
+    void Grow(VkDeviceSize requiredSize);
+
+    SBufferHandles m_bufferHandles{};
+    uint32_t m_frameCount;
+    VkDeviceSize m_frameSize;
+    VkDeviceSize m_alignment = 1;
+    uint32_t m_frameIndex = 0;
+    // Relative to the start of the current frame's region
+    VkDeviceSize m_head = 0;
+    uint32_t m_generation = 0;
+};
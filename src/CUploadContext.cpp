@@ -0,0 +1,347 @@
+#include "CUploadContext.hpp"
+#include "CHostAllocator.hpp"
+#include "CTimelineSync.hpp"
+#include "vkStructs.hpp"
+#include <algorithm>
+
+using namespace vkTools;
+
+namespace
+{
+// Satisfies bufferOffset rules for every format we upload
+constexpr VkDeviceSize kStagingAlignment = 16;
+} // namespace
+
+CUploadContext::CUploadContext(VkDeviceSize stagingSize, uint32_t queueFamilyIndex, uint32_t graphicsFamilyIndex)
+    : m_queueFamilyIndex(queueFamilyIndex), m_graphicsFamilyIndex(graphicsFamilyIndex), m_stagingSize(stagingSize)
+{
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = m_queueFamilyIndex;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    VK_CHECK_RESULT(vkCreateCommandPool(CDevice::GetInstance().GetDevice(), &poolInfo,
+                                        CHostAllocator::GetCallbacks(), &m_commandPool))
+
+    VkBufferCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    createInfo.size = m_stagingSize;
+    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    createInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    CDevice::GetInstance().GetBufferImageManager().CreateBuffer(createInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                                                m_stagingHandles, EMemoryCategory::Staging);
+}
+
+EUploadPath CUploadContext::UploadBuffer(const void *pData, VkDeviceSize size, const SBufferHandles &dst,
+                                         VkDeviceSize dstOffset)
+{
+    if (!dst.allocation.pMapped)
+    {
+        UploadBuffer(pData, size, dst.buffer, dstOffset);
+        return EUploadPath::Staged;
+    }
+
+    // Host writes made before a submission are visible to it, no copy or barrier is needed
+    CDevice::GetInstance().GetBufferImageManager().WriteMemory(dst, dstOffset, size, pData);
+    ++m_statistics.directUploads;
+    m_statistics.directBytes += size;
+    return EUploadPath::Direct;
+}
+
+void CUploadContext::UploadBuffer(const void *pData, VkDeviceSize size, VkBuffer dst, VkDeviceSize dstOffset)
+{
+    ++m_statistics.stagedUploads;
+    m_statistics.stagedBytes += size;
+
+    VkBufferCopy region{};
+    const auto src = Stage(pData, size, region.srcOffset);
+    region.dstOffset = dstOffset;
+    region.size = size;
+
+    const auto cmdBuffer = GetRecordingCommandBuffer();
+    vkCmdCopyBuffer(cmdBuffer, src, dst, 1, &region);
+
+    if (!IsAsync())
+        return;
+
+    // Release to the graphics family, the matching acquire is recorded by RecordAcquireBarriers
+    VkBufferMemoryBarrier bufferMemoryBarrier{};
+    bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bufferMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    bufferMemoryBarrier.dstAccessMask = 0;
+    bufferMemoryBarrier.srcQueueFamilyIndex = m_queueFamilyIndex;
+    bufferMemoryBarrier.dstQueueFamilyIndex = m_graphicsFamilyIndex;
+    bufferMemoryBarrier.buffer = dst;
+    bufferMemoryBarrier.offset = dstOffset;
+    bufferMemoryBarrier.size = size;
+
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0,
+                         nullptr, 1, &bufferMemoryBarrier, 0, nullptr);
+
+    bufferMemoryBarrier.srcAccessMask = 0;
+    bufferMemoryBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+                                        VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    m_recordingAcquire.vecBufferBarriers.push_back(bufferMemoryBarrier);
+}
+
+void CUploadContext::UploadImage(const void *pData, VkDeviceSize size, VkImage dst, VkExtent3D extent)
+{
+    ++m_statistics.stagedUploads;
+    m_statistics.stagedBytes += size;
+
+    VkBufferImageCopy region{};
+    const auto src = Stage(pData, size, region.bufferOffset);
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = extent;
+
+    const auto cmdBuffer = GetRecordingCommandBuffer();
+
+    VkImageMemoryBarrier imageMemoryBarrier{};
+    imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageMemoryBarrier.srcAccessMask = 0;
+    imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageMemoryBarrier.image = dst;
+    imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+    imageMemoryBarrier.subresourceRange.levelCount = 1;
+    imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+    imageMemoryBarrier.subresourceRange.layerCount = 1;
+
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &imageMemoryBarrier);
+
+    vkCmdCopyBufferToImage(cmdBuffer, src, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    if (!IsAsync())
+    {
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+                             nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+        return;
+    }
+
+    // The layout transition happens once, as part of the release and acquire pair
+    imageMemoryBarrier.dstAccessMask = 0;
+    imageMemoryBarrier.srcQueueFamilyIndex = m_queueFamilyIndex;
+    imageMemoryBarrier.dstQueueFamilyIndex = m_graphicsFamilyIndex;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0,
+                         nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+    imageMemoryBarrier.srcAccessMask = 0;
+    imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    m_recordingAcquire.vecImageBarriers.push_back(imageMemoryBarrier);
+}
+
+SUploadToken CUploadContext::Flush()
+{
+    auto &timelineSync = CDevice::GetInstance().GetTimelineSync();
+    if (!m_isRecording)
+        return {timelineSync.GetLastSubmitted(ETimelineQueue::Transfer)};
+
+    if (!IsAsync())
+    {
+        // Same queue as rendering, make every buffer copy visible to the frames submitted after it
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask =
+            VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT;
+        vkCmdPipelineBarrier(m_recordingBatch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1,
+                             &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    VK_CHECK_RESULT(vkEndCommandBuffer(m_recordingBatch.commandBuffer))
+    m_recordingBatch.timelineValue = timelineSync.Submit(ETimelineQueue::Transfer, m_recordingBatch.commandBuffer);
+
+    if (IsAsync())
+    {
+        m_recordingAcquire.timelineValue = m_recordingBatch.timelineValue;
+        m_vecPendingAcquires.push_back(std::move(m_recordingAcquire));
+        m_recordingAcquire = {};
+    }
+
+    const SUploadToken token{m_recordingBatch.timelineValue};
+    m_inFlightBatches.push_back(std::move(m_recordingBatch));
+    m_recordingBatch = {};
+    m_isRecording = false;
+
+    RetireCompleted();
+    return token;
+}
+
+void CUploadContext::Wait(SUploadToken token)
+{
+    CDevice::GetInstance().GetTimelineSync().Wait({ETimelineQueue::Transfer, token.timelineValue});
+    RetireCompleted();
+}
+
+bool CUploadContext::IsComplete(SUploadToken token)
+{
+    RetireCompleted();
+    return CDevice::GetInstance().GetTimelineSync().IsReached({ETimelineQueue::Transfer, token.timelineValue});
+}
+
+bool CUploadContext::IsIdle()
+{
+    RetireCompleted();
+    return !m_isRecording && m_inFlightBatches.empty() && m_vecPendingAcquires.empty();
+}
+
+uint64_t CUploadContext::RecordAcquireBarriers(VkCommandBuffer cmdBuffer)
+{
+    uint64_t waitValue = 0;
+    for (const auto &acquire : m_vecPendingAcquires)
+    {
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                             0, 0, nullptr, static_cast<uint32_t>(acquire.vecBufferBarriers.size()),
+                             acquire.vecBufferBarriers.data(), static_cast<uint32_t>(acquire.vecImageBarriers.size()),
+                             acquire.vecImageBarriers.data());
+        // Batches signal in submission order, waiting for the latest covers all of them
+        waitValue = std::max(waitValue, acquire.timelineValue);
+    }
+    m_vecPendingAcquires.clear();
+
+    return waitValue;
+}
+
+void CUploadContext::Cleanup()
+{
+    Wait(Flush());
+
+    // Command buffers are freed with the pool
+    m_freeBatches.clear();
+    m_vecPendingAcquires.clear();
+    vkDestroyCommandPool(CDevice::GetInstance().GetDevice(), m_commandPool, CHostAllocator::GetCallbacks());
+
+    CDevice::GetInstance().GetBufferImageManager().DestroyBufferHandles(m_stagingHandles);
+}
+
+VkCommandBuffer CUploadContext::GetRecordingCommandBuffer()
+{
+    if (m_isRecording)
+        return m_recordingBatch.commandBuffer;
+
+    const auto device = CDevice::GetInstance().GetDevice();
+    if (!m_freeBatches.empty())
+    {
+        m_recordingBatch = std::move(m_freeBatches.back());
+        m_freeBatches.pop_back();
+    }
+    else
+    {
+        const auto allocateInfo = vkStructs::CommandBufferAllocateInfo(m_commandPool);
+        VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &allocateInfo, &m_recordingBatch.commandBuffer))
+    }
+
+    m_recordingBatch.timelineValue = 0;
+    m_recordingBatch.stagingCharge = 0;
+
+    const auto beginInfo = vkStructs::CommandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    VK_CHECK_RESULT(vkBeginCommandBuffer(m_recordingBatch.commandBuffer, &beginInfo))
+
+    m_isRecording = true;
+    return m_recordingBatch.commandBuffer;
+}
+
+VkBuffer CUploadContext::Stage(const void *pData, VkDeviceSize size, VkDeviceSize &stagingOffset)
+{
+    const auto &bufferImageManager = CDevice::GetInstance().GetBufferImageManager();
+
+    if (size > m_stagingSize)
+    {
+        SBufferHandles oversizedHandles{};
+        VkBufferCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        createInfo.size = size;
+        createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        createInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferImageManager.CreateBuffer(createInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, oversizedHandles,
+                                        EMemoryCategory::Staging);
+        bufferImageManager.WriteMemory(oversizedHandles, 0, size, pData);
+
+        GetRecordingCommandBuffer();
+        m_recordingBatch.vecOversizedStaging.push_back(oversizedHandles);
+        stagingOffset = 0;
+        return oversizedHandles.buffer;
+    }
+
+    // Find room in the ring, retiring or submitting batches until the range is free
+    VkDeviceSize offset = 0;
+    VkDeviceSize charge = 0;
+    while (true)
+    {
+        if (m_stagingUsed == 0)
+            m_stagingHead = 0;
+
+        const auto alignedHead = (m_stagingHead + kStagingAlignment - 1) / kStagingAlignment * kStagingAlignment;
+        if (alignedHead + size <= m_stagingSize)
+        {
+            offset = alignedHead;
+            charge = alignedHead - m_stagingHead + size;
+        }
+        else
+        {
+            // Skip the tail of the ring and wrap around
+            offset = 0;
+            charge = m_stagingSize - m_stagingHead + size;
+        }
+
+        if (m_stagingUsed + charge <= m_stagingSize)
+            break;
+
+        if (!m_inFlightBatches.empty())
+            RetireOldest();
+        else if (m_isRecording)
+            Flush();
+        else
+            throw std::runtime_error("Failed to find room in the upload staging ring.");
+    }
+
+    GetRecordingCommandBuffer();
+    m_recordingBatch.stagingCharge += charge;
+    m_stagingUsed += charge;
+    m_stagingHead = offset + size;
+
+    bufferImageManager.WriteMemory(m_stagingHandles, offset, size, pData);
+    stagingOffset = offset;
+    return m_stagingHandles.buffer;
+}
+
+void CUploadContext::RetireOldest()
+{
+    auto &batch = m_inFlightBatches.front();
+    CDevice::GetInstance().GetTimelineSync().Wait({ETimelineQueue::Transfer, batch.timelineValue});
+
+    m_stagingUsed -= batch.stagingCharge;
+    for (auto &handles : batch.vecOversizedStaging)
+    {
+        CDevice::GetInstance().GetBufferImageManager().DestroyBufferHandles(handles);
+    }
+    batch.vecOversizedStaging.clear();
+
+    m_freeBatches.push_back(std::move(batch));
+    m_inFlightBatches.pop_front();
+}
+
+void CUploadContext::RetireCompleted()
+{
+    auto &timelineSync = CDevice::GetInstance().GetTimelineSync();
+    while (!m_inFlightBatches.empty() &&
+           timelineSync.IsReached({ETimelineQueue::Transfer, m_inFlightBatches.front().timelineValue}))
+    {
+        RetireOldest();
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "CBufferImageManager.hpp"
+#include <deque>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Identifies a submitted upload batch by the transfer timeline value it signals, see CUploadContext::Wait
+struct SUploadToken
+{
+    uint64_t timelineValue = 0;
+};
+
+enum class EUploadPath
+{
+    // Written by the CPU straight into mapped device-local memory
+    Direct,
+    // Copied through the staging ring by the GPU
+    Staged,
+};
+
+struct SUploadStatistics
+{
+    uint64_t directUploads = 0;
+    VkDeviceSize directBytes = 0;
+    uint64_t stagedUploads = 0;
+    VkDeviceSize stagedBytes = 0;
+};
+
+// Records buffer and image uploads into one command buffer, staging the data through a persistently mapped ring, and
+// submits the whole batch at once. Nothing here waits on the queue unless the staging ring runs out of space.
+//
+// Batches are submitted through CTimelineSync and retire once the transfer timeline reached their value. When the
+// upload queue belongs to a different family than graphics, every destination is released to the graphics family at
+// the end of its batch. The graphics side picks the releases up with RecordAcquireBarriers and waits for the batch's
+// timeline value, uploads have to be flushed before the frame that first uses them records its acquires.
+class CUploadContext
+{
+  public:
+    CUploadContext(VkDeviceSize stagingSize, uint32_t queueFamilyIndex, uint32_t graphicsFamilyIndex);
+
+    void UploadBuffer(const void *pData, VkDeviceSize size, VkBuffer dst, VkDeviceSize dstOffset = 0);
+    // Writes directly when the buffer lives in host visible memory (see CBufferImageManager::CreateDeviceBuffer),
+    // stages otherwise. The destination range must not be in use by the GPU.
+    EUploadPath UploadBuffer(const void *pData, VkDeviceSize size, const SBufferHandles &dst,
+                             VkDeviceSize dstOffset = 0);
+    // Transitions the whole image to TRANSFER_DST, copies into mip 0 and leaves it in SHADER_READ_ONLY_OPTIMAL
+    void UploadImage(const void *pData, VkDeviceSize size, VkImage dst, VkExtent3D extent);
+
+    // Submits everything recorded since the last flush, returns the token of the last submitted batch
+    SUploadToken Flush();
+    // Token semantics cover the copies only, ownership still has to be acquired on the graphics queue
+    void Wait(SUploadToken token);
+    bool IsComplete(SUploadToken token);
+
+    // Records the ownership acquire for every batch submitted since the last call into a graphics command buffer and
+    // returns the transfer timeline value that command buffer's submission has to wait for at the transfer stage, 0
+    // when there was nothing to acquire
+    uint64_t RecordAcquireBarriers(VkCommandBuffer cmdBuffer);
+
+    // True when nothing is being recorded, copied or waiting for its ownership acquire
+    bool IsIdle();
+
+    bool IsAsync() const
+    {
+        return m_queueFamilyIndex != m_graphicsFamilyIndex;
+    }
+
+    const SUploadStatistics &GetStatistics() const
+    {
+        return m_statistics;
+    }
+
+    void Cleanup();
+
+  private:
+    struct SBatch
+    {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        // Set on submission
+        uint64_t timelineValue = 0;
+        // Staging ring bytes (including alignment and wrap-around waste) released when the batch retires
+        VkDeviceSize stagingCharge = 0;
+        // Uploads too large for the ring get their own staging buffer
+        std::vector<SBufferHandles> vecOversizedStaging;
+    };
+
+    // Ownership transfers of one async batch waiting for the graphics queue
+    struct SPendingAcquire
+    {
+        uint64_t timelineValue = 0;
+        std::vector<VkBufferMemoryBarrier> vecBufferBarriers;
+        std::vector<VkImageMemoryBarrier> vecImageBarriers;
+    };
+
+    VkCommandBuffer GetRecordingCommandBuffer();
+    VkBuffer Stage(const void *pData, VkDeviceSize size, VkDeviceSize &stagingOffset);
+    void RetireOldest();
+    void RetireCompleted();
+
+    uint32_t m_queueFamilyIndex;
+    uint32_t m_graphicsFamilyIndex;
+    VkCommandPool m_commandPool = VK_NULL_HANDLE;
+
+    SBufferHandles m_stagingHandles{};
+    VkDeviceSize m_stagingSize;
+    VkDeviceSize m_stagingHead = 0;
+    VkDeviceSize m_stagingUsed = 0;
+
+    bool m_isRecording = false;
+    SBatch m_recordingBatch{};
+    std::deque<SBatch> m_inFlightBatches;
+    std::vector<SBatch> m_freeBatches;
+
+    SPendingAcquire m_recordingAcquire{};
+    std::vector<SPendingAcquire> m_vecPendingAcquires;
+
+    SUploadStatistics m_statistics{};
+};
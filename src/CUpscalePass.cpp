@@ -0,0 +1,163 @@
+#include "CUpscalePass.hpp"
+#include "CDevice.hpp"
+#include "CHostAllocator.hpp"
+#include "CShaderUtils.hpp"
+#include "vkStructs.hpp"
+#include <glm/glm.hpp>
+
+using namespace vkTools;
+
+namespace
+{
+// Matches the push constant block of upscale.vert and upscale.frag
+struct SUpscaleConstants
+{
+    // Maps the target's UVs onto the rendered part of the source
+    glm::vec2 uvScale;
+    // Last UV bilinear filtering may sample without reading texels outside the rendered part
+    glm::vec2 uvMax;
+};
+} // namespace
+
+CUpscalePass::CUpscalePass(VkRenderPass renderPass)
+{
+    VkSamplerCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    createInfo.minFilter = VK_FILTER_LINEAR;
+    createInfo.magFilter = VK_FILTER_LINEAR;
+    createInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    createInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    createInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    createInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    createInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+    createInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    VK_CHECK_RESULT(vkCreateSampler(CDevice::GetInstance().GetDevice(), &createInfo, CHostAllocator::GetCallbacks(),
+                                    &m_sampler))
+
+    CreatePipeline(renderPass);
+}
+
+void CUpscalePass::SetSource(VkImageView sourceView)
+{
+    auto &deviceInstance = CDevice::GetInstance();
+    if (m_descriptorSet != VK_NULL_HANDLE)
+    {
+        deviceInstance.DeferDestroy([descriptorSet = m_descriptorSet]() {
+            auto &deviceInstance = CDevice::GetInstance();
+            vkFreeDescriptorSets(deviceInstance.GetDevice(), deviceInstance.GetDescriptorPool(), 1, &descriptorSet);
+        });
+    }
+
+    const auto layout = deviceInstance.GetTextureDescriptorSetLayout();
+    VkDescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.descriptorPool = deviceInstance.GetDescriptorPool();
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &layout;
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(deviceInstance.GetDevice(), &allocateInfo, &m_descriptorSet))
+
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageView = sourceView;
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.sampler = m_sampler;
+
+    VkWriteDescriptorSet writeDescriptorSet{};
+    writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writeDescriptorSet.descriptorCount = 1;
+    writeDescriptorSet.dstSet = m_descriptorSet;
+    writeDescriptorSet.dstBinding = 0;
+    writeDescriptorSet.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(deviceInstance.GetDevice(), 1, &writeDescriptorSet, 0, nullptr);
+}
+
+void CUpscalePass::Record(VkCommandBuffer cmdBuffer, VkExtent2D sourceExtent, VkExtent2D targetExtent) const
+{
+    const auto fullExtent = glm::vec2(targetExtent.width, targetExtent.height);
+    const auto renderedExtent = glm::vec2(sourceExtent.width, sourceExtent.height);
+    SUpscaleConstants constants{};
+    constants.uvScale = renderedExtent / fullExtent;
+    constants.uvMax = (renderedExtent - 0.5f) / fullExtent;
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 0,
+                            nullptr);
+    vkCmdPushConstants(cmdBuffer, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                       sizeof(constants), &constants);
+
+    VkViewport viewport{};
+    viewport.width = fullExtent.x;
+    viewport.height = fullExtent.y;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+    VkRect2D scissor{};
+    scissor.extent = targetExtent;
+    vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+
+    // The vertex shader places the triangle from its index, there is no vertex buffer
+    vkCmdDraw(cmdBuffer, 3, 1, 0, 0);
+}
+
+void CUpscalePass::Cleanup()
+{
+    const auto device = CDevice::GetInstance().GetDevice();
+    vkDestroyPipeline(device, m_pipeline, CHostAllocator::GetCallbacks());
+    vkDestroyPipelineLayout(device, m_pipelineLayout, CHostAllocator::GetCallbacks());
+    vkDestroySampler(device, m_sampler, CHostAllocator::GetCallbacks());
+    m_pipeline = VK_NULL_HANDLE;
+    m_pipelineLayout = VK_NULL_HANDLE;
+    m_sampler = VK_NULL_HANDLE;
+    m_descriptorSet = VK_NULL_HANDLE;
+}
+
+void CUpscalePass::CreatePipeline(VkRenderPass renderPass)
+{
+    const auto device = CDevice::GetInstance().GetDevice();
+    const auto vertModule =
+        CShaderUtils::CreateShaderModule(device, "../assets/shaders/upscale.vert", EShaderType::Vert);
+    const auto vertStageInfo = CShaderUtils::ShaderPipelineStageCreateInfo(vertModule, EShaderType::Vert);
+    const auto fragModule =
+        CShaderUtils::CreateShaderModule(device, "../assets/shaders/upscale.frag", EShaderType::Frag);
+    const auto fragStageInfo = CShaderUtils::ShaderPipelineStageCreateInfo(fragModule, EShaderType::Frag);
+    const std::vector<VkPipelineShaderStageCreateInfo> vecShaderStages{vertStageInfo, fragStageInfo};
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    const auto inputAssemblyInfo = vkStructs::InputAssemblyStateCreateInfo();
+    const auto tessellationInfo = vkStructs::TessellationStateCreateInfo();
+    auto rasterizationInfo = vkStructs::RasterizationStateCreateInfo();
+    rasterizationInfo.cullMode = VK_CULL_MODE_NONE;
+
+    VkPipelineColorBlendAttachmentState attachmentState{};
+    attachmentState.blendEnable = VK_FALSE;
+    attachmentState.colorWriteMask =
+        VK_COLOR_COMPONENT_A_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_R_BIT;
+    const auto colorBlendInfo = vkStructs::ColorBlendStateCreateInfo(attachmentState);
+    const auto multisampleInfo = vkStructs::MultisampleStateCreateInfo();
+    // The pass has no depth attachment
+    auto depthStencilInfo = vkStructs::DepthStencilStateCreateInfo();
+    depthStencilInfo.depthTestEnable = VK_FALSE;
+    depthStencilInfo.depthWriteEnable = VK_FALSE;
+    const std::vector<VkDynamicState> vecDynamicStates{VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    const auto dynamicInfo = vkStructs::DynamicStateCreateInfo(vecDynamicStates);
+    const auto viewportInfo = vkStructs::ViewportCreateInfo(1, 1);
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.size = sizeof(SUpscaleConstants);
+    // The create info points into the vectors, they have to outlive it
+    const std::vector<VkDescriptorSetLayout> vecLayouts{CDevice::GetInstance().GetTextureDescriptorSetLayout()};
+    const std::vector<VkPushConstantRange> vecPushConstantRanges{pushConstantRange};
+    const auto pipelineLayoutInfo = vkStructs::PipelineLayoutCreateInfo(vecLayouts, vecPushConstantRanges);
+    VK_CHECK_RESULT(
+        vkCreatePipelineLayout(device, &pipelineLayoutInfo, CHostAllocator::GetCallbacks(), &m_pipelineLayout))
+
+    const auto pipelineInfo = vkStructs::GraphicsPipelineCreateInfo(
+        vecShaderStages, vertexInputInfo, inputAssemblyInfo, tessellationInfo, viewportInfo, rasterizationInfo,
+        multisampleInfo, depthStencilInfo, colorBlendInfo, dynamicInfo, m_pipelineLayout, renderPass);
+    VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, CHostAllocator::GetCallbacks(),
+                                              &m_pipeline))
+
+    vkDestroyShaderModule(device, vertModule, CHostAllocator::GetCallbacks());
+    vkDestroyShaderModule(device, fragModule, CHostAllocator::GetCallbacks());
+}
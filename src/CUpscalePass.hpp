@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+// Stretches the part of the scene target the scene rendered into over the whole backbuffer with a single bilinear
+// fullscreen triangle. The descriptor set is replaced, not updated, when the source changes since frames in flight
+// still bind the old one.
+class CUpscalePass
+{
+  public:
+    // renderPass is where Record is called
+    explicit CUpscalePass(VkRenderPass renderPass);
+
+    // After the source image was recreated
+    void SetSource(VkImageView sourceView);
+    // sourceExtent of the source, which is as large as targetExtent, was rendered
+    void Record(VkCommandBuffer cmdBuffer, VkExtent2D sourceExtent, VkExtent2D targetExtent) const;
+
+    // The device must be idle, the descriptor set goes with CDevice's pool
+    void Cleanup();
+
+  private:
+    void CreatePipeline(VkRenderPass renderPass);
+
+    VkSampler m_sampler = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
+};
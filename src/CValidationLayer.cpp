@@ -1,4 +1,5 @@
 #include "CValidationLayer.hpp"
+#include "CHostAllocator.hpp"
 #include "CVulkanHelpers.hpp"
 
 // TODO add debug check
@@ -49,8 +50,8 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(VkDebugUtilsMessageSeverityF
     else
         type = "Performance";
 
-    fprintf_s(VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT ? stderr : stdout, "%s : %s - %s\n", severity.c_str(),
-              type.c_str(), pCallbackData->pMessage);
+    fprintf(VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT ? stderr : stdout, "%s : %s - %s\n", severity.c_str(),
+            type.c_str(), pCallbackData->pMessage);
 
     return VK_FALSE;
 }
@@ -78,7 +79,8 @@ void CValidationLayer::SetupDebugMessenger(VkInstance const &instance)
     VkDebugUtilsMessengerCreateInfoEXT createInfo;
     PopulateDebugMessengerCreateInfo(createInfo);
 
-    if (CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr, &m_debugMessenger) != VK_SUCCESS)
+    if (CreateDebugUtilsMessengerEXT(instance, &createInfo, CHostAllocator::GetCallbacks(), &m_debugMessenger) !=
+        VK_SUCCESS)
     {
         throw std::runtime_error("failed to set up debug messenger!");
     }
@@ -86,5 +88,5 @@ void CValidationLayer::SetupDebugMessenger(VkInstance const &instance)
 
 void CValidationLayer::DestroyDebugMessenger(const VkInstance &instance)
 {
-    DestroyDebugUtilsMessengerEXT(instance, m_debugMessenger, nullptr);
+    DestroyDebugUtilsMessengerEXT(instance, m_debugMessenger, CHostAllocator::GetCallbacks());
 }
@@ -1,15 +1,19 @@
 #include "CVulkanHelpers.hpp"
 // TODO MOVE TO vkTools
-std::vector<const char *> CVulkanHelpers::GetVulkanInstanceExtensions()
+std::vector<const char *> CVulkanHelpers::GetVulkanInstanceExtensions(bool isHeadless, bool isValidation)
 {
-    if (glfwVulkanSupported() == GLFW_FALSE)
-        throw std::runtime_error("Vulkan is not supported.");
-    uint32_t glfwExtensionCount;
-    const auto glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-    std::vector<const char *> vExtensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
-    // TODO add debug check
-    vExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+    std::vector<const char *> vExtensions;
+    // Without a window there is no surface, glfw isn't even initialized
+    if (!isHeadless)
+    {
+        if (glfwVulkanSupported() == GLFW_FALSE)
+            throw std::runtime_error("Vulkan is not supported.");
+        uint32_t glfwExtensionCount;
+        const auto glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        vExtensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
+    if (isValidation)
+        vExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 
     return vExtensions;
 }
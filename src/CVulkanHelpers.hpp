@@ -16,7 +16,8 @@ struct SSwapchainSupport
 class CVulkanHelpers
 {
   public:
-    static std::vector<const char *> GetVulkanInstanceExtensions();
+    // Debug utils only comes with the validation layers
+    static std::vector<const char *> GetVulkanInstanceExtensions(bool isHeadless = false, bool isValidation = true);
     static std::vector<VkExtensionProperties> GetVulkanDeviceExtensions(const VkPhysicalDevice &physicalDevice);
     static std::vector<VkLayerProperties> GetVulkanLayers();
     static bool CheckForVulkanInstanceExtensions(const VkPhysicalDevice &physicalDevice,
@@ -3,11 +3,53 @@
 
 void ErrorCallback(int error, const char *desc)
 {
-    fprintf_s(stderr, "Error %d: %s\n", error, desc);
+    fprintf(stderr, "Error %d: %s\n", error, desc);
+}
+
+CWindow *GetCWindow(GLFWwindow *window)
+{
+    return static_cast<CWindow *>(glfwGetWindowUserPointer(window));
 }
 
 void FramebufferCallback(GLFWwindow *window, int width, int height)
 {
+    GetCWindow(window)->MarkWindowChanged();
+}
+
+void RefreshCallback(GLFWwindow *window)
+{
+    GetCWindow(window)->MarkWindowChanged();
+}
+
+void FocusCallback(GLFWwindow *window, int focused)
+{
+    GetCWindow(window)->MarkWindowChanged();
+}
+
+void CursorPosCallback(GLFWwindow *window, double x, double y)
+{
+    GetCWindow(window)->MarkInput();
+}
+
+// ImGui installs its own button, scroll, key and char callbacks later and chains to these
+void MouseButtonCallback(GLFWwindow *window, int button, int action, int mods)
+{
+    GetCWindow(window)->MarkInput();
+}
+
+void ScrollCallback(GLFWwindow *window, double x, double y)
+{
+    GetCWindow(window)->MarkInput();
+}
+
+void KeyCallback(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+    GetCWindow(window)->MarkInput();
+}
+
+void CharCallback(GLFWwindow *window, unsigned int c)
+{
+    GetCWindow(window)->MarkInput();
 }
 
 CWindow::CWindow(const uint32_t width, const uint32_t height) : m_width(width), m_height(height)
@@ -25,7 +67,29 @@ void CWindow::InitWindow()
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
     mp_window = glfwCreateWindow(m_width, m_height, "App", nullptr, nullptr);
+    glfwSetWindowUserPointer(mp_window, this);
     glfwSetFramebufferSizeCallback(mp_window, FramebufferCallback);
+    glfwSetWindowRefreshCallback(mp_window, RefreshCallback);
+    glfwSetWindowFocusCallback(mp_window, FocusCallback);
+    glfwSetCursorPosCallback(mp_window, CursorPosCallback);
+    glfwSetMouseButtonCallback(mp_window, MouseButtonCallback);
+    glfwSetScrollCallback(mp_window, ScrollCallback);
+    glfwSetKeyCallback(mp_window, KeyCallback);
+    glfwSetCharCallback(mp_window, CharCallback);
+}
+
+bool CWindow::ConsumeWindowChange()
+{
+    const auto hasWindowChanged = m_hasWindowChanged;
+    m_hasWindowChanged = false;
+    return hasWindowChanged;
+}
+
+bool CWindow::ConsumeInput()
+{
+    const auto hasInput = m_hasInput;
+    m_hasInput = false;
+    return hasInput;
 }
 
 void CWindow::Terminate() const
@@ -8,6 +8,9 @@ class CWindow
     uint32_t m_width;
     uint32_t m_height;
     GLFWwindow *mp_window;
+    // Set by the glfw callbacks while events are polled
+    bool m_hasWindowChanged = false;
+    bool m_hasInput = false;
 
     void InitWindow();
     void Terminate() const;
@@ -20,4 +23,17 @@ class CWindow
     {
         return mp_window;
     }
+
+    void MarkWindowChanged()
+    {
+        m_hasWindowChanged = true;
+    }
+    void MarkInput()
+    {
+        m_hasInput = true;
+    }
+    // Resize, expose or focus change since the last call
+    bool ConsumeWindowChange();
+    // Any mouse or keyboard event since the last call
+    bool ConsumeInput();
 };
\ No newline at end of file
@@ -3,8 +3,12 @@
 
 using namespace vkTools::vkPrimitives;
 
+namespace
+{
+constexpr std::array<VkDynamicState, 2> kDynamicStates{VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+} // namespace
+
 SGraphicsPipelineStates::SGraphicsPipelineStates(const VkPipelineColorBlendAttachmentState &attachmentState,
-                                                 const VkViewport &viewport, const VkRect2D &scissors,
                                                  const VkVertexInputBindingDescription &inputBindingDesc,
                                                  const std::array<VkVertexInputAttributeDescription, 3> &attributeDesc)
 {
@@ -15,7 +19,7 @@ SGraphicsPipelineStates::SGraphicsPipelineStates(const VkPipelineColorBlendAttac
     multisampleState = MultisampleStateCreateInfo();
     depthStencilState = DepthStencilStateCreateInfo();
     dynamicState = DynamicStateCreateInfo();
-    viewportState = ViewportCreateInfo(viewport, scissors);
+    viewportState = ViewportCreateInfo();
 }
 VkPipelineVertexInputStateCreateInfo SGraphicsPipelineStates::VertexInputStateCreateInfo(
     const VkVertexInputBindingDescription &inputBindingDesc,
@@ -92,17 +96,17 @@ VkPipelineDynamicStateCreateInfo SGraphicsPipelineStates::DynamicStateCreateInfo
 {
     VkPipelineDynamicStateCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    createInfo.dynamicStateCount = kDynamicStates.size();
+    createInfo.pDynamicStates = kDynamicStates.data();
     return createInfo;
 }
-VkPipelineViewportStateCreateInfo SGraphicsPipelineStates::ViewportCreateInfo(const VkViewport &viewport,
-                                                                              const VkRect2D &scissors)
+VkPipelineViewportStateCreateInfo SGraphicsPipelineStates::ViewportCreateInfo()
 {
+    // Only the counts matter, the values come from vkCmdSetViewport and vkCmdSetScissor
     VkPipelineViewportStateCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
     createInfo.viewportCount = 1;
-    createInfo.pViewports = &viewport;
     createInfo.scissorCount = 1;
-    createInfo.pScissors = &scissors;
 
     return createInfo;
 }
@@ -15,8 +15,8 @@ struct SGraphicsPipelineStates
     VkPipelineDynamicStateCreateInfo dynamicState;
     VkPipelineViewportStateCreateInfo viewportState;
 
+    // Viewport and scissor are dynamic, they are set per command buffer so the pipeline outlives swapchain resizes
     explicit SGraphicsPipelineStates(const VkPipelineColorBlendAttachmentState &attachmentState,
-                                     const VkViewport &viewport, const VkRect2D &scissors,
                                      const VkVertexInputBindingDescription &inputBindingDesc,
                                      const std::array<VkVertexInputAttributeDescription, 3> &attributeDesc);
 
@@ -38,5 +38,5 @@ struct SGraphicsPipelineStates
 
     static VkPipelineDynamicStateCreateInfo DynamicStateCreateInfo();
 
-    static VkPipelineViewportStateCreateInfo ViewportCreateInfo(const VkViewport &viewport, const VkRect2D &scissors);
+    static VkPipelineViewportStateCreateInfo ViewportCreateInfo();
 };
\ No newline at end of file
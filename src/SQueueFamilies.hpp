@@ -8,10 +8,13 @@ struct SQueueFamilies
 {
     std::optional<uint32_t> graphicsFamilyIndex;
     std::optional<uint32_t> presentFamilyIndex;
+    // Falls back to the graphics family when the device has no separate transfer family
+    std::optional<uint32_t> transferFamilyIndex;
 
     inline std::set<uint32_t> GetUniqueQueueFamilies() const
     {
-        return std::set<uint32_t>{graphicsFamilyIndex.value(), presentFamilyIndex.value()};
+        return std::set<uint32_t>{graphicsFamilyIndex.value(), presentFamilyIndex.value(),
+                                  transferFamilyIndex.value_or(graphicsFamilyIndex.value())};
     }
 
     inline bool HaveValues() const
@@ -28,4 +31,14 @@ struct SQueueFamilies
     {
         return &presentFamilyIndex.value();
     }
+
+    inline const uint32_t *TransferFamily() const
+    {
+        return transferFamilyIndex.has_value() ? &transferFamilyIndex.value() : &graphicsFamilyIndex.value();
+    }
+
+    inline bool HasSeparateTransferFamily() const
+    {
+        return *TransferFamily() != graphicsFamilyIndex.value();
+    }
 };
\ No newline at end of file
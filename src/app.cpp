@@ -1,18 +1,42 @@
 #include "app.hpp"
+#include "CCameraLatch.hpp"
+#include "CFramePacer.hpp"
 #include "CImageLoader.hpp"
+#include "CUploadContext.hpp"
+#include <chrono>
+#include <glm/gtc/matrix_transform.hpp>
 #include <imgui.h>
 
+namespace
+{
+constexpr float kMemoryWarningThreshold = 0.9f;
+// Radians of camera orbit per pixel of horizontal mouse movement
+constexpr float kOrbitSpeed = 0.005f;
+// Render-on-demand wakes up this often without events to pick up work that doesn't come from the window
+constexpr double kIdleWaitSeconds = 0.5;
+} // namespace
+
 CApp::CApp(SAppInfo appInfo) : m_appInfo(appInfo)
 {
-    // Create GLFW window
-    mp_window = std::make_unique<CWindow>(appInfo.width, appInfo.height);
+    // Create GLFW window, headless runs render offscreen without one
+    if (!appInfo.isHeadless)
+        mp_window = std::make_unique<CWindow>(appInfo.width, appInfo.height);
     // Create Vulkan instance, surface, physical device, queue families and validation layers
-    mp_instance = std::make_unique<CInstance>(mp_window->Window(), appInfo);
+    mp_instance = std::make_unique<CInstance>(mp_window ? mp_window->Window() : nullptr, appInfo);
     mp_bufferImageManager = std::make_unique<CBufferImageManager>(mp_instance->PhysicalDevice());
 
     m_deviceInstance = &CDevice::GetInstance();
     m_deviceInstance->InitDevice(mp_window.get(), mp_instance.get(), mp_bufferImageManager.get(), appInfo);
 
+    // Nothing streams yet, so running low on a heap is only reported
+    mp_bufferImageManager->GetMemoryBudget().AddThresholdCallback(
+        kMemoryWarningThreshold, [](uint32_t heapIndex, const SHeapBudget &heapBudget, bool isAbove) {
+            fprintf(isAbove ? stderr : stdout, "Memory heap %u %s %.0f%% of its budget (%llu / %llu bytes)\n",
+                    heapIndex, isAbove ? "is above" : "is back below", kMemoryWarningThreshold * 100.0f,
+                    static_cast<unsigned long long>(heapBudget.usage),
+                    static_cast<unsigned long long>(heapBudget.budget));
+        });
+
     SModelProps vikingProps{};
     vikingProps.modelName = "Viking Room";
     vikingProps.objectFile = "../assets/models/viking_room.obj";
@@ -30,55 +54,150 @@ CApp::CApp(SAppInfo appInfo) : m_appInfo(appInfo)
 
     m_vecLightObjects.emplace_back(std::make_unique<CLightObject>());
 
-    mp_gui = std::make_unique<CGui>();
+    m_deviceInstance->GetCameraLatch().SetSampler([this]() { return SampleCamera(); });
+    m_deviceInstance->SetSceneRecorder([this]() { RecordScene(); });
+    m_deviceInstance->SetDepthRecorder([this]() { RecordDepth(); });
+
+    // Every object above only recorded its uploads, submit them together, the first frame acquires them
+    m_deviceInstance->GetUploadContext().Flush();
+
+    // The GUI needs a window for its input and display size
+    if (!appInfo.isHeadless)
+    {
+        mp_gui = std::make_unique<CGui>();
+        m_deviceInstance->SetOverlayRecorder([this]() { mp_gui->Draw(); });
+    }
 }
 
 void CApp::Draw()
 {
+    // A recreated swapchain has nothing in it yet
     if (!m_deviceInstance->DrawBegin())
     {
-        for (auto &lightObject : m_vecLightObjects)
-        {
-            lightObject->CleanupGraphicsPipeline();
-            lightObject->RecreateGraphicsPipeline();
-        }
+        m_deviceInstance->GetFramePacer().MarkDirty(EFrameDirty::Window);
         return;
     }
 
+    // Pushed in the same order every frame, so a cached recording finds each object's uniforms at its offsets
     for (const auto &gameObject : m_vecGameObjects)
-    {
         gameObject->UpdateUniformBuffers();
-        gameObject->Draw();
-    }
-    // TODO This has to go after gameobjects because they're using the same render pass
-    mp_gui->Draw();
-
     for (auto &lightObject : m_vecLightObjects)
-    {
         lightObject->UpdateUniformBuffers();
-        lightObject->Draw();
-    }
 
+    // Records the render graph, the scene and the GUI are drawn from its passes
     if (!m_deviceInstance->DrawEnd())
+        m_deviceInstance->GetFramePacer().MarkDirty(EFrameDirty::Window);
+}
+
+void CApp::RecordScene()
+{
+    m_deviceInstance->RecordParallel(
+        static_cast<uint32_t>(m_vecGameObjects.size()),
+        [this](VkCommandBuffer cmdBuffer, uint32_t index) { m_vecGameObjects[index]->Draw(cmdBuffer); });
+    // Lights bind their own pipeline, they are few and recorded on this thread after the game objects
+    for (auto &lightObject : m_vecLightObjects)
+        lightObject->Draw(m_deviceInstance->GetCurrentCommandBuffer());
+}
+
+void CApp::RecordDepth()
+{
+    // Only the opaque game objects, lights are drawn as wireframes and test against what these leave
+    for (const auto &gameObject : m_vecGameObjects)
+        gameObject->DrawDepth(m_deviceInstance->GetCurrentCommandBuffer());
+}
+
+vkTools::vkPrimitives::SCameraUniform CApp::SampleCamera()
+{
+    // Dragging with the right mouse button orbits the camera, the cursor position is queried at latch time rather
+    // than taken from the events polled at the start of the frame
+    if (mp_window && glfwGetMouseButton(mp_window->Window(), GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS)
     {
-        for (auto &lightObject : m_vecLightObjects)
+        double cursorX, cursorY;
+        glfwGetCursorPos(mp_window->Window(), &cursorX, &cursorY);
+        // The cursor may be ahead of the polled events, the next frame has to catch up with it
+        if (m_isOrbiting && cursorX != m_orbitCursorX)
         {
-            lightObject->CleanupGraphicsPipeline();
-            lightObject->RecreateGraphicsPipeline();
+            m_orbitAngle -= static_cast<float>(cursorX - m_orbitCursorX) * kOrbitSpeed;
+            m_deviceInstance->GetFramePacer().MarkDirty(EFrameDirty::Camera);
         }
-        return;
+        m_orbitCursorX = cursorX;
+        m_isOrbiting = true;
+    }
+    else
+    {
+        m_isOrbiting = false;
     }
+
+    const auto orbit = glm::rotate(glm::mat4(1.0f), m_orbitAngle, glm::vec3(0.0f, 0.0f, 1.0f));
+    const auto eye = glm::vec3(orbit * glm::vec4(10.0f, 0.01f, 10.0f, 1.0f));
+    const auto extent = m_deviceInstance->GetExtent();
+
+    vkTools::vkPrimitives::SCameraUniform camera{};
+    camera.view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    camera.projection =
+        glm::perspective(glm::radians(45.0f), extent.width / static_cast<float>(extent.height), 0.1f, 100.0f);
+    camera.projection[1][1] *= -1;
+    return camera;
 }
 
 void CApp::RenderLoop()
 {
+    if (m_appInfo.isHeadless)
+    {
+        RenderHeadless();
+        return;
+    }
+
+    auto &framePacer = m_deviceInstance->GetFramePacer();
+    // Without a frame rate cap, skipped frames are counted at the display's refresh rate
+    if (const auto monitor = glfwGetPrimaryMonitor())
+    {
+        if (const auto videoMode = glfwGetVideoMode(monitor))
+            framePacer.SetRefreshRate(videoMode->refreshRate);
+    }
     while (!glfwWindowShouldClose(mp_window->Window()))
     {
-        glfwPollEvents();
-        Draw();
+        if (framePacer.IsRedrawNeeded())
+        {
+            glfwPollEvents();
+        }
+        else
+        {
+            // Nothing to draw, let the GPU finish and sleep until an event arrives
+            m_deviceInstance->WaitForSubmittedFrames();
+            glfwWaitEventsTimeout(kIdleWaitSeconds);
+        }
+
+        if (mp_window->ConsumeWindowChange())
+            framePacer.MarkDirty(EFrameDirty::Window);
+        if (mp_window->ConsumeInput())
+            framePacer.MarkDirty(EFrameDirty::Gui);
+        // Uploads only complete through the acquire barriers a frame records
+        if (!m_deviceInstance->GetUploadContext().IsIdle())
+            framePacer.MarkDirty(EFrameDirty::Scene);
+
+        if (framePacer.ShouldRender())
+            Draw();
     }
 }
 
+void CApp::RenderHeadless()
+{
+    // Measures what the CPU spends per frame, the timeline waits only block once it runs a full ring ahead of the GPU
+    const auto startTime = std::chrono::high_resolution_clock::now();
+    for (auto frame = 0u; frame != m_appInfo.headlessFrameCount; ++frame)
+        Draw();
+    const auto elapsed =
+        std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime);
+
+    const auto frameCount = std::max(m_appInfo.headlessFrameCount, 1u);
+    fprintf(stdout, "Rendered %u headless frames in %.1f ms, %.3f ms per frame\n", m_appInfo.headlessFrameCount,
+            elapsed.count(), elapsed.count() / frameCount);
+    const auto &smoothedTiming = m_deviceInstance->GetFramePacer().GetSmoothedTiming();
+    fprintf(stdout, "Smoothed CPU frame %.3f ms, submit to completion %.3f ms\n", smoothedTiming.cpuFrameMs,
+            smoothedTiming.submitToCompleteMs);
+}
+
 void CApp::Cleanup()
 {
     for (auto &gameObject : m_vecGameObjects)
@@ -89,6 +208,7 @@ void CApp::Cleanup()
     {
         lightObject->ObjectCleanup();
     }
-    mp_gui->Cleanup();
+    if (mp_gui)
+        mp_gui->Cleanup();
     m_deviceInstance->Cleanup();
 }
\ No newline at end of file
@@ -35,7 +35,15 @@ class CApp
     std::vector<std::unique_ptr<CGameObject>> m_vecGameObjects{};
     std::vector<std::unique_ptr<CLightObject>> m_vecLightObjects{};
 
+    float m_orbitAngle = 0.0f;
+    double m_orbitCursorX = 0.0;
+    bool m_isOrbiting = false;
+
     void Draw();
+    void RecordScene();
+    void RecordDepth();
+    vkTools::vkPrimitives::SCameraUniform SampleCamera();
+    void RenderHeadless();
   public:
     explicit CApp(SAppInfo appInfo);
 
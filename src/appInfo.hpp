@@ -1,11 +1,38 @@
 #pragma once
 
+#include <vulkan/vulkan.h>
+
 struct SAppInfo
 {
     uint32_t width;
     uint32_t height;
+    // Instance layers, empty runs without validation and without the debug utils extension
     const std::vector<const char *> layers;
     const std::vector<const char *> deviceExtensions;
+    // Frames the CPU may record ahead of the GPU, independent of the swapchain image count
+    uint32_t framesInFlight = 2;
+    // Render into a ring of offscreen images instead of a window swapchain, no surface or present queue is needed
+    bool isHeadless = false;
+    // Frames a headless run renders before it reports its CPU frame time and exits
+    uint32_t headlessFrameCount = 1000;
+    // Falls back to FIFO when the surface doesn't support it, see CFramePacer for changing it at runtime
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+    // Frame rate cap, 0 leaves frames unlimited
+    double maxFrameRate = 0.0;
+    // Only draw when the scene, camera, GUI or window changed or an animation runs, wait for events otherwise. Starts
+    // with the animation paused, the default scene would never stop drawing otherwise.
+    bool isRenderOnDemand = false;
+    // Replay the scene's recorded command buffers until it changes instead of recording them every frame
+    bool isCommandCaching = false;
+    // Split the scene's draws across threads that record secondary command buffers
+    bool isParallelRecording = false;
+    // Threads recording in parallel including the main thread, 0 picks one per hardware thread up to a limit
+    uint32_t recordingThreadCount = 0;
+    // Scale the scene's resolution to hold the GPU frame time at targetGpuFrameMs, see CDynamicResolution
+    bool isDynamicResolution = false;
+    double targetGpuFrameMs = 1000.0 / 60.0;
+    // Render the opaque objects' depth from a position-only stream first and shade with an EQUAL depth test
+    bool isDepthPrepass = false;
 
     SAppInfo(uint32_t width, uint32_t height, const std::vector<const char *> layers,
              const std::vector<const char *> deviceExtensions)
@@ -37,5 +37,26 @@ std::array<VkVertexInputAttributeDescription, 3> SVertex::GetAttributeBindingDes
 
     return {posDesc, normalDesc, texDesc};
 }
+
+VkVertexInputBindingDescription SVertex::GetPositionInputBindingDescription()
+{
+    VkVertexInputBindingDescription description{};
+    description.binding = 0;
+    description.stride = sizeof(glm::vec3);
+    description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    return description;
+}
+
+VkVertexInputAttributeDescription SVertex::GetPositionAttributeDescription()
+{
+    VkVertexInputAttributeDescription posDesc{};
+    posDesc.binding = 0;
+    posDesc.location = 0;
+    posDesc.format = VK_FORMAT_R32G32B32_SFLOAT;
+    posDesc.offset = 0;
+
+    return posDesc;
+}
 } // namespace vkPrimitives
 } // namespace vkTools
@@ -19,18 +19,29 @@ struct SVertex
 
     static VkVertexInputBindingDescription GetInputBindingDescription();
     static std::array<VkVertexInputAttributeDescription, 3> GetAttributeBindingDescription();
+    // The depth pre-pass reads positions from their own tightly packed stream, see SMesh::positions
+    static VkVertexInputBindingDescription GetPositionInputBindingDescription();
+    static VkVertexInputAttributeDescription GetPositionAttributeDescription();
 };
 
 struct SMesh
 {
     std::string name;
     std::vector<SVertex> vertices;
+    // The vertices' positions again, a depth-only pass fetches 12 instead of 32 bytes per vertex
+    std::vector<glm::vec3> positions;
     std::vector<uint16_t> indices;
 };
 
-struct SMVP
+// Uniform set binding 0, pushed per object into the uniform ring
+struct SModelUniform
 {
     glm::mat4 model;
+};
+
+// Uniform set binding 1, written once per frame by CCameraLatch
+struct SCameraUniform
+{
     glm::mat4 view;
     glm::mat4 projection;
 };
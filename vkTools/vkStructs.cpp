@@ -14,7 +14,7 @@ VkApplicationInfo ApplicationInfo(const char *appName, uint32_t appVersion, cons
     applicationInfo.applicationVersion = appVersion;
     applicationInfo.pEngineName = engineName;
     applicationInfo.engineVersion = engineVersion;
-    applicationInfo.apiVersion = VK_API_VERSION_1_0;
+    applicationInfo.apiVersion = VK_API_VERSION_1_2;
 
     return applicationInfo;
 }
@@ -31,7 +31,9 @@ VkInstanceCreateInfo InstanceCreateInfo(VkApplicationInfo applicationInfo,
 #ifndef NDEBUG
     instanceCreateInfo.enabledLayerCount = vecLayers.size();
     instanceCreateInfo.ppEnabledLayerNames = vecLayers.data();
-    instanceCreateInfo.pNext = static_cast<VkDebugUtilsMessengerCreateInfoEXT *>(&debugInfo);
+    // Without layers there is no debug utils extension to chain the messenger to
+    if (!vecLayers.empty())
+        instanceCreateInfo.pNext = static_cast<VkDebugUtilsMessengerCreateInfoEXT *>(&debugInfo);
 #endif
     return instanceCreateInfo;
 }
@@ -142,6 +144,15 @@ VkPipelineViewportStateCreateInfo ViewportCreateInfo(const std::vector<VkViewpor
 
     return viewportStateCreateInfo;
 }
+VkPipelineViewportStateCreateInfo ViewportCreateInfo(uint32_t viewportCount, uint32_t scissorCount)
+{
+    VkPipelineViewportStateCreateInfo viewportStateCreateInfo{};
+    viewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportStateCreateInfo.viewportCount = viewportCount;
+    viewportStateCreateInfo.scissorCount = scissorCount;
+
+    return viewportStateCreateInfo;
+}
 VkGraphicsPipelineCreateInfo GraphicsPipelineCreateInfo(
     const std::vector<VkPipelineShaderStageCreateInfo> &vecShaderStagesInfos,
     const VkPipelineVertexInputStateCreateInfo &vertexInputInfo,
@@ -202,6 +213,16 @@ VkCommandBufferBeginInfo CommandBufferBeginInfo(VkCommandBufferUsageFlags usageF
 
     return commandBufferBeginInfo;
 }
+VkCommandBufferInheritanceInfo CommandBufferInheritanceInfo(VkRenderPass renderPass, uint32_t subpass)
+{
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = subpass;
+    inheritanceInfo.framebuffer = VK_NULL_HANDLE;
+
+    return inheritanceInfo;
+}
 VkSubmitInfo SubmitInfo(uint32_t cmdBufferCount, VkCommandBuffer &cmdBuffer,
                         const std::vector<VkSemaphore> &vecWaitSemaphores,
                         const std::vector<VkSemaphore> &vecSignalSemaphores, const VkPipelineStageFlags &flags)
@@ -32,6 +32,8 @@ VkPipelineDepthStencilStateCreateInfo DepthStencilStateCreateInfo();
 VkPipelineDynamicStateCreateInfo DynamicStateCreateInfo(const std::vector<VkDynamicState> &vecDynamicStates = {});
 VkPipelineViewportStateCreateInfo ViewportCreateInfo(const std::vector<VkViewport> &vecViewports,
                                                      const std::vector<VkRect2D> &vecScissors);
+// For pipelines with dynamic viewport and scissor state
+VkPipelineViewportStateCreateInfo ViewportCreateInfo(uint32_t viewportCount, uint32_t scissorCount);
 
 VkGraphicsPipelineCreateInfo GraphicsPipelineCreateInfo(
     const std::vector<VkPipelineShaderStageCreateInfo> &vecShaderStagesInfos,
@@ -50,6 +52,8 @@ VkDescriptorPoolCreateInfo DescriptorPoolCreateInfo(uint32_t maxSets, std::vecto
 VkCommandBufferAllocateInfo CommandBufferAllocateInfo(const VkCommandPool commandPool, uint32_t commandBufferCount = 1,
                                                       VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 VkCommandBufferBeginInfo CommandBufferBeginInfo(VkCommandBufferUsageFlags usageFlags);
+// For secondary command buffers that continue a render pass, the framebuffer is left unspecified
+VkCommandBufferInheritanceInfo CommandBufferInheritanceInfo(VkRenderPass renderPass, uint32_t subpass = 0);
 VkSubmitInfo SubmitInfo(uint32_t cmdBufferCount, VkCommandBuffer &cmdBuffer,
                         const std::vector<VkSemaphore> &vecWaitSemaphores = {},
                         const std::vector<VkSemaphore> &vecSignalSemaphores = {},